@@ -0,0 +1,93 @@
+// Microbenchmark of the accuracy tiers of the activation function, see quantum_state/psi_functions.hpp.
+// Reports the time per element of the batched host versions and the maximum deviation from the exact tier.
+//
+// usage: benchmark_activation_functions [num_elements] [max_abs_real_part] [max_abs_imag_part]
+
+#include "quantum_state/psi_functions.hpp"
+
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+
+using namespace rbm_on_gpu;
+
+
+template<typename Function>
+double ns_per_element(Function function, const unsigned int num_elements) {
+    constexpr auto num_repetitions = 20u;
+
+    function(); // warm-up
+
+    const auto begin = chrono::high_resolution_clock::now();
+    for(auto r = 0u; r < num_repetitions; r++) {
+        function();
+    }
+    const auto end = chrono::high_resolution_clock::now();
+
+    return chrono::duration<double, nano>(end - begin).count() / (num_repetitions * num_elements);
+}
+
+
+double max_error(const vector<complex_t>& result, const vector<complex_t>& reference) {
+    auto error = 0.0;
+    for(auto i = 0u; i < result.size(); i++) {
+        error = max(error, abs(result[i] - reference[i]));
+    }
+    return error;
+}
+
+
+template<ActivationTier tier>
+void benchmark_tier(
+    const char* name,
+    const vector<complex_t>& z,
+    const vector<complex_t>& logcosh_exact,
+    const vector<complex_t>& derivative_exact
+) {
+    const auto n = z.size();
+    vector<complex_t> result(n);
+
+    const auto logcosh_time = ns_per_element([&]() {logcosh_batch<tier>(result.data(), z.data(), n);}, n);
+    const auto logcosh_error = max_error(result, logcosh_exact);
+
+    const auto derivative_time = ns_per_element([&]() {logcosh_derivative_batch<tier>(result.data(), z.data(), n);}, n);
+    const auto derivative_error = max_error(result, derivative_exact);
+
+    printf(
+        "%-10s  logcosh: %7.3f ns  max-err %9.3e    tanh: %7.3f ns  max-err %9.3e\n",
+        name, logcosh_time, logcosh_error, derivative_time, derivative_error
+    );
+}
+
+
+int main(int argc, char** argv) {
+    const auto num_elements = argc > 1 ? unsigned(atoi(argv[1])) : 1u << 16;
+    const auto max_real = argc > 2 ? atof(argv[2]) : 4.0;
+    const auto max_imag = argc > 3 ? atof(argv[3]) : 0.5;
+
+    mt19937 rng(0);
+    uniform_real_distribution<double> random_real(-max_real, max_real);
+    uniform_real_distribution<double> random_imag(-max_imag, max_imag);
+
+    vector<complex_t> z(num_elements);
+    for(auto& z_i : z) {
+        z_i = complex_t(random_real(rng), random_imag(rng));
+    }
+
+    vector<complex_t> logcosh_exact(num_elements);
+    vector<complex_t> derivative_exact(num_elements);
+    logcosh_batch<ActivationTier::exact>(logcosh_exact.data(), z.data(), num_elements);
+    logcosh_derivative_batch<ActivationTier::exact>(derivative_exact.data(), z.data(), num_elements);
+
+    printf("%u elements, |Re(z)| < %g, |Im(z)| < %g\n", num_elements, max_real, max_imag);
+
+    benchmark_tier<ActivationTier::exact>("exact", z, logcosh_exact, derivative_exact);
+    benchmark_tier<ActivationTier::rational>("rational", z, logcosh_exact, derivative_exact);
+    benchmark_tier<ActivationTier::low_order>("low_order", z, logcosh_exact, derivative_exact);
+
+    return 0;
+}
@@ -27,6 +27,11 @@ struct std_type<complex_t> {
     using type = std::complex<double>;
 };
 
+template<typename T>
+struct std_type<const T> {
+    using type = typename std_type<T>::type;
+};
+
 } // namespace detail
 
 
@@ -130,4 +135,97 @@ struct Array : public vector<T>, public kernel::Array<T> {
 #endif // __PYTHONCC__
 };
 
+
+// Non-owning host view onto a block of an Array, e.g. onto the parameter store of a network.
+template<typename T>
+struct ArrayView {
+    T*     ptr;
+    size_t length;
+
+    inline ArrayView() : ptr(nullptr), length(0u) {}
+    inline ArrayView(T* ptr, const size_t length) : ptr(ptr), length(length) {}
+
+    inline T& operator[](const size_t i) {
+        return this->ptr[i];
+    }
+
+    inline const T& operator[](const size_t i) const {
+        return this->ptr[i];
+    }
+
+    inline size_t size() const {
+        return this->length;
+    }
+
+    inline bool empty() const {
+        return this->length == 0u;
+    }
+
+    inline T* data() {
+        return this->ptr;
+    }
+
+    inline const T* data() const {
+        return this->ptr;
+    }
+
+    inline T* begin() {
+        return this->ptr;
+    }
+
+    inline T* end() {
+        return this->ptr + this->length;
+    }
+
+    inline const T* begin() const {
+        return this->ptr;
+    }
+
+    inline const T* end() const {
+        return this->ptr + this->length;
+    }
+
+#ifdef __PYTHONCC__
+    template<unsigned int dim>
+    inline xt::pytensor<typename detail::std_type<T>::type, dim> to_pytensor(shape_t<dim> shape={}) const {
+        if(shape == shape_t<dim>()) {
+            shape[0] = (long int)this->size();
+        }
+
+        xt::pytensor<typename detail::std_type<T>::type, dim> result(shape);
+        memcpy(result.data(), this->ptr, sizeof(T) * this->size());
+        return result;
+    }
+#endif // __PYTHONCC__
+};
+
+
+// Read-only host view onto the real parts of a block of complex numbers,
+// used for real valued parameters which live in a complex parameter store.
+struct RealArrayView {
+    const complex_t* ptr;
+    size_t           length;
+
+    inline RealArrayView() : ptr(nullptr), length(0u) {}
+    inline RealArrayView(const complex_t* ptr, const size_t length) : ptr(ptr), length(length) {}
+
+    inline double operator[](const size_t i) const {
+        return this->ptr[i].real();
+    }
+
+    inline size_t size() const {
+        return this->length;
+    }
+
+#ifdef __PYTHONCC__
+    inline xt::pytensor<double, 1u> to_pytensor() const {
+        xt::pytensor<double, 1u> result(shape_t<1u>{(long int)this->size()});
+        for(auto i = 0u; i < this->size(); i++) {
+            result[i] = (*this)[i];
+        }
+        return result;
+    }
+#endif // __PYTHONCC__
+};
+
 } // namespace rbm_on_gpu
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+
+namespace rbm_on_gpu {
+
+using namespace std;
+
+
+// Holds a payload which is shared between copies until one of them is modified.
+// Copying is O(1). Before modifying the payload, its owner has to call make_unique(),
+// which copies the payload if it is shared and tells the owner to rebind its pointers into it.
+template<typename T>
+class CopyOnWrite {
+    shared_ptr<T> payload;
+
+    // number of references to the payload which escaped, e.g. as writable numpy views.
+    // Copies of a pinned instance can't share its payload since they couldn't see the writes.
+    unsigned int num_pins;
+
+public:
+    inline CopyOnWrite() : num_pins(0u) {}
+    inline explicit CopyOnWrite(shared_ptr<T> payload) : payload(move(payload)), num_pins(0u) {}
+
+    inline CopyOnWrite(const CopyOnWrite<T>& other)
+        : payload(other.num_pins > 0u ? make_shared<T>(*other.payload) : other.payload), num_pins(0u) {}
+
+    inline CopyOnWrite<T>& operator=(const CopyOnWrite<T>& other) {
+        this->payload = other.num_pins > 0u ? make_shared<T>(*other.payload) : other.payload;
+        this->num_pins = 0u;
+        return *this;
+    }
+
+    inline const T& operator*() const {
+        return *this->payload;
+    }
+
+    inline const T* operator->() const {
+        return this->payload.get();
+    }
+
+    // mutable access. Writing is only allowed after make_unique().
+    inline T& operator*() {
+        return *this->payload;
+    }
+
+    inline T* operator->() {
+        return this->payload.get();
+    }
+
+    inline bool unique() const {
+        return this->payload.use_count() == 1;
+    }
+
+    inline bool shares_payload_with(const CopyOnWrite<T>& other) const {
+        return this->payload == other.payload;
+    }
+
+    // returns true if the payload had to be copied.
+    inline bool make_unique() {
+        if(this->unique()) {
+            return false;
+        }
+
+        this->payload = make_shared<T>(*this->payload);
+        return true;
+    }
+
+    // returns true if the payload had to be copied. Each pin() has to be matched by an unpin()
+    // once the escaped reference is gone, such that copies can share the payload again.
+    inline bool pin() {
+        const auto copied = this->make_unique();
+        this->num_pins++;
+        return copied;
+    }
+
+    inline void unpin() {
+        if(this->num_pins > 0u) {
+            this->num_pins--;
+        }
+    }
+
+    inline bool pinned() const {
+        return this->num_pins > 0u;
+    }
+};
+
+} // namespace rbm_on_gpu
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace rbm_on_gpu {
+
+using namespace std;
+
+
+// Versioned binary container for the parameters of a network.
+//
+// layout:  [header | topology | padding | parameters]
+//
+// The topology is a list of 32-bit words whose meaning depends on the type of the network:
+//
+//  Psi:        M
+//  PsiDeep:    num_layers, then for each layer: size, lhs_connectivity, lhs_connections (lhs-connectivity x size)
+//  PsiDeepMin: same as PsiDeep
+//  PsiClassical: num_entries, then for each non-zero entry of the index of the variational parameters:
+//              uncompressed index, compressed index. The parameters are the variational parameters.
+//
+// The parameters are complex doubles, stored in the same order as the parameter store of the network.
+// They start at a multiple of 'params_alignment' bytes, hence they can be used in-place from a memory-mapped file.
+
+enum class NetworkType : uint32_t {
+    Psi = 1u,
+    PsiDeep = 2u,
+    PsiDeepMin = 3u,
+    PsiClassical = 4u
+};
+
+
+struct NetworkFileHeader {
+    static constexpr uint32_t current_version = 1u;
+    static constexpr uint32_t byte_order_mark = 0x01020304u;
+    static constexpr uint32_t flag_free_quantum_axis = 1u;
+
+    char        magic[8];           // "RBMonGPU"
+    uint32_t    version;
+    uint32_t    byte_order;         // 'byte_order_mark' as written by the producer
+    uint32_t    type;               // NetworkType
+    uint32_t    N;
+    uint32_t    flags;
+    uint32_t    reserved;
+    double      prefactor;
+    double      log_prefactor;
+    uint64_t    topology_offset;    // in bytes
+    uint64_t    topology_length;    // in 32-bit words
+    uint64_t    params_offset;      // in bytes
+    uint64_t    num_params;         // in complex numbers
+};
+
+static_assert(sizeof(NetworkFileHeader) == 80u, "unexpected padding of NetworkFileHeader");
+
+
+// Read-only memory mapping of a whole file. It is unmapped once the last owner is gone.
+class MappedFile {
+    void*   address;
+    size_t  length;
+
+public:
+    explicit MappedFile(const string& file_name);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    inline const char* data() const {
+        return reinterpret_cast<const char*>(this->address);
+    }
+
+    inline size_t size() const {
+        return this->length;
+    }
+};
+
+
+class NetworkFile {
+public:
+    static constexpr size_t params_alignment = 64u;
+
+    shared_ptr<const MappedFile> mapping;
+
+public:
+    // maps the file and validates its header. Throws runtime_error if it isn't a valid network file.
+    explicit NetworkFile(const string& file_name);
+
+    // true if the file starts with the magic of a network file
+    static bool is_network_file(const string& file_name);
+
+    static void write(
+        const string& file_name,
+        const NetworkType type,
+        const unsigned int N,
+        const uint32_t flags,
+        const double prefactor,
+        const double log_prefactor,
+        const vector<uint32_t>& topology,
+        const complex<double>* params,
+        const size_t num_params
+    );
+
+    inline const NetworkFileHeader& header() const {
+        return *reinterpret_cast<const NetworkFileHeader*>(this->mapping->data());
+    }
+
+    inline NetworkType type() const {
+        return static_cast<NetworkType>(this->header().type);
+    }
+
+    inline const uint32_t* topology() const {
+        return reinterpret_cast<const uint32_t*>(this->mapping->data() + this->header().topology_offset);
+    }
+
+    inline size_t topology_length() const {
+        return this->header().topology_length;
+    }
+
+    inline const complex<double>* params() const {
+        return reinterpret_cast<const complex<double>*>(this->mapping->data() + this->header().params_offset);
+    }
+
+    inline size_t num_params() const {
+        return this->header().num_params;
+    }
+
+    inline bool free_quantum_axis() const {
+        return this->header().flags & NetworkFileHeader::flag_free_quantum_axis;
+    }
+
+    // throws if the file doesn't hold a network of the given type.
+    void expect_type(const NetworkType type) const;
+};
+
+
+// Bounds-checked sequential reader of the topology section.
+class TopologyReader {
+    const uint32_t* position;
+    const uint32_t* end;
+
+public:
+    inline explicit TopologyReader(const NetworkFile& file)
+        : position(file.topology()), end(file.topology() + file.topology_length()) {}
+
+    // returns a pointer to the next 'length' words and skips them.
+    const uint32_t* read(const size_t length);
+
+    inline uint32_t read() {
+        return *this->read(1u);
+    }
+};
+
+
+// Topology words of a layered network, see the layout above.
+struct LayerTopology {
+    unsigned int                size;
+    unsigned int                lhs_connectivity;
+    const uint32_t*             lhs_connections;    // lhs-connectivity x size
+};
+
+vector<LayerTopology> read_layer_topology(const NetworkFile& file, const unsigned int N);
+void append_layer_topology(vector<uint32_t>& topology, const LayerTopology& layer);
+
+} // namespace rbm_on_gpu
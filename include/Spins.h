@@ -20,6 +20,34 @@
 
 namespace rbm_on_gpu {
 
+// bit helpers for masks of sites
+
+HDINLINE unsigned int bit_parity(const uint64_t mask) {
+    #ifdef __CUDA_ARCH__
+        return __popcll(mask) & 1u;
+    #else
+        return __builtin_parityll(mask);
+    #endif
+}
+
+HDINLINE unsigned int bit_count(const uint64_t mask) {
+    #ifdef __CUDA_ARCH__
+        return __popcll(mask);
+    #else
+        return __builtin_popcountll(mask);
+    #endif
+}
+
+// 'mask' must not be zero
+HDINLINE unsigned int lowest_set_bit(const uint64_t mask) {
+    #ifdef __CUDA_ARCH__
+        return __ffsll(mask) - 1;
+    #else
+        return __builtin_ctzll(mask);
+    #endif
+}
+
+
 struct Spins {
     using type = uint64_t;
 
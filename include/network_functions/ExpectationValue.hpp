@@ -1,6 +1,7 @@
 #pragma once
 
 #include "operator/Operator.hpp"
+#include "operator/MeasurementPlan.hpp"
 #include "types.h"
 
 #ifdef __PYTHONCC__
@@ -26,9 +27,13 @@ public:
     template<typename Psi_t, typename SpinEnsemble>
     complex<double> operator()(const Psi_t& psi, const Operator& operator_, const SpinEnsemble& spin_ensemble) const;
 
+    // All operators are measured in a single pass, see MeasurementPlan.
     template<typename Psi_t, typename SpinEnsemble>
     vector<complex<double>> operator()(const Psi_t& psi, const vector<Operator>& operator_list_host, const SpinEnsemble& spin_ensemble) const;
 
+    template<typename Psi_t, typename SpinEnsemble>
+    vector<complex<double>> operator()(const Psi_t& psi, const MeasurementPlan& plan, const SpinEnsemble& spin_ensemble) const;
+
     template<typename Psi_t, typename SpinEnsemble>
     pair<double, complex<double>> fluctuation(const Psi_t& psi, const Operator& operator_, const SpinEnsemble& spin_ensemble) const;
 
@@ -43,6 +48,11 @@ public:
         const Psi_t& psi, const Psi_t& psi_prime, const vector<Operator>& operator_list_host, const SpinEnsemble& spin_ensemble
     ) const;
 
+    template<typename Psi_t, typename SpinEnsemble>
+    vector<complex<double>> difference(
+        const Psi_t& psi, const Psi_t& psi_prime, const MeasurementPlan& plan, const SpinEnsemble& spin_ensemble
+    ) const;
+
     template<typename Psi_t, typename SpinEnsemble>
     complex<double> __call__(const Psi_t& psi, const Operator& operator_, const SpinEnsemble& spin_ensemble) const {
         return (*this)(psi, operator_, spin_ensemble);
@@ -53,6 +63,25 @@ public:
         return (*this)(psi, operator_, spin_ensemble);
     }
 
+    template<typename Psi_t, typename SpinEnsemble>
+    vector<complex<double>> __call__plan(const Psi_t& psi, const MeasurementPlan& plan, const SpinEnsemble& spin_ensemble) const {
+        return (*this)(psi, plan, spin_ensemble);
+    }
+
+    template<typename Psi_t, typename SpinEnsemble>
+    vector<complex<double>> difference_vector(
+        const Psi_t& psi, const Psi_t& psi_prime, const vector<Operator>& operator_, const SpinEnsemble& spin_ensemble
+    ) const {
+        return this->difference(psi, psi_prime, operator_, spin_ensemble);
+    }
+
+    template<typename Psi_t, typename SpinEnsemble>
+    vector<complex<double>> difference_plan(
+        const Psi_t& psi, const Psi_t& psi_prime, const MeasurementPlan& plan, const SpinEnsemble& spin_ensemble
+    ) const {
+        return this->difference(psi, psi_prime, plan, spin_ensemble);
+    }
+
 #ifdef __PYTHONCC__
 
     template<typename Psi_t, typename SpinEnsemble>
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Array.hpp"
+#include "types.h"
+
+
+namespace rbm_on_gpu {
+
+class PsiClassical;
+class PsiDeepMin;
+
+// Networks of up to this many spins can be tabulated. The table takes 16 bytes per configuration.
+constexpr unsigned int log_psi_table_max_N = 26u;
+
+// Evaluates log(psi(s)) without the prefactor for all 2^N configurations s, indexed by s.configuration.
+// Networks residing on the GPU are tabulated there, the others are split over 'num_threads' host threads,
+// where zero picks the number of hardware threads.
+// The table is a snapshot: it has to be rebuilt once the parameters of the network change.
+// Only PsiClassical looks up a table in log_psi_s(), see PsiClassical::tabulate() for wrapping other networks.
+template<typename Psi_t>
+Array<complex_t> log_psi_table(const Psi_t& psi, const unsigned int num_threads = 0u);
+
+// always evaluated on the host
+template<>
+Array<complex_t> log_psi_table(const PsiClassical& psi, const unsigned int num_threads);
+template<>
+Array<complex_t> log_psi_table(const PsiDeepMin& psi, const unsigned int num_threads);
+
+} // namespace rbm_on_gpu
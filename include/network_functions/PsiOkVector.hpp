@@ -28,12 +28,13 @@ pair<Array<complex_t>, Array<double>> psi_O_k_vector(const Psi_t& psi, const Spi
 
 #ifdef __PYTHONCC__
 
+// indexed like the parameters, psi_O_k_vector() writes all of them
 template<typename Psi_t>
 inline xt::pytensor<complex<double>, 1> psi_O_k_vector_py(
     const Psi_t& psi, const Spins& spins
 ) {
     auto result = xt::pytensor<complex<double>, 1>(
-        std::array<long int, 1>({static_cast<long int>(psi.get_O_k_length())})
+        std::array<long int, 1>({static_cast<long int>(psi.get_num_params())})
     );
 
     psi_O_k_vector(result.data(), psi, spins);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "operator/Operator.hpp"
+#include "operator/SpinBasis.hpp"
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+
+
+namespace rbm_on_gpu {
+
+// y = O x on the states of 'basis', without storing the matrix. Each thread owns a contiguous range of rows and gathers
+// < s | O | s' > x(s') over the connected configurations s' of its rows, hence no atomics are needed.
+void apply_operator(
+    std::complex<double>* y, const Operator& operator_, const SpinBasis& basis, const std::complex<double>* x,
+    unsigned int num_threads = 0u
+);
+
+struct GroundState {
+    SpinBasis                           basis;
+    double                              energy;
+    // normalized, indexed like 'basis', largest component real and positive
+    std::vector<std::complex<double>>   amplitudes;
+    double                              residual;       // | O x - energy x |
+    unsigned int                        num_iterations;
+    bool                                converged;
+
+    // 'amplitudes' embedded into the 2^N configurations, ordered like psi_vector()
+    std::vector<std::complex<double>> full_vector() const;
+};
+
+// Lowest eigenpair of the hermitian 'operator_' on 'basis' by the Lanczos method. Only three basis vectors and the
+// real diagonal are kept during the iteration, the ground state is assembled in a second pass regenerating the same
+// Krylov vectors.
+// Stops once the estimated residual drops below 'tolerance' times max(1, |energy|), at a breakdown of the recurrence
+// or after 'max_iterations' steps. The start vector is a pseudo-random function of 'seed' and the configurations,
+// hence it does not depend on the number of threads.
+GroundState ground_state(
+    const Operator&     operator_,
+    const SpinBasis&    basis,
+    const unsigned int  max_iterations = 1000u,
+    const double        tolerance = 1e-10,
+    unsigned int        num_threads = 0u,
+    const uint64_t      seed = 0u
+);
+
+} // namespace rbm_on_gpu
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "operator/Operator.hpp"
+#include "operator/QuadraticForm.hpp"
+#include "Spins.h"
+#include "cuda_complex.hpp"
+#include "types.h"
+
+#include <vector>
+
+
+namespace rbm_on_gpu {
+
+namespace kernel {
+
+// Several operators measured in a single pass. The compiled strings of all operators are merged and grouped by
+// their flip mask, such that each distinct connected configuration s' is evaluated only once per sample and its
+// contribution is scattered into every operator which connects s to s'.
+class MeasurementPlan {
+public:
+    unsigned int    num_operators;
+    unsigned int    num_groups;
+    // total number of strings
+    unsigned int    num_terms;
+
+    unsigned int*   group_begin;        // index of the first term of each group, followed by 'num_terms'
+    Spins::type*    group_flip_masks;   // diagonal group first, if there is one
+    complex_t*      coefficients;       // per term, compiled like Operator::compiled_coefficients
+    Spins::type*    sign_masks;         // per term
+    unsigned int*   operator_index;     // per term, the operator it belongs to
+
+    // quadratic forms of the operators which have one, see Operator::quadratic_form
+    unsigned int    num_quadratic_forms;
+    QuadraticForm*  quadratic_forms;            // pointing into 'quadratic_form_data'
+    unsigned int*   quadratic_form_operator;    // the operator each form belongs to
+    complex_t*      quadratic_form_data;
+    unsigned int    quadratic_form_data_size;
+
+public:
+
+#ifdef __CUDACC__
+
+    // Calls function(i, contribution) for every term, where i is the index of its operator.
+    // The contributions of each operator sum up to its local energy.
+    template<typename Psi_t, typename Function>
+    HDINLINE
+    void foreach_local_energy(
+        const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles, Function function
+    ) const {
+        #include "cuda_kernel_defines.h"
+
+        SHARED typename Psi_t::Angles angles_prime;
+        this->foreach_local_energy(psi, spins, log_psi, angles, angles_prime, function);
+    }
+
+    // Keeps the angles of the connected configurations in the shared scratch 'angles_prime', updated from 'angles'
+    // by flipping the spins of the group's flip mask, such that a caller which measures several networks gets along
+    // with a single scratch.
+    template<typename Psi_t, typename Function>
+    HDINLINE
+    void foreach_local_energy(
+        const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles,
+        typename Psi_t::Angles& angles_prime, Function function
+    ) const {
+        #include "cuda_kernel_defines.h"
+
+        for(auto f = 0u; f < this->num_quadratic_forms; f++) {
+            const auto& quadratic_form = this->quadratic_forms[f];
+
+            LOOP(i, quadratic_form.num_rows()) {
+                function(this->quadratic_form_operator[f], quadratic_form.row(i, spins.configuration));
+            }
+        }
+
+        SHARED complex_t psi_ratio;
+
+        for(auto n = 0u; n < this->num_groups; n++) {
+            const auto flip_mask = this->group_flip_masks[n];
+
+            if(flip_mask == 0u) {
+                SINGLE {
+                    psi_ratio = complex_t(1.0, 0.0);
+                }
+            }
+            else {
+                const auto spins_prime = Spins(spins.configuration ^ flip_mask);
+
+                angles_prime.init(psi, angles);
+
+                MULTI(j, psi.get_num_angles())
+                {
+                    for(auto remaining = flip_mask; remaining != 0u; remaining &= remaining - 1u) {
+                        psi.flip_spin_of_jth_angle(j, lowest_set_bit(remaining), spins_prime, angles_prime);
+                    }
+                }
+
+                SHARED complex_t log_psi_prime;
+                psi.log_psi_s(log_psi_prime, spins_prime, angles_prime);
+
+                SINGLE {
+                    psi_ratio = exp(log_psi_prime - log_psi);
+                }
+            }
+            SYNC;
+
+            const auto group_begin = this->group_begin[n];
+            LOOP(term, this->group_begin[n + 1u] - group_begin) {
+                const auto t = group_begin + term;
+                const auto coefficient = (
+                    bit_parity(spins.configuration & this->sign_masks[t]) ? -this->coefficients[t] : this->coefficients[t]
+                );
+
+                function(this->operator_index[t], coefficient * psi_ratio);
+            }
+            SYNC;
+        }
+    }
+
+#endif // __CUDACC__
+
+    inline MeasurementPlan get_kernel() const {
+        return *this;
+    }
+};
+
+} // namespace kernel
+
+
+class MeasurementPlan : public kernel::MeasurementPlan {
+public:
+    bool gpu;
+
+private:
+    // The quadratic forms on the host. The 'data' of each form is set up from its offset into 'quadratic_form_data'
+    // whenever the kernel's forms are allocated, see allocate_quadratic_forms().
+    std::vector<kernel::QuadraticForm>  host_quadratic_forms;
+    std::vector<unsigned int>           host_quadratic_form_offsets;
+    std::vector<unsigned int>           host_quadratic_form_operator;
+
+public:
+    MeasurementPlan(const std::vector<Operator>& operators, const bool gpu);
+    MeasurementPlan(const MeasurementPlan& other);
+    ~MeasurementPlan() noexcept(false);
+
+    MeasurementPlan& operator=(const MeasurementPlan& other) = delete;
+
+private:
+    void allocate_quadratic_forms(const complex_t* quadratic_form_data, const bool pointer_on_gpu);
+    void allocate_memory_and_initialize(
+        const unsigned int* group_begin,
+        const Spins::type*  group_flip_masks,
+        const complex_t*    coefficients,
+        const Spins::type*  sign_masks,
+        const unsigned int* operator_index,
+        const bool          pointers_on_gpu
+    );
+};
+
+} // namespace rbm_on_gpu
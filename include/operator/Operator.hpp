@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MatrixElement.hpp"
+#include "QuadraticForm.hpp"
 #include "Spins.h"
 #include "cuda_complex.hpp"
 #include "types.h"
@@ -21,10 +22,15 @@
 #include <vector>
 #include <complex>
 #include <memory>
+#include <string>
+#include <cstdint>
 
 
 namespace rbm_on_gpu {
 
+// Signature of the group coefficients generated by Operator::enable_jit(), writing the real and imaginary part to 'result'.
+using JitGroupCoefficient = void (*)(uint64_t configuration, unsigned int group, double* result);
+
 namespace kernel {
 
 class Operator {
@@ -38,78 +44,147 @@ public:
     // table's width
     unsigned int    max_string_length;
 
-public:
+    // Every string compiled into bit masks, such that a matrix element is a handful of bit operations:
+    // < s | string = compiled_coefficient * (-1)^popcount(s & sign_mask) * < s ^ flip_mask |
+    //
+    // The strings are grouped by their flip mask, i.e. by the configuration s' they connect s to.
+    // Strings without flips form the first group, if there are any.
+    unsigned int    num_groups;
+    unsigned int    num_compiled_strings;   // without those moved into 'quadratic_form'
+    unsigned int*   group_begin;            // index of the first string of each group, followed by 'num_compiled_strings'
+    Spins::type*    group_flip_masks;       // sites of X and Y
+    complex_t*      compiled_coefficients;  // per string in the order of the groups, including the phase
+                                            // (-i)^(number of Y) and the sign of a down spin
+    Spins::type*    sign_masks;             // per string, sites of Y and Z
+
+    // Dense Z and ZZ strings are evaluated as a whole. If present, the first group is the diagonal one.
+    QuadraticForm   quadratic_form;
+
+    // Per site, the strings of the diagonal group acting on it, see diagonal_energy_difference().
+    unsigned int    num_sites;              // highest site of the diagonal group plus one
+    unsigned int*   site_begin;             // index of the first entry of each site, followed by the number of entries
+    unsigned int*   site_strings;           // indices into the diagonal group
+
+    // host only: runtime-compiled replacement of the loop over the strings of a group, see Operator::enable_jit()
+    JitGroupCoefficient jit_group_coefficient;
 
-#ifdef __CUDACC__
+public:
 
-    template<typename Psi_t>
     HDINLINE
-    MatrixElement nth_matrix_element(const Spins& spins, const int n, const Psi_t& psi, typename Psi_t::Angles& angles) const {
-        #include "cuda_kernel_defines.h"
-        MatrixElement result = {this->coefficients[n], spins};
+    complex_t group_coefficient(const Spins& spins, const unsigned int group) const {
+        complex_t result = (
+            this->quadratic_form.N > 0u && this->is_diagonal(group) ? this->quadratic_form(spins) : complex_t(0.0, 0.0)
+        );
 
-        for(auto table_index = n * this->max_string_length; true; table_index++) {
-            const auto pauli_index = this->pauli_indices[table_index];
-            if(pauli_index == -1) {
-                break;
+        #ifndef __CUDA_ARCH__
+        if(this->jit_group_coefficient != nullptr) {
+            double strings_result[2];
+            this->jit_group_coefficient(spins.configuration, group, strings_result);
+
+            return result + complex_t(strings_result[0], strings_result[1]);
+        }
+        #endif
+
+        for(auto n = this->group_begin[group]; n < this->group_begin[group + 1u]; n++) {
+            if(bit_parity(spins.configuration & this->sign_masks[n])) {
+                result -= this->compiled_coefficients[n];
             }
+            else {
+                result += this->compiled_coefficients[n];
+            }
+        }
 
-            /*
-            < s | sigma_x =          < -s |
-            < s | sigma_y = -i * s * < -s |
-            < s | sigma_z = s *       < s |
-            */
+        return result;
+    }
 
-            PauliMatrices pauli_type = this->pauli_types[table_index];
-            if(pauli_type == PauliMatrices::SigmaX) {
-                result.spins = result.spins.flip(pauli_index);
+    HDINLINE
+    bool is_diagonal(const unsigned int group) const {
+        return this->group_flip_masks[group] == 0u;
+    }
 
-                MULTI(j, psi.get_num_angles())
-                {
-                    psi.flip_spin_of_jth_angle(j, pauli_index, result.spins, angles);
-                }
-            }
-            else if(pauli_type == PauliMatrices::SigmaY) {
-                result.spins = result.spins.flip(pauli_index);
+#ifdef __CUDACC__
 
-                MULTI(j, psi.get_num_angles())
-                {
-                    psi.flip_spin_of_jth_angle(j, pauli_index, result.spins, angles);
-                }
+    // Flips the sites of a group and updates 'angles' accordingly, which have to belong to 'spins'.
+    template<typename Psi_t>
+    HDINLINE
+    Spins flip_group(const Spins& spins, const unsigned int group, const Psi_t& psi, typename Psi_t::Angles& angles) const {
+        #include "cuda_kernel_defines.h"
 
-                result.coefficient *= complex_t(0.0, -1.0) * spins[pauli_index];
-            }
-            else if(pauli_type == PauliMatrices::SigmaZ) {
-                result.coefficient *= spins[pauli_index];
+        const auto flip_mask = this->group_flip_masks[group];
+        const auto result = Spins(spins.configuration ^ flip_mask);
+
+        // all flipped sites at once. Each angle only depends on the new value of the flipped spin.
+        MULTI(j, psi.get_num_angles())
+        {
+            for(auto remaining = flip_mask; remaining != 0u; remaining &= remaining - 1u) {
+                psi.flip_spin_of_jth_angle(j, lowest_set_bit(remaining), result, angles);
             }
         }
 
         return result;
     }
 
+    // < s | O | s' > of the n-th group together with s'. 'n' indexes the groups of strings sharing a flip mask,
+    // not the strings themselves, hence the coefficient is the sum over all strings of the group.
+    template<typename Psi_t>
+    HDINLINE
+    MatrixElement nth_group_matrix_element(
+        const Spins& spins, const unsigned int n, const Psi_t& psi, typename Psi_t::Angles& angles
+    ) const {
+        /*
+        < s | sigma_x =          < -s |
+        < s | sigma_y = -i * s * < -s |
+        < s | sigma_z = s *       < s |
+        */
+
+        return {this->group_coefficient(spins, n), this->flip_group(spins, n, psi, angles)};
+    }
+
     template<typename Psi_t>
     HDINLINE
     void local_energy(complex_t& result, const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles) const {
         #include "cuda_kernel_defines.h"
+
+        SHARED typename Psi_t::Angles angles_prime;
+        this->local_energy(result, psi, spins, log_psi, angles, angles_prime);
+    }
+
+    // Keeps the angles of the connected configurations in 'angles_prime', which has to be shared. Kernels holding
+    // further angles pass the same scratch to every call, such that their shared memory stays bounded.
+    template<typename Psi_t>
+    HDINLINE
+    void local_energy(
+        complex_t& result, const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles,
+        typename Psi_t::Angles& angles_prime
+    ) const {
+        #include "cuda_kernel_defines.h"
         // CAUTION: 'result' is only updated by the first thread.
 
         SINGLE {
             result = complex_t(0.0, 0.0);
         }
 
-        SHARED typename Psi_t::Angles angles_prime;
+        // One evaluation of psi per distinct s'. The coefficient is the same in all threads.
+        for(auto n = 0u; n < this->num_groups; n++) {
+            const auto coefficient = this->group_coefficient(spins, n);
+            if(coefficient.real() == 0.0 && coefficient.imag() == 0.0) {
+                continue;
+            }
 
-        for(auto n = 0u; n < this->num_strings; n++) {
-            angles_prime.init(psi, angles);
+            if(this->is_diagonal(n)) {
+                SINGLE {
+                    result += coefficient;
+                }
+                continue;
+            }
 
-            const auto matrix_element = this->nth_matrix_element(
-                spins, n, psi, angles_prime
-            );
+            angles_prime.init(psi, angles);
+            const auto spins_prime = this->flip_group(spins, n, psi, angles_prime);
 
             SHARED complex_t log_psi_prime;
-            psi.log_psi_s(log_psi_prime, matrix_element.spins, angles_prime);
+            psi.log_psi_s(log_psi_prime, spins_prime, angles_prime);
             SINGLE {
-                result += matrix_element.coefficient * exp(log_psi_prime - log_psi);
+                result += coefficient * exp(log_psi_prime - log_psi);
             }
         }
     }
@@ -124,22 +199,53 @@ public:
         }
         SYNC;
 
-        // for(auto n = 0u; n < this->num_strings; n++) {
-        LOOP(n, this->num_strings) {
-            auto string_result = this->coefficients[n];
+        // only strings without flips contribute to the diagonal
+        if(this->num_groups > 0u && this->is_diagonal(0u)) {
+            LOOP(n, this->group_begin[1]) {
+                const auto string_result = (
+                    bit_parity(spins.configuration & this->sign_masks[n]) ?
+                        -this->compiled_coefficients[n] : this->compiled_coefficients[n]
+                );
 
-            for(auto table_index = n * this->max_string_length; true; table_index++) {
-                const auto pauli_index = this->pauli_indices[table_index];
-                if(pauli_index == -1) {
-                    break;
-                }
+                generic_atomicAdd(&result, string_result);
+            }
+        }
+        LOOP(i, this->quadratic_form.num_rows()) {
+            generic_atomicAdd(&result, this->quadratic_form.row(i, spins.configuration));
+        }
+        SYNC;
+    }
+
+    // Change of the diagonal energy when flipping 'position', given the spins after the flip.
+    // Only the strings acting on 'position' are visited, they all change their sign.
+    HDINLINE
+    complex_t diagonal_energy_difference(const Spins& new_spins, const unsigned int position) const {
+        complex_t result = this->quadratic_form.flip_difference(position, new_spins.configuration);
 
-                string_result *= spins[pauli_index];
+        if(position < this->num_sites) {
+            for(auto k = this->site_begin[position]; k < this->site_begin[position + 1u]; k++) {
+                const auto n = this->site_strings[k];
+
+                if(bit_parity(new_spins.configuration & this->sign_masks[n])) {
+                    result -= 2.0 * this->compiled_coefficients[n];
+                }
+                else {
+                    result += 2.0 * this->compiled_coefficients[n];
+                }
             }
+        }
 
-            generic_atomicAdd(&result, string_result);
+        return result;
+    }
+
+    // Serial counterpart of diagonal_energy(), evaluated by a single thread.
+    HDINLINE
+    complex_t diagonal_energy(const Spins& spins) const {
+        if(this->num_groups > 0u && this->is_diagonal(0u)) {
+            return this->group_coefficient(spins, 0u);
         }
-        SYNC;
+
+        return this->quadratic_form(spins);
     }
 
     template<typename Psi_t, typename Function>
@@ -147,29 +253,50 @@ public:
     void foreach_E_k_s_prime(
         const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles, Function function
     ) const {
-        // E_k = sum_s' E_ss' * psi(s') / psi(s) * O_k(s')
         #include "cuda_kernel_defines.h"
 
         SHARED typename Psi_t::Angles angles_primes;
+        this->foreach_E_k_s_prime(psi, spins, log_psi, angles, angles_primes, function);
+    }
 
-        for(auto n = 0u; n < this->num_strings; n++) {
-            angles_primes.init(psi, angles);
+    // With a shared scratch for the connected configurations, see local_energy().
+    template<typename Psi_t, typename Function>
+    HDINLINE
+    void foreach_E_k_s_prime(
+        const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles,
+        typename Psi_t::Angles& angles_primes, Function function
+    ) const {
+        // E_k = sum_s' E_ss' * psi(s') / psi(s) * O_k(s')
+        #include "cuda_kernel_defines.h"
 
-            const auto matrix_element = this->nth_matrix_element(
-                spins, n, psi, angles_primes
-            );
+        for(auto n = 0u; n < this->num_groups; n++) {
+            const auto coefficient = this->group_coefficient(spins, n);
+            if(coefficient.real() == 0.0 && coefficient.imag() == 0.0) {
+                continue;
+            }
 
-            SHARED complex_t log_psi_prime;
-            psi.log_psi_s(log_psi_prime, matrix_element.spins, angles_primes);
+            angles_primes.init(psi, angles);
+            const auto spins_prime = this->flip_group(spins, n, psi, angles_primes);
 
             SHARED complex_t E_s_prime;
-            SINGLE
-            {
-                E_s_prime = matrix_element.coefficient * exp(log_psi_prime - log_psi);
+            if(this->is_diagonal(n)) {
+                SINGLE
+                {
+                    E_s_prime = coefficient;
+                }
+            }
+            else {
+                SHARED complex_t log_psi_prime;
+                psi.log_psi_s(log_psi_prime, spins_prime, angles_primes);
+
+                SINGLE
+                {
+                    E_s_prime = coefficient * exp(log_psi_prime - log_psi);
+                }
             }
 
             psi.foreach_O_k(
-                matrix_element.spins,
+                spins_prime,
                 angles_primes,
                 [&](const unsigned int k, const complex_t& O_k_element) {
                     function(k, E_s_prime * O_k_element);
@@ -188,10 +315,24 @@ public:
 } // namespace kernel
 
 
+// Outcome of Operator::compress()
+struct CompressionReport {
+    unsigned int    num_strings;
+    unsigned int    num_merged_strings;     // after merging identical strings
+    unsigned int    num_compressed_strings; // after dropping small ones
+    double          error_bound;            // sum of the dropped coefficients, bounding the norm of the difference
+    double          relative_error_bound;   // relative to the sum of all merged coefficients
+};
+
+
 class Operator : public kernel::Operator {
 public:
     bool gpu;
 
+    // Shared object loaded by enable_jit(), closed when the last copy of this operator lets go of it. Kernel copies
+    // only hold the function pointer and thus must not outlive the operator they are taken from.
+    std::shared_ptr<void> jit_library;
+
 public:
 
     Operator(
@@ -252,6 +393,29 @@ public:
     Operator(const Operator& other);
     ~Operator() noexcept(false);
 
+    // Canonical form of this operator: one symbol per site in ascending order, identical strings merged and those
+    // below 'tolerance' times the largest coefficient dropped. The strings are ordered by the sites they flip.
+    Operator compress(const double tolerance, CompressionReport& report) const;
+
+    // Emits C++ code with the compiled strings unrolled into constants, builds it with the system compiler
+    // ($RBM_ON_GPU_JIT_CXX, $CXX or c++) and loads it, such that local energies on the host no longer loop over
+    // the tables. The shared object is cached by a hash of the code in 'cache_directory', which defaults to
+    // $RBM_ON_GPU_JIT_CACHE or ~/.cache/rbm_on_gpu. The directory is created with mode 0700 and rejected unless
+    // it is owned by the user and not writable by others. A cached library is only loaded if the code stored next
+    // to it is identical. Returns false if the operator resides on the GPU or if compiling or loading fails, in
+    // which case the interpreted strings are used as before.
+    bool enable_jit(const std::string& cache_directory = "");
+    void disable_jit();
+
+    inline bool jit_enabled() const {
+        return this->jit_group_coefficient != nullptr;
+    }
+
+    // dynamic shared memory needed by local_energy(), see OperatorProduct
+    inline unsigned int get_shared_memory_size() const {
+        return 0u;
+    }
+
 private:
     void allocate_memory_and_initialize(
         const std::complex<double>* coefficients,
@@ -268,6 +432,22 @@ private:
     void get_coefficients(complex<double>* coefficients) const;
     void get_pauli_types(int* pauli_types) const;
     void get_pauli_indices(int* pauli_indices) const;
+
+    bool load_jit_library(const std::string& path);
+    std::string jit_source() const;
+
+    void compile_to_masks(
+        std::vector<std::complex<double>>&  compiled_coefficients,
+        std::vector<Spins::type>&           flip_masks,
+        std::vector<Spins::type>&           sign_masks
+    ) const;
+    void compile_strings();
+    // fills 'quadratic_form' from the compiled strings and returns which of them went into it
+    std::vector<bool> compile_quadratic_form(
+        const std::vector<std::complex<double>>&    compiled_coefficients,
+        const std::vector<Spins::type>&             flip_masks,
+        const std::vector<Spins::type>&             sign_masks
+    );
 };
 
 } // namespace rbm_on_gpu
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "operator/Operator.hpp"
+#include "Spins.h"
+#include "cuda_complex.hpp"
+#include "types.h"
+
+#include <vector>
+
+
+namespace rbm_on_gpu {
+
+namespace kernel {
+
+// A product A_1 A_2 ... A_K of operators, applied factor by factor instead of being expanded into strings:
+//
+// < s | A_1 A_2 ... A_K = sum_s' < s | A_1 | s' > < s' | A_2 ... A_K
+//
+// After k factors, s is connected to configurations s ^ m, where the set of flip masks m does not depend on s.
+// These sets are built once with duplicates merged, together with the transitions (m, group of A_k) -> m ^ flip mask.
+// Per sample only the amplitudes of the distinct masks are propagated and psi is evaluated once per distinct
+// final configuration. The transitions of the last factor are sorted by their target, such that the final amplitudes
+// are summed up one at a time and need no buffer. The two buffers of the intermediate amplitudes are sized by the
+// actual number of masks and kept in dynamic shared memory, see get_shared_memory_size().
+class OperatorProduct {
+public:
+    // upper bound for the number of distinct configurations after each factor but the last
+    static constexpr unsigned int max_configurations = MAX_DYNAMIC_SHARED_MEMORY / (2u * sizeof(complex_t));
+
+    unsigned int    num_factors;
+    Operator*       factors;
+
+    unsigned int*   num_masks;              // per factor, the number of distinct flip masks before applying it,
+                                            // followed by the number of final flip masks
+    unsigned int    max_masks;              // the largest number of flip masks before applying a factor
+
+    unsigned int    num_transitions;
+    unsigned int*   transition_begin;       // index of the first transition of each factor, followed by 'num_transitions'
+    unsigned int*   transition_source;      // index of the flip mask before applying the factor
+    Spins::type*    transition_source_mask; // the flip mask itself
+    unsigned int*   transition_group;       // group of the factor
+    unsigned int*   transition_target;      // index of the flip mask after applying the factor
+
+    Spins::type*    final_flip_masks;
+    unsigned int*   final_begin;            // per final flip mask, the index of its first transition of the last factor,
+                                            // followed by 'num_transitions'
+
+public:
+
+#ifdef __CUDACC__
+
+    template<typename Psi_t>
+    HDINLINE
+    void local_energy(complex_t& result, const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles) const {
+        #include "cuda_kernel_defines.h"
+
+        SHARED typename Psi_t::Angles angles_prime;
+        this->local_energy(result, psi, spins, log_psi, angles, angles_prime);
+    }
+
+    // With a shared scratch for the angles of the final configurations, see Operator::local_energy().
+    // Requires get_shared_memory_size() bytes of dynamic shared memory.
+    template<typename Psi_t>
+    HDINLINE
+    void local_energy(
+        complex_t& result, const Psi_t& psi, const Spins& spins, const complex_t& log_psi, const typename Psi_t::Angles& angles,
+        typename Psi_t::Angles& angles_prime
+    ) const {
+        #include "cuda_kernel_defines.h"
+        // CAUTION: 'result' is only updated by the first thread.
+
+        auto source = static_cast<complex_t*>(dynamic_shared_memory());
+        auto target = source + this->max_masks;
+
+        SINGLE {
+            result = complex_t(0.0, 0.0);
+            source[0] = complex_t(1.0, 0.0);
+        }
+
+        for(auto k = 0u; k + 1u < this->num_factors; k++) {
+            LOOP(m, this->num_masks[k + 1u]) {
+                target[m] = complex_t(0.0, 0.0);
+            }
+            SYNC;
+
+            const auto& factor = this->factors[k];
+            const auto transition_begin = this->transition_begin[k];
+
+            LOOP(transition, this->transition_begin[k + 1u] - transition_begin) {
+                const auto t = transition_begin + transition;
+                const auto amplitude = source[this->transition_source[t]];
+
+                if(amplitude.real() != 0.0 || amplitude.imag() != 0.0) {
+                    const auto coefficient = factor.group_coefficient(
+                        Spins(spins.configuration ^ this->transition_source_mask[t]), this->transition_group[t]
+                    );
+                    generic_atomicAdd(&target[this->transition_target[t]], amplitude * coefficient);
+                }
+            }
+            SYNC;
+
+            const auto swap = source;
+            source = target;
+            target = swap;
+        }
+
+        // one evaluation of psi per distinct final configuration
+        const auto& last_factor = this->factors[this->num_factors - 1u];
+
+        SHARED complex_t amplitude;
+        SHARED complex_t log_psi_prime;
+
+        for(auto m = 0u; m < this->num_masks[this->num_factors]; m++) {
+            SINGLE {
+                amplitude = complex_t(0.0, 0.0);
+            }
+            SYNC;
+
+            const auto final_begin = this->final_begin[m];
+            LOOP(transition, this->final_begin[m + 1u] - final_begin) {
+                const auto t = final_begin + transition;
+                const auto source_amplitude = source[this->transition_source[t]];
+
+                if(source_amplitude.real() != 0.0 || source_amplitude.imag() != 0.0) {
+                    const auto coefficient = last_factor.group_coefficient(
+                        Spins(spins.configuration ^ this->transition_source_mask[t]), this->transition_group[t]
+                    );
+                    generic_atomicAdd(&amplitude, source_amplitude * coefficient);
+                }
+            }
+            SYNC;
+
+            if(amplitude.real() == 0.0 && amplitude.imag() == 0.0) {
+                continue;
+            }
+
+            const auto flip_mask = this->final_flip_masks[m];
+            if(flip_mask == 0u) {
+                SINGLE {
+                    result += amplitude;
+                }
+                continue;
+            }
+
+            angles_prime.init(psi, angles);
+
+            const auto spins_prime = Spins(spins.configuration ^ flip_mask);
+            MULTI(j, psi.get_num_angles())
+            {
+                for(auto remaining = flip_mask; remaining != 0u; remaining &= remaining - 1u) {
+                    psi.flip_spin_of_jth_angle(j, lowest_set_bit(remaining), spins_prime, angles_prime);
+                }
+            }
+
+            psi.log_psi_s(log_psi_prime, spins_prime, angles_prime);
+            SINGLE {
+                result += amplitude * exp(log_psi_prime - log_psi);
+            }
+        }
+    }
+
+#endif // __CUDACC__
+
+    inline OperatorProduct get_kernel() const {
+        return *this;
+    }
+};
+
+} // namespace kernel
+
+
+class OperatorProduct : public kernel::OperatorProduct {
+public:
+    bool gpu;
+
+    // own copies of the factors, 'factors' holds their kernels
+    std::vector<Operator> operators;
+
+public:
+    OperatorProduct(const std::vector<Operator>& operators, const bool gpu);
+    OperatorProduct(const OperatorProduct& other);
+    ~OperatorProduct() noexcept(false);
+
+    OperatorProduct& operator=(const OperatorProduct& other) = delete;
+
+    inline unsigned int get_num_configurations() const {
+        return this->num_final_masks;
+    }
+
+    // dynamic shared memory needed by local_energy(), to be passed to the ensembles' foreach()
+    inline unsigned int get_shared_memory_size() const {
+        return 2u * this->max_masks * sizeof(complex_t);
+    }
+
+private:
+    unsigned int    num_final_masks;
+
+    void allocate_memory_and_initialize(
+        const unsigned int* num_masks,
+        const unsigned int* transition_begin,
+        const unsigned int* transition_source,
+        const Spins::type*  transition_source_mask,
+        const unsigned int* transition_group,
+        const unsigned int* transition_target,
+        const Spins::type*  final_flip_masks,
+        const unsigned int* final_begin,
+        const bool          pointers_on_gpu
+    );
+};
+
+} // namespace rbm_on_gpu
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Spins.h"
+#include "cuda_complex.hpp"
+#include "types.h"
+
+
+namespace rbm_on_gpu {
+
+namespace kernel {
+
+// Diagonal one- and two-body part of an operator: sum_{i<j} J_ij Z_i Z_j + sum_i h_i Z_i.
+//
+// It is evaluated from the bits of s rather than string by string, using s_i = 2 b_i - 1:
+// - in general row by row, sum_i s_i (2 sum_{j > i, b_j} J_ij - sum_{j > i} J_ij), which only visits the set bits,
+// - if J_ij = J(|i - j| mod N) on a ring, by the correlations sum_i s_i s_(i+d) = N - 2 popcount(s ^ rotate(s, d)),
+//   which is O(N) in total.
+struct QuadraticForm {
+    // zero if there is no quadratic form
+    unsigned int    N;
+    bool            translation_invariant;
+
+    // 'N' fields h_i, followed by either 'N' couplings J(d) and nothing else (translation invariant)
+    // or the N x N symmetric couplings J_ij and the 'N' upper row sums sum_{j > i} J_ij.
+    complex_t*      data;
+
+    HDINLINE unsigned int size() const {
+        return this->translation_invariant ? 2u * this->N : this->N * this->N + 2u * this->N;
+    }
+
+    HDINLINE const complex_t* fields() const {
+        return this->data;
+    }
+
+    HDINLINE const complex_t* couplings() const {
+        return this->data + this->N;
+    }
+
+    HDINLINE const complex_t* upper_row_sums() const {
+        return this->data + this->N + this->N * this->N;
+    }
+
+    HDINLINE Spins::type all_sites() const {
+        return this->N == 64u ? ~(Spins::type)0u : (((Spins::type)1u << this->N) - 1u);
+    }
+
+    HDINLINE Spins::type rotate(const Spins::type configuration, const unsigned int shift) const {
+        return ((configuration << shift) | (configuration >> (this->N - shift))) & this->all_sites();
+    }
+
+    // Rows can be summed up in parallel, see operator().
+    HDINLINE unsigned int num_rows() const {
+        return this->N;
+    }
+
+    HDINLINE complex_t row(const unsigned int i, Spins::type configuration) const {
+        // sampled configurations may carry arbitrary bits beyond the N sites
+        configuration &= this->all_sites();
+
+        const auto spin_up = static_cast<bool>(configuration & ((Spins::type)1u << i));
+
+        complex_t result = spin_up ? this->fields()[i] : -this->fields()[i];
+
+        if(this->translation_invariant) {
+            // the i-th row holds the distance d = i + 1, where d and N - d are the same pairs seen from both ends
+            const auto d = i + 1u;
+            if(d < this->N) {
+                const auto correlation = (
+                    (int)this->N - 2 * (int)bit_count(configuration ^ this->rotate(configuration, d))
+                );
+                result += 0.5 * correlation * this->couplings()[d];
+            }
+        }
+        else {
+            const auto J_i = this->couplings() + i * this->N;
+            const auto upper_sites = this->all_sites() & ~((((Spins::type)2u) << i) - 1u);
+
+            complex_t local_field = -this->upper_row_sums()[i];
+            for(auto remaining = configuration & upper_sites; remaining != 0u; remaining &= remaining - 1u) {
+                local_field += 2.0 * J_i[lowest_set_bit(remaining)];
+            }
+
+            result += spin_up ? local_field : -local_field;
+        }
+
+        return result;
+    }
+
+    // Change of the form when flipping site k, given the configuration after the flip: 2 s_k (h_k + sum_j J_kj s_j).
+    HDINLINE complex_t flip_difference(const unsigned int k, const Spins::type new_configuration) const {
+        if(k >= this->N) {
+            return complex_t(0.0, 0.0);
+        }
+
+        complex_t local_field = this->fields()[k];
+
+        if(this->translation_invariant) {
+            for(auto d = 1u; d < this->N; d++) {
+                const auto j = (k + d) % this->N;
+                local_field += (new_configuration & ((Spins::type)1u << j)) ? this->couplings()[d] : -this->couplings()[d];
+            }
+        }
+        else {
+            const auto J_k = this->couplings() + k * this->N;
+            for(auto j = 0u; j < this->N; j++) {
+                local_field += (new_configuration & ((Spins::type)1u << j)) ? J_k[j] : -J_k[j];
+            }
+        }
+
+        return 2.0 * ((new_configuration & ((Spins::type)1u << k)) ? local_field : -local_field);
+    }
+
+    HDINLINE complex_t operator()(const Spins& spins) const {
+        complex_t result(0.0, 0.0);
+
+        for(auto i = 0u; i < this->num_rows(); i++) {
+            result += this->row(i, spins.configuration);
+        }
+
+        return result;
+    }
+};
+
+} // namespace kernel
+
+} // namespace rbm_on_gpu
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "operator/Operator.hpp"
+#include "operator/SpinBasis.hpp"
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+
+
+namespace rbm_on_gpu {
+
+// Matrix of an operator in compressed sparse row format, with < s | O | s' > at row index(s) and column index(s'),
+// laid out as expected by scipy.sparse.csr_matrix((data, indices, indptr)). The columns of each row are sorted.
+struct SparseMatrix {
+    uint64_t                            dimension;
+    std::vector<int64_t>                indptr;     // 'dimension' + 1 row offsets
+    std::vector<int32_t>                indices;
+    std::vector<std::complex<double>>   data;
+};
+
+// Builds the matrix row by row from the compiled groups of 'operator_', split over 'num_threads' threads (zero picks
+// the number of hardware threads). In a sector of 'basis' the operator is projected onto it, i.e. elements leading out
+// of the sector are dropped, which are zero anyway if the operator conserves the total Sz.
+SparseMatrix sparse_matrix(const Operator& operator_, const SpinBasis& basis, unsigned int num_threads = 0u);
+
+} // namespace rbm_on_gpu
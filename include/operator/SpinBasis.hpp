@@ -0,0 +1,181 @@
+#pragma once
+
+#include "Spins.h"
+#include "types.h"
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+
+namespace rbm_on_gpu {
+
+// Computational basis of N spins, either the full space, indexed by the configuration itself, or the sector with
+// a fixed number of up spins (set bits), i.e. a fixed total Sz.
+//
+// Within a sector the configurations are ordered by value, which for a fixed number of set bits is the
+// colexicographic order. Hence a configuration with set bits at p_0 < p_1 < ... has the rank sum_k binomial(p_k, k + 1)
+// and neither direction needs a table of the states. The terms of the lower half of the sites only depend on the
+// lower half and, given the number of up spins, those of the upper half only on the upper half, such that the rank
+// is the sum of two table lookups as long as the tables are small.
+class SpinBasis {
+public:
+    // upper bound for the number of sites covered by one rank table
+    static constexpr unsigned int max_table_bits = 20u;
+
+    unsigned int    N;
+    int             num_up;     // negative for the full space
+
+public:
+    SpinBasis(const unsigned int N, const int num_up = -1) : N(N), num_up(num_up) {
+        if(N == 0u || N > 63u) {
+            throw std::invalid_argument("a spin basis supports 1 to 63 spins");
+        }
+        if(num_up > (int)N) {
+            throw std::invalid_argument("the number of up spins exceeds the number of spins");
+        }
+
+        this->binomials.assign((N + 1u) * (N + 1u), 0u);
+        for(auto n = 0u; n <= N; n++) {
+            this->binomials[n * (N + 1u)] = 1u;
+            for(auto k = 1u; k <= n; k++) {
+                this->binomials[n * (N + 1u) + k] = this->binomial(n - 1u, k - 1u) + this->binomial(n - 1u, k);
+            }
+        }
+
+        this->low_bits = N / 2u;
+        if(this->is_sector() && N - this->low_bits <= max_table_bits) {
+            this->low_ranks.resize((size_t)1u << this->low_bits);
+            this->high_ranks.resize((size_t)1u << (N - this->low_bits));
+
+            for(auto low = uint64_t(0u); low < this->low_ranks.size(); low++) {
+                this->low_ranks[low] = this->rank(low, 0u, 0u);
+            }
+            for(auto high = uint64_t(0u); high < this->high_ranks.size(); high++) {
+                const auto num_high_up = bit_count(high);
+                if(num_high_up <= (unsigned int)num_up) {
+                    this->high_ranks[high] = this->rank(high, this->low_bits, num_up - num_high_up);
+                }
+            }
+        }
+    }
+
+    inline bool is_sector() const {
+        return this->num_up >= 0;
+    }
+
+    inline uint64_t binomial(const unsigned int n, const unsigned int k) const {
+        return k > n ? 0u : this->binomials[n * (this->N + 1u) + k];
+    }
+
+    inline uint64_t size() const {
+        return this->is_sector() ? this->binomial(this->N, this->num_up) : (uint64_t)1u << this->N;
+    }
+
+    inline bool contains(const uint64_t configuration) const {
+        if((configuration >> this->N) != 0u) {
+            return false;
+        }
+        return !this->is_sector() || bit_count(configuration) == (unsigned int)this->num_up;
+    }
+
+    // position of a configuration of this basis
+    inline uint64_t index(const uint64_t configuration) const {
+        if(!this->is_sector()) {
+            return configuration;
+        }
+        if(!this->low_ranks.empty()) {
+            return (
+                this->low_ranks[configuration & (((uint64_t)1u << this->low_bits) - 1u)] +
+                this->high_ranks[configuration >> this->low_bits]
+            );
+        }
+
+        return this->rank(configuration, 0u, 0u);
+    }
+
+    // configuration at a position of this basis
+    inline uint64_t state(uint64_t index) const {
+        if(!this->is_sector()) {
+            return index;
+        }
+
+        uint64_t result = 0u;
+        auto position = this->N;
+        for(auto k = (unsigned int)this->num_up; k > 0u; k--) {
+            do {
+                position--;
+            } while(this->binomial(position, k) > index);
+
+            result |= (uint64_t)1u << position;
+            index -= this->binomial(position, k);
+        }
+        return result;
+    }
+
+    // configuration following one of this basis, which must not be the last one
+    inline uint64_t next(const uint64_t configuration) const {
+        if(!this->is_sector()) {
+            return configuration + 1u;
+        }
+
+        // next integer with the same number of set bits
+        const auto lowest = configuration & (~configuration + 1u);
+        const auto ripple = configuration + lowest;
+        return ripple | (((ripple ^ configuration) >> 2u) / lowest);
+    }
+
+    // Number of threads used by foreach_chunk(), where zero picks the number of hardware threads.
+    inline unsigned int get_num_threads(unsigned int num_threads) const {
+        if(num_threads == 0u) {
+            num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        return std::max(std::min<uint64_t>(num_threads, this->size()), uint64_t(1u));
+    }
+
+    // Calls function(thread_idx, begin, end) for contiguous ranges of basis indices, one per thread.
+    template<typename Function>
+    void foreach_chunk(unsigned int num_threads, Function function) const {
+        num_threads = this->get_num_threads(num_threads);
+
+        const auto evaluate_chunk = [&](const unsigned int thread_idx) {
+            function(
+                thread_idx,
+                this->size() * thread_idx / num_threads,
+                this->size() * (thread_idx + 1u) / num_threads
+            );
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads - 1u);
+        for(auto thread_idx = 1u; thread_idx < num_threads; thread_idx++) {
+            threads.emplace_back(evaluate_chunk, thread_idx);
+        }
+        evaluate_chunk(0u);
+
+        for(auto& worker : threads) {
+            worker.join();
+        }
+    }
+
+private:
+    // sum_k binomial(p_k + offset, k + first_k + 1) over the set bits p_0 < p_1 < ... of 'bits'
+    inline uint64_t rank(const uint64_t bits, const unsigned int offset, const unsigned int first_k) const {
+        uint64_t result = 0u;
+        auto k = first_k + 1u;
+        for(auto remaining = bits; remaining != 0u; remaining &= remaining - 1u, k++) {
+            result += this->binomial(lowest_set_bit(remaining) + offset, k);
+        }
+        return result;
+    }
+
+    std::vector<uint64_t> binomials;    // (N + 1) x (N + 1)
+
+    unsigned int            low_bits;
+    std::vector<uint64_t>   low_ranks;  // per configuration of the lower 'low_bits' sites
+    std::vector<uint64_t>   high_ranks; // per configuration of the remaining sites
+};
+
+} // namespace rbm_on_gpu
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "quantum_state/Psi.hpp"
+#include "quantum_state/PsiDeep.hpp"
+#include "quantum_state/PsiJastrow.hpp"
+#include "network_functions/PsiVector.hpp"
+#include "network_functions/PsiOkVector.hpp"
+#include "Array.hpp"
+#include "Spins.h"
+#include "types.h"
+#include "cuda_complex.hpp"
+
+#include <complex>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __PYTHONCC__
+    #define FORCE_IMPORT_ARRAY
+    #include "xtensor-python/pytensor.hpp"
+#endif // __PYTHONCC__
+
+
+namespace rbm_on_gpu {
+
+// The caches of both factors side by side.
+template<typename FirstAngles_t, typename SecondAngles_t>
+struct ProductPsiAngles {
+    FirstAngles_t   first;
+    SecondAngles_t  second;
+
+    ProductPsiAngles() = default;
+
+    template<typename Psi_t>
+    HDINLINE void init(const Psi_t& psi, const ProductPsiAngles& other) {
+        this->first.init(psi.first, other.first);
+        this->second.init(psi.second, other.second);
+    }
+
+    template<typename Psi_t>
+    HDINLINE void init(const Psi_t& psi, const Spins& spins) {
+        this->first.init(psi.first, spins);
+        this->second.init(psi.second, spins);
+    }
+};
+
+namespace kernel {
+
+// psi(s) = psi_first(s) * psi_second(s)
+//
+// Both factors share the thread block: each of them is handed the same angle index j and ignores it if
+// j exceeds its own number of angles. The parameters of the second factor follow those of the first.
+template<typename First_t, typename Second_t>
+class ProductPsi {
+public:
+    First_t     first;
+    Second_t    second;
+
+    unsigned int N;
+    unsigned int num_params;
+    double       prefactor;
+
+    using Angles = ProductPsiAngles<typename First_t::Angles, typename Second_t::Angles>;
+
+public:
+
+#ifdef __CUDACC__
+
+    HDINLINE
+    void log_psi_s(complex_t& result, const Spins& spins, Angles& angles) const {
+        // CAUTION: 'result' has to be a shared variable.
+        #include "cuda_kernel_defines.h"
+
+        SHARED complex_t log_psi_second;
+
+        this->first.log_psi_s(result, spins, angles.first);
+        this->second.log_psi_s(log_psi_second, spins, angles.second);
+
+        SYNC;
+        SINGLE {
+            result += log_psi_second;
+        }
+        SYNC;
+    }
+
+    HDINLINE
+    void log_psi_s_real(double& result, const Spins& spins, Angles& angles) const {
+        // CAUTION: 'result' has to be a shared variable.
+        #include "cuda_kernel_defines.h"
+
+        SHARED double log_psi_second;
+
+        this->first.log_psi_s_real(result, spins, angles.first);
+        this->second.log_psi_s_real(log_psi_second, spins, angles.second);
+
+        SYNC;
+        SINGLE {
+            result += log_psi_second;
+        }
+        SYNC;
+    }
+
+    HDINLINE void flip_spin_of_jth_angle(
+        const unsigned int j, const unsigned int position, const Spins& new_spins, Angles& angles
+    ) const {
+        this->first.flip_spin_of_jth_angle(j, position, new_spins, angles.first);
+        this->second.flip_spin_of_jth_angle(j, position, new_spins, angles.second);
+    }
+
+    HDINLINE
+    complex_t psi_s(const Spins& spins, Angles& angles) const {
+        #include "cuda_kernel_defines.h"
+
+        SHARED complex_t log_psi;
+        this->log_psi_s(log_psi, spins, angles);
+
+        return exp(log(this->prefactor) + log_psi);
+    }
+
+    template<typename Function>
+    HDINLINE
+    void foreach_O_k(const Spins& spins, Angles& angles, Function function) const {
+        #include "cuda_kernel_defines.h"
+
+        this->first.foreach_O_k(spins, angles.first, function);
+        SYNC;
+
+        const auto offset = this->first.get_num_params();
+        this->second.foreach_O_k(
+            spins,
+            angles.second,
+            [&](const unsigned int k, const complex_t& O_k_element) {
+                function(offset + k, O_k_element);
+            }
+        );
+    }
+
+    ProductPsi get_kernel() const {
+        return *this;
+    }
+
+#endif // __CUDACC__
+
+    HDINLINE
+    double probability_s(const double log_psi_s_real) const {
+        return exp(2.0 * (log(this->prefactor) + log_psi_s_real));
+    }
+
+    HDINLINE
+    unsigned int get_num_spins() const {
+        return this->N;
+    }
+
+    HDINLINE
+    unsigned int get_num_angles() const {
+        const auto first_num_angles = this->first.get_num_angles();
+        const auto second_num_angles = this->second.get_num_angles();
+
+        return first_num_angles > second_num_angles ? first_num_angles : second_num_angles;
+    }
+
+    HDINLINE
+    unsigned int get_width() const {
+        const auto first_width = this->first.get_width();
+        const auto second_width = this->second.get_width();
+
+        return first_width > second_width ? first_width : second_width;
+    }
+
+    HDINLINE
+    static constexpr unsigned int get_max_spins() {
+        return MAX_SPINS;
+    }
+
+    HDINLINE
+    unsigned int get_num_params() const {
+        return this->num_params;
+    }
+};
+
+} // namespace kernel
+
+
+namespace detail {
+
+// kernel counterpart of each host network which can be a factor of a ProductPsi
+template<typename Psi_t>
+struct KernelOf;
+
+template<>
+struct KernelOf<Psi> {
+    using type = kernel::Psi;
+};
+
+template<>
+struct KernelOf<PsiDeep> {
+    using type = kernel::PsiDeep;
+};
+
+template<>
+struct KernelOf<PsiJastrow> {
+    using type = kernel::PsiJastrow;
+};
+
+// The networks differ in how they hand out their parameters.
+inline void get_params(complex<double>* result, const Psi& psi) {
+    psi.get_params(result);
+}
+
+inline void get_params(complex<double>* result, const PsiDeep& psi) {
+    memcpy(result, psi.get_params().host_data(), sizeof(complex_t) * psi.get_num_params());
+}
+
+inline void get_params(complex<double>* result, const PsiJastrow& psi) {
+    psi.get_params(result);
+}
+
+inline void set_params(Psi& psi, const complex<double>* new_params) {
+    psi.set_params(new_params);
+}
+
+inline void set_params(PsiDeep& psi, const complex<double>* new_params) {
+    psi.set_params(reinterpret_cast<const complex_t*>(new_params));
+}
+
+inline void set_params(PsiJastrow& psi, const complex<double>* new_params) {
+    psi.set_params(new_params);
+}
+
+} // namespace detail
+
+
+// The first factor is a network, the second one is typically a cheap factor like PsiJastrow.
+// The free quantum axis is taken from the first factor, whose parameters come first.
+template<typename First_t, typename Second_t>
+class ProductPsi : public kernel::ProductPsi<
+    typename detail::KernelOf<First_t>::type, typename detail::KernelOf<Second_t>::type
+> {
+public:
+    First_t     first_factor;
+    Second_t    second_factor;
+
+    // views onto the parameters of the first factor, bound by update_kernel()
+    RealArrayView   alpha_array;
+    RealArrayView   beta_array;
+    bool            free_quantum_axis;
+
+    bool gpu;
+
+public:
+    inline ProductPsi(const First_t& first_factor, const Second_t& second_factor)
+        :
+        first_factor(first_factor),
+        second_factor(second_factor),
+        free_quantum_axis(first_factor.free_quantum_axis),
+        gpu(first_factor.gpu)
+    {
+        if(first_factor.get_num_spins() != second_factor.get_num_spins()) {
+            throw invalid_argument("both factors of a product have to act on the same number of spins");
+        }
+        if(first_factor.gpu != second_factor.gpu) {
+            throw invalid_argument("both factors of a product have to reside on the same device");
+        }
+
+        this->update_kernel();
+    }
+
+    inline ProductPsi(const ProductPsi& other)
+        :
+        first_factor(other.first_factor),
+        second_factor(other.second_factor),
+        free_quantum_axis(other.free_quantum_axis),
+        gpu(other.gpu)
+    {
+        this->update_kernel();
+    }
+
+    ProductPsi& operator=(const ProductPsi& other) = delete;
+
+#ifdef __PYTHONCC__
+
+    inline ProductPsi copy() const {
+        return *this;
+    }
+
+    inline xt::pytensor<complex<double>, 1u> get_params_py() const {
+        xt::pytensor<complex<double>, 1u> result(shape_t<1u>{(long int)this->num_params});
+        this->get_params(result.data());
+
+        return result;
+    }
+
+    inline void set_params_py(const xt::pytensor<complex<double>, 1u>& new_params) {
+        if(new_params.size() != this->num_params) {
+            throw invalid_argument("expected " + to_string(this->num_params) + " parameters");
+        }
+        this->set_params(new_params.data());
+    }
+
+    // O_k at 'spins', laid out like the parameters
+    inline xt::pytensor<complex<double>, 1u> O_k_vector_py(const Spins& spins) const {
+        xt::pytensor<complex<double>, 1u> result(shape_t<1u>{(long int)this->num_params});
+        psi_O_k_vector(result.data(), *this, spins);
+
+        return result;
+    }
+
+#endif // __PYTHONCC__
+
+    // [params of the first factor | params of the second factor]
+    inline void get_params(complex<double>* result) const {
+        detail::get_params(result, this->first_factor);
+        detail::get_params(result + this->first_factor.get_num_params(), this->second_factor);
+    }
+
+    inline void set_params(const complex<double>* new_params) {
+        detail::set_params(this->first_factor, new_params);
+        detail::set_params(this->second_factor, new_params + this->first_factor.get_num_params());
+
+        this->update_kernel();
+    }
+
+    inline Array<complex_t> as_vector() const {
+        return psi_vector(*this);
+    }
+
+    // has to be called after modifying one of the factors
+    inline void update_kernel() {
+        this->first = this->first_factor;
+        this->second = this->second_factor;
+
+        this->N = this->first_factor.get_num_spins();
+        this->num_params = this->first_factor.get_num_params() + this->second_factor.get_num_params();
+        this->prefactor = this->first_factor.prefactor * this->second_factor.prefactor;
+
+        this->alpha_array = this->first_factor.alpha_array;
+        this->beta_array = this->first_factor.beta_array;
+    }
+};
+
+
+using PsiWithJastrow = ProductPsi<Psi, PsiJastrow>;
+using PsiDeepWithJastrow = ProductPsi<PsiDeep, PsiJastrow>;
+
+} // namespace rbm_on_gpu
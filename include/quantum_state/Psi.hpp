@@ -4,6 +4,8 @@
 #include "quantum_state/PsiCache.hpp"
 #include "spin_ensembles/ExactSummation.hpp"
 #include "Array.hpp"
+#include "CopyOnWrite.hpp"
+#include "NetworkFile.hpp"
 #include "Spins.h"
 #include "types.h"
 #ifdef __CUDACC__
@@ -15,6 +17,7 @@
 #include <complex>
 #include <memory>
 #include <cassert>
+#include <cstring>
 
 #ifdef __PYTHONCC__
     #define FORCE_IMPORT_ARRAY
@@ -262,10 +265,15 @@ public:
 
 class Psi : public kernel::Psi {
 public:
-    Array<double> alpha_array;
-    Array<double> beta_array;
-    Array<complex_t> b_array;
-    Array<complex_t> W_array;
+    // all parameters in one contiguous buffer: [alpha | beta | b | W].
+    // It is shared between copies until one of them is modified, see make_params_unique().
+    CopyOnWrite<Array<complex_t>> params;
+
+    // views onto the blocks of 'params', bound by update_kernel()
+    RealArrayView           alpha_array;
+    RealArrayView           beta_array;
+    ArrayView<complex_t>    b_array;
+    ArrayView<complex_t>    W_array;
 
     const bool  free_quantum_axis;
     bool gpu;
@@ -273,6 +281,7 @@ public:
 public:
     Psi(const unsigned int N, const unsigned int M, const int seed, const double noise, const bool free_quantum_axis, const bool gpu);
     Psi(const Psi& other);
+    Psi(const NetworkFile& file, const bool gpu);
 
 #ifdef __PYTHONCC__
     inline Psi(
@@ -283,7 +292,8 @@ public:
         const double prefactor,
         const bool free_quantum_axis,
         const bool gpu
-    ) : alpha_array(alpha, false), beta_array(alpha, false), b_array(b, gpu), W_array(W, gpu), free_quantum_axis(free_quantum_axis), gpu(gpu) {
+    ) : params(make_shared<Array<complex_t>>(2 * alpha.shape()[0] + b.shape()[0] + W.size(), gpu)),
+        free_quantum_axis(free_quantum_axis), gpu(gpu) {
         this->N = alpha.shape()[0];
         this->M = b.shape()[0];
         this->prefactor = prefactor;
@@ -291,6 +301,15 @@ public:
         this->O_k_length = M + N * M;
 
         this->update_kernel();
+
+        for(auto i = 0u; i < this->N; i++) {
+            (*this->params)[i] = complex_t(alpha[i], 0.0);
+            (*this->params)[this->N + i] = complex_t(beta[i], 0.0);
+        }
+        memcpy(this->b_array.data(), b.data(), sizeof(complex_t) * this->M);
+        memcpy(this->W_array.data(), W.data(), sizeof(complex_t) * this->N * this->M);
+
+        this->update_params();
     }
 
     xt::pytensor<complex<double>, 1> as_vector_py() const {
@@ -304,7 +323,7 @@ public:
 
     xt::pytensor<complex<double>, 1> O_k_vector_py(const Spins& spins) const {
         auto result = xt::pytensor<complex<double>, 1>(
-            std::array<long int, 1>({static_cast<long int>(this->O_k_length)})
+            std::array<long int, 1>({static_cast<long int>(this->get_num_params())})
         );
         this->O_k_vector(result.data(), spins);
 
@@ -315,19 +334,6 @@ public:
         return *this;
     }
 
-    xt::pytensor<complex<double>, 1> get_params_py() const {
-        auto result = xt::pytensor<complex<double>, 1>(
-            std::array<long int, 1>({static_cast<long int>(this->num_params)})
-        );
-        this->get_params(result.data());
-
-        return result;
-    }
-
-    void set_params_py(const xt::pytensor<complex<double>, 1>& new_params) {
-        this->set_params(new_params.data());
-    }
-
     unsigned int get_num_params_py() const {
         return this->get_num_params();
     }
@@ -339,8 +345,17 @@ public:
     double norm_function(const ExactSummation& exact_summation) const;
     complex<double> log_psi_s_std(const Spins& spins);
 
+    void save(const string& file_name) const;
+
     void get_params(complex<double>* result) const;
     void set_params(const complex<double>* new_params);
+    void update_params();
+    void make_params_unique();
+    // the store as long as a reference to it escaped, to be matched by unpin_params()
+    Array<complex_t>& pin_params();
+    inline void unpin_params() {
+        this->params.unpin();
+    }
 
     void update_kernel();
 };
@@ -3,6 +3,7 @@
 #include "quantum_state/PsiDeepMin.hpp"
 
 #include "quantum_state/PsiClassicalHelper.hpp"
+#include "network_functions/LogPsiTable.hpp"
 
 
 #include "Array.hpp"
@@ -17,6 +18,7 @@
 #include <complex>
 #include <memory>
 #include <cassert>
+#include <stdexcept>
 
 #ifdef __PYTHONCC__
     #define FORCE_IMPORT_ARRAY
@@ -54,8 +56,12 @@ public:
 
     complex_t* W;
 
+    // table of log_psi for all configurations or nullptr, owned by the host class
     complex_t* log_psi_ptr;
 
+    // immutable tables of the classical network, owned by the host class
+    const Peter::Tables* tables;
+
 // #ifdef __CUDACC__
     using Angles = rbm_on_gpu::PsiClassicalAngles;
     // using Derivatives = rbm_on_gpu::PsiClassicalDerivatives;
@@ -68,13 +74,20 @@ public:
 
     HDINLINE
     complex_t log_psi_s(const Spins& spins) const {
-        #ifndef __CUDA_ARCH__
-        std::vector<int> spins_vector(this->N);
-        for(auto i = 0u; i < this->N; i++) {
-            spins_vector[i] = spins[i];
+        #if MAX_SPINS <= 64
+        const auto configuration = spins.configuration;
+        #else
+        const auto configuration = spins.configuration_first;
+        #endif
+
+        // tabulated, see PsiClassical::tabulate(). Sampled configurations may carry arbitrary bits beyond the N sites.
+        if(this->log_psi_ptr != nullptr) {
+            return this->log_psi_ptr[configuration & ((uint64_t(1u) << this->N) - 1u)];
         }
 
-        const auto result = Peter::findHeffComplex(spins_vector);
+        #ifndef __CUDA_ARCH__
+        // reentrant, hence it can be called from any number of host threads at once.
+        const auto result = Peter::log_psi_s(*this->tables, configuration);
         return complex_t(result.real(), result.imag());
 
         #else
@@ -82,10 +95,6 @@ public:
         return complex_t(0.0, 0.0);
 
         #endif
-
-
-        // return this->log_psi_ptr[spins.configuration];
-
     }
 
 
@@ -186,47 +195,118 @@ public:
     Array<double> alpha_array;
     Array<double> beta_array;
 
+    shared_ptr<const Peter::Tables> shared_tables;
+
     bool free_quantum_axis;
     bool gpu;
 
 public:
-    // PsiClassical(const PsiClassical& other);
+    inline PsiClassical(const PsiClassical& other)
+        :
+        kernel::PsiClassical(other),
+        log_psi_array(other.log_psi_array),
+        W_array(other.W_array),
+        alpha_array(other.alpha_array),
+        beta_array(other.beta_array),
+        shared_tables(other.shared_tables),
+        free_quantum_axis(other.free_quantum_axis),
+        gpu(other.gpu)
+    {
+        if(other.log_psi_ptr != nullptr) {
+            this->log_psi_ptr = this->log_psi_array.data();
+        }
+    }
+
+    PsiClassical& operator=(const PsiClassical& other) = delete;
+
+    // Opt-in: evaluates the network for all 2^N configurations at once, such that log_psi_s() becomes a lookup,
+    // also on the GPU. The lookup table is a snapshot, it is dropped by clear_table() whenever the network changes.
+    // Only PsiClassical consults such a table. Other networks benefit from it only when wrapped into a tabulated
+    // state, PsiClassical(log_psi_table(psi), N, gpu), which has to be rebuilt after each update of their parameters.
+    inline void tabulate(const unsigned int num_threads = 0u) {
+        this->log_psi_array = log_psi_table(*this, num_threads);
+        this->log_psi_ptr = this->log_psi_array.data();
+    }
+
+    // Falls back to evaluating the classical network. A state given by its table alone keeps the table.
+    inline void clear_table() {
+        if(this->tables != nullptr) {
+            this->log_psi_array = Array<complex_t>(1, false);
+            this->log_psi_ptr = nullptr;
+        }
+    }
+
+    inline bool is_tabulated() const {
+        return this->log_psi_ptr != nullptr;
+    }
 
 #ifdef __PYTHONCC__
     inline PsiClassical(
         const string directory,
         const int index,
         const unsigned int N,
+        const bool gpu,
+        const int perturbation_order = 1
+    ) : log_psi_array(1, false), W_array(1, false), alpha_array(1, false), beta_array(1, false), free_quantum_axis(false), gpu(gpu) {
+        this->N = N;
+
+        this->shared_tables = Peter::load_tables(directory, index, N, perturbation_order);
+        this->tables = this->shared_tables.get();
+        this->log_psi_ptr = nullptr;
+
+        this->prefactor = 1.0;
+    }
+
+    // A tabulated state, e.g. the table of any other network as given by log_psi_table().
+    inline PsiClassical(
+        const xt::pytensor<std::complex<double>, 1u>& log_psi,
+        const unsigned int N,
         const bool gpu
     ) : log_psi_array(1, false), W_array(1, false), alpha_array(1, false), beta_array(1, false), free_quantum_axis(false), gpu(gpu) {
+        if(N > log_psi_table_max_N || log_psi.size() != (size_t(1u) << N)) {
+            throw invalid_argument("the table has to hold log_psi of all 2^N configurations");
+        }
         this->N = N;
 
-        Peter::loadVP(directory, index, "Re");
-        Peter::loadVP(directory, index, "Im");
-        Peter::Compress_Load(directory, index);
-        Peter::load_neural_network(directory, index);
+        this->log_psi_array = Array<complex_t>(log_psi, gpu);
+        this->log_psi_ptr = this->log_psi_array.data();
+        this->tables = nullptr;
 
         this->prefactor = 1.0;
     }
 
-    // inline PsiClassical(
-    //     const xt::pytensor<std::complex<double>, 1u>& log_psi,
-    //     const unsigned int N,
-    //     const bool gpu
-    // ) : log_psi_array(log_psi, gpu), W_array(0, gpu), alpha_array(1, false), beta_array(1, false), free_quantum_axis(false), gpu(gpu) {
-    //     this->N = N;
+    inline complex<double> log_psi_s_py(const Spins& spins) const {
+        if(this->log_psi_ptr != nullptr) {
+            return this->log_psi_array.host_data()[spins.configuration & ((1ull << this->N) - 1u)].to_std();
+        }
 
-    //     this->log_psi_array.update_device();
-    //     this->log_psi_ptr = this->log_psi_array.data();
+        return Peter::log_psi_s(*this->tables, spins.configuration);
+    }
 
-    //     this->prefactor = 1.0;
-    //     this->psi_neural = nullptr;
-    // }
+    inline xt::pytensor<complex<double>, 1u> log_psi_s_batch_py(
+        const xt::pytensor<uint64_t, 1u>& configurations, const unsigned int num_threads
+    ) const {
+        xt::pytensor<complex<double>, 1u> result(shape_t<1u>{(long int)configurations.size()});
+        if(this->log_psi_ptr != nullptr) {
+            for(auto n = 0u; n < configurations.size(); n++) {
+                result[n] = this->log_psi_array.host_data()[configurations[n] & ((1ull << this->N) - 1u)].to_std();
+            }
+            return result;
+        }
+
+        Peter::log_psi_s_batch(
+            *this->tables, result.data(), configurations.data(), configurations.size(), num_threads
+        );
+
+        return result;
+    }
 
     inline ~PsiClassical() {
     }
 
     void init(const string& fname_base, const std::string& ReIm) {
+        this->clear_table();
+
         string filenamePos = fname_base + ReIm+".csv";
         std::ifstream filePos;
         filePos.open (filenamePos.c_str());
@@ -1,13 +1,110 @@
+#pragma once
+
 #include <string>
 #include <complex>
 #include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+
+namespace rbm_on_gpu {
+    class PsiDeepMin;
+}
 
 
 namespace Peter {
 
-void load_neural_network(std::string directory, int index);
-void loadVP(std::string directory, int index, std::string ReIm);
-void Compress_Load(std::string directory, int index);
-std::complex<double> findHeffComplex(std::vector<int> &spins);
+// Collision-free hash map from the uncompressed to the compressed index of a variational parameter.
+// Only the non-zero entries of the index file are stored, all other indices map to zero.
+// Built by hash and displace: the keys are distributed into buckets and every bucket gets its own
+// seed, chosen such that its keys land in free slots. A lookup costs two hashes and a comparison.
+class PerfectHashIndex {
+    std::vector<uint32_t>   seeds;          // per bucket
+    std::vector<int>        keys;           // per slot, -1 marks an empty slot
+    std::vector<int>        values;         // per slot
+
+    static inline uint64_t hash(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9u;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebu;
+        return x ^ (x >> 31);
+    }
+
+public:
+    inline PerfectHashIndex() : seeds(1u, 0u), keys(1u, -1), values(1u, 0) {}
+
+    // 'entries' are pairs of distinct non-negative keys and their values.
+    void build(const std::vector<std::pair<int, int>>& entries);
+
+    inline int operator[](const int key) const {
+        const auto h = hash(uint64_t(key));
+        const auto slot = hash(h ^ this->seeds[h & (this->seeds.size() - 1u)]) & (this->keys.size() - 1u);
+
+        return this->keys[slot] == key ? this->values[slot] : 0;
+    }
+
+    inline size_t size() const {
+        return this->keys.size();
+    }
+};
+
+
+// Everything the classical network is made of. It is immutable once loaded, hence a single
+// instance can be shared by any number of threads evaluating the network at the same time.
+struct Tables {
+    // the neighbourhood of every plaquette has to fit into a 64-bit word, see Context::neighbourhoods()
+    static constexpr int max_sites = 62;
+    // the third order is only partially implemented, see Context::Heff_plaquetteComplex()
+    static constexpr int max_perturbation_order = 3;
+
+    int L;                                          // length of the chain
+    int H;                                          // number of chains
+    int perturbation_order;
+
+    std::vector<std::complex<double>> varW;         // variational parameters, the last one is the normalization
+    PerfectHashIndex indexVP;                       // index into 'varW' of each uncompressed variational parameter
+
+    // Contributions of a plaquette up to first order. Their coefficients only depend on the plaquette
+    // and its two neighbours, whose spins (j-1, j, j+1) make up the 3-bit index of these tables.
+    std::complex<double> plaquette_diagonal[8];     // zeroth order
+    std::complex<double> plaquette_flip[8];         // first order, to be multiplied by psi(j flipped) / psi
+
+    std::shared_ptr<const rbm_on_gpu::PsiDeepMin> psi_neural;
+};
+
+// fills the plaquette tables from 'varW' and 'indexVP'.
+void build_plaquette_tables(Tables& tables);
+
+std::shared_ptr<const Tables> load_tables(
+    const std::string& directory, const int index, const int L, const int perturbation_order = 1
+);
+
+void load_neural_network(Tables& tables, const std::string& directory, const int index);
+void load_variational_parameters(Tables& tables, const std::string& directory, const int index);
+void loadVP(Tables& tables, const std::string& directory, const int index, const std::string& ReIm);
+void Compress_Load(Tables& tables, const std::string& directory, const int index);
+std::vector<std::pair<int, int>> load_index_entries(const std::string& directory, const int index);
+
+// Converts the text files of snapshot 'index' in 'directory' into network files, which load_tables() prefers:
+// 'psi_<index>_compressed.txt' into 'psi_<index>_compressed.bin' and the csv-files of the variational
+// parameters into 'a_VP_<index>.bin'.
+void convert_to_network_files(const std::string& directory, const int index);
+
+// Reentrant and allocation-free: all scratch lives on the stack of the calling thread.
+// Bit i of 'configuration' is the spin i, set bits are spin up (+1).
+std::complex<double> log_psi_s(const Tables& tables, const uint64_t configuration);
+
+// Evaluates a batch of configurations, split into contiguous chunks over 'num_threads' threads.
+// A 'num_threads' of zero picks the number of hardware threads.
+void log_psi_s_batch(
+    const Tables& tables,
+    std::complex<double>* result,
+    const uint64_t* configurations,
+    const size_t num_configurations,
+    unsigned int num_threads = 0u
+);
 
 }
@@ -7,6 +7,8 @@
 #include "quantum_state/psi_functions.hpp"
 #include "quantum_state/PsiDeepCache.hpp"
 #include "Array.hpp"
+#include "CopyOnWrite.hpp"
+#include "NetworkFile.hpp"
 #include "Spins.h"
 #include "types.h"
 #ifdef __CUDACC__
@@ -15,10 +17,10 @@
 #include "cuda_complex.hpp"
 
 #include <vector>
-#include <list>
 #include <complex>
 #include <memory>
 #include <cassert>
+#include <cstring>
 #include <utility>
 #include <algorithm>
 
@@ -42,21 +44,37 @@ class PsiDeep {
 public:
     using Angles = rbm_on_gpu::PsiDeepAngles;
 
-    static constexpr unsigned int max_layers = 3u;
-    static constexpr unsigned int max_deep_angles = max_layers * MAX_SPINS;
+#ifdef PSI_DEEP_BATCHED_SHIFTS
+    // capacity of each of the two shift x width buffers of the batched forward pass
+    static constexpr unsigned int max_batched_activations = 2u * MAX_SPINS * MAX_SPINS;
+
+#ifdef __CUDACC__
+    // Both buffers of the batched forward pass. Being declared in a non-template function, they occupy the shared
+    // memory of a kernel only once, no matter how many instantiations of forward_pass_of_all_shifts() it contains.
+    HDINLINE static complex_t* batched_activations() {
+        #ifdef __CUDA_ARCH__
+        __shared__ complex_t result[2u * max_batched_activations];
+        #else
+        static thread_local complex_t result[2u * max_batched_activations];
+        #endif
+
+        return result;
+    }
+#endif // __CUDACC__
+#endif // PSI_DEEP_BATCHED_SHIFTS
 
-    // TODO: Try to use stack-allocated arrays
     struct Layer {
         unsigned int  size;                 // number of units
         unsigned int  begin_angles;         // index of the first unit of this layer in a global list of angles
         unsigned int  begin_params;         // index of the first unit of this layer in a global list of parameters
         unsigned int  lhs_connectivity;     // number of connections to the lhs per unit
         unsigned int  rhs_connectivity;     // number of connections to the rhs per unit
-        unsigned int* lhs_connections;      // connectivity matrix to the lhs: lhs-connectivity x size
-        unsigned int* rhs_connections;      // connectivity matrix to the rhs: size x rhs-connectivity
+        const unsigned int* lhs_connections; // connectivity matrix to the lhs: lhs-connectivity x size
+        const unsigned int* rhs_connections; // connectivity matrix to the rhs: size x rhs-connectivity
         complex_t*    lhs_weights;          // weight matrix to the lhs: lhs-connectivity x size
         complex_t*    rhs_weights;          // weight matrix to the rhs: size x rhs-connectivity
         complex_t*    biases;               // bias factors
+        complex_t*    dense_weights;        // fully connected layers only: lhs-size x size, nullptr otherwise
 
         HDINLINE unsigned int lhs_connection(const unsigned int i, const unsigned int j) const {
             return this->lhs_connections[i * this->size + j];
@@ -70,10 +88,32 @@ public:
         HDINLINE complex_t rhs_weight(const unsigned int i, const unsigned int j) const {
             return this->rhs_weights[i * this->rhs_connectivity + j];
         }
+        HDINLINE complex_t dense_weight(const unsigned int i, const unsigned int j) const {
+            return this->dense_weights[i * this->size + j];
+        }
+
+        template<typename Input_t>
+        HDINLINE complex_t angle(const unsigned int j, const Input_t& input) const {
+            // pre-activation of the j-th unit. Dense layers skip the indirection through the connectivity matrix.
+            complex_t result = this->biases[j];
+
+            if(this->dense_weights != nullptr) {
+                for(auto i = 0u; i < this->lhs_connectivity; i++) {
+                    result += this->dense_weight(i, j) * input[i];
+                }
+            }
+            else {
+                for(auto i = 0u; i < this->lhs_connectivity; i++) {
+                    result += this->lhs_weight(i, j) * input[this->lhs_connection(i, j)];
+                }
+            }
+
+            return result;
+        }
     };
 
     unsigned int   N;
-    Layer          layers[max_layers];
+    Layer*         layers;                  // num_layers layer descriptors, in device memory if the network lives on the gpu
     unsigned int   num_layers;
     unsigned int   width;                   // size of largest layer
     unsigned int   num_units;
@@ -92,135 +132,274 @@ public:
     HDINLINE
     void forward_pass(
         const Spins& spins,
-        complex_t* activations_in, /* once this functions has finished, this holds the *output*-activations of the last layer */
+        Angles& cache, /* once this functions has finished, cache.activations() holds the *output*-activations of the last layer */
         complex_t* deep_angles) const
     {
         #include "cuda_kernel_defines.h"
 
-        SHARED complex_t activations_out[Angles::max_width];
-
         MULTI(i, this->get_num_spins()) {
-            activations_in[i] = spins[i];
+            cache.activations()[i] = spins[i];
         }
 
-        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
+        this->propagate(0u, cache, deep_angles);
+    }
+
+    HDINLINE
+    void forward_pass(
+        const complex_t* angles, /* pre-activations of the first layer, e.g. taken from the cache */
+        Angles& cache, /* once this functions has finished, cache.activations() holds the *output*-activations of the last layer */
+        complex_t* deep_angles) const
+    {
+        #include "cuda_kernel_defines.h"
+
+        SYNC;
+        MULTI(j, this->layers[0].size) {
+            if(deep_angles != nullptr) {
+                deep_angles[this->layers[0].begin_angles + j] = angles[j];
+            }
+            cache.activations()[j] = my_logcosh(angles[j]);
+        }
+
+        this->propagate(1u, cache, deep_angles);
+    }
+
+    HDINLINE
+    void propagate(
+        const unsigned int begin_layer,
+        Angles& cache,
+        complex_t* deep_angles) const
+    {
+        #include "cuda_kernel_defines.h"
+
+        for(auto layer_idx = begin_layer; layer_idx < this->num_layers; layer_idx++) {
             SYNC;
             const Layer& layer = this->layers[layer_idx];
             MULTI(j, layer.size) {
-                activations_out[j] = complex_t(0.0, 0.0);
-
-                for(auto i = 0u; i < layer.lhs_connectivity; i++) {
-                    activations_out[j] += (
-                        layer.lhs_weight(i, j) *
-                        activations_in[layer.lhs_connection(i, j)]
-                    );
-                }
-                activations_out[j] += layer.biases[j];
+                cache.activations_out()[j] = layer.angle(j, cache.activations());
 
                 if(deep_angles != nullptr) {
-                    deep_angles[layer.begin_angles + j] = activations_out[j];
+                    deep_angles[layer.begin_angles + j] = cache.activations_out()[j];
                 }
             }
             SYNC;
             MULTI(k, layer.size) {
-                activations_in[k] = my_logcosh(activations_out[k]);
+                cache.activations()[k] = my_logcosh(cache.activations_out()[k]);
             }
         }
     }
 
     HDINLINE
-    void log_psi_s(complex_t& result, const Spins& spins, Angles& cache) const {
-        // CAUTION: 'result' has to be a shared variable.
+    complex_t angle(const unsigned int j, const Spins& spins) const {
+        // pre-activation of the j-th unit of the first layer
+        return this->layers[0].angle(j, spins);
+    }
 
-        SINGLE {
-            result = complex_t(0.0, 0.0);
-        }
+    HDINLINE
+    void forward_pass_of_shift(
+        const unsigned int shift, const Spins& spins, Angles& cache, complex_t* deep_angles
+    ) const {
+        #ifdef PSI_DEEP_CACHED_ANGLES
+        this->forward_pass(cache.shift_angles(shift), cache, deep_angles);
+        #else
+        this->forward_pass(this->shifted_spins(spins, shift), cache, deep_angles);
+        #endif
+    }
 
-        #ifdef TRANSLATIONAL_INVARIANCE
+#ifdef PSI_DEEP_BATCHED_SHIFTS
 
-        #if DIM == 1
-        for(auto shift = 0u; shift < this->N; shift++) {
-        this->forward_pass(spins.rotate_left(shift, this->N), cache.activations, nullptr);
-        #endif
-        #if DIM == 2
-        for(auto shift_i = 0u; shift_i < this->N_i; shift_i++) {
-            for(auto shift_j = 0u; shift_j < this->N_j; shift_j++) {
-                this->forward_pass(spins.shift_2d(shift_i, shift_j, this->N_i, this->N_j), cache.activations, nullptr);
-        #endif
+    template<typename Function>
+    HDINLINE
+    void forward_pass_of_all_shifts(const Angles& cache, complex_t* deep_angles, Function function) const {
+        // Evaluates the network for all translations at once, with the shift as batch dimension:
+        // neighbouring threads handle the same unit for different shifts and thus share each weight.
+        // The first layer is taken from the cached angles. 'function' is called for each
+        // output-activation of the last layer of every shift.
+        // Requires has_batched_shifts().
+        #include "cuda_kernel_defines.h"
 
-        #else
+        complex_t* activations_in = batched_activations();
+        complex_t* activations_out = activations_in + max_batched_activations;
 
-        this->forward_pass(spins, cache.activations, nullptr);
+        const auto num_shifts = this->get_num_shifts();
+        const Layer& first_layer = this->layers[0];
 
-        #endif
+        SYNC;
+        LOOP(k, first_layer.size * num_shifts) {
+            const auto j = k / num_shifts;
+            const auto shift = k % num_shifts;
+            const auto angle = cache.shift_angles(shift)[j];
 
-        MULTI(j, this->layers[this->num_layers - 1u].size) {
-            generic_atomicAdd(&result, cache.activations[j]);
+            if(shift == 0u && deep_angles != nullptr) {
+                deep_angles[first_layer.begin_angles + j] = angle;
+            }
+            activations_in[shift * this->width + j] = my_logcosh(angle);
         }
 
+        for(auto layer_idx = 1u; layer_idx < this->num_layers; layer_idx++) {
+            SYNC;
+            const Layer& layer = this->layers[layer_idx];
+            LOOP(k, layer.size * num_shifts) {
+                const auto j = k / num_shifts;
+                const auto shift = k % num_shifts;
+                const complex_t* shift_activations_in = activations_in + shift * this->width;
 
-        #ifdef TRANSLATIONAL_INVARIANCE
+                const auto angle = layer.angle(j, shift_activations_in);
 
-        #if DIM == 1
+                if(shift == 0u && deep_angles != nullptr) {
+                    deep_angles[layer.begin_angles + j] = angle;
+                }
+                activations_out[shift * this->width + j] = my_logcosh(angle);
+            }
+
+            complex_t* tmp = activations_in;
+            activations_in = activations_out;
+            activations_out = tmp;
         }
-        #endif
-        #if DIM == 2
-        }}
-        #endif
+        SYNC;
 
-        result *= 1.0 / this->N;
+        const Layer& last_layer = this->layers[this->num_layers - 1u];
+        LOOP(k, last_layer.size * num_shifts) {
+            function(activations_in[(k % num_shifts) * this->width + k / num_shifts]);
+        }
+    }
 
+#endif // PSI_DEEP_BATCHED_SHIFTS
+
+    HDINLINE
+    bool has_batched_shifts() const {
+        #ifdef PSI_DEEP_BATCHED_SHIFTS
+        return this->get_num_shifts() * this->width <= max_batched_activations;
+        #else
+        return false;
         #endif
     }
 
     HDINLINE
-    void log_psi_s_real(double& result, const Spins& spins, Angles& cache) const {
+    const complex_t* get_deep_angles(const Spins& spins, Angles& cache) const {
+        // Returns the angles of all layers for 'spins'. The forward pass is skipped
+        // if the cache still holds the angles computed by log_psi_s() for these spins.
+        #include "cuda_kernel_defines.h"
+
+        SYNC;
+        if(!cache.has_deep_angles || !(cache.deep_angles_spins == spins)) {
+            this->forward_pass(spins, cache, cache.deep_angles());
+            SYNC;
+            SINGLE {
+                cache.has_deep_angles = true;
+                cache.deep_angles_spins = spins;
+            }
+        }
+        SYNC;
+
+        return cache.deep_angles();
+    }
+
+    HDINLINE
+    void log_psi_s(complex_t& result, const Spins& spins, Angles& cache) const {
         // CAUTION: 'result' has to be a shared variable.
+        #include "cuda_kernel_defines.h"
 
         SINGLE {
-            result = 0.0;
+            result = complex_t(0.0, 0.0);
         }
 
-        #ifdef TRANSLATIONAL_INVARIANCE
-
-        #if DIM == 1
-        for(auto shift = 0u; shift < this->N; shift++) {
-        this->forward_pass(spins.rotate_left(shift, this->N), cache.activations, nullptr);
-        #endif
-        #if DIM == 2
-        for(auto shift_i = 0u; shift_i < this->N_i; shift_i++) {
-            for(auto shift_j = 0u; shift_j < this->N_j; shift_j++) {
-                this->forward_pass(spins.shift_2d(shift_i, shift_j, this->N_i, this->N_j), cache.activations, nullptr);
+        // the angles of the unshifted pass are kept for a subsequent call of foreach_O_k()
+        #ifdef PSI_DEEP_BATCHED_SHIFTS
+        if(this->has_batched_shifts()) {
+            this->forward_pass_of_all_shifts(cache, cache.deep_angles(), [&](const complex_t& activation) {
+                generic_atomicAdd(&result, activation);
+            });
+        }
+        else
         #endif
+        for(auto shift = 0u; shift < this->get_num_shifts(); shift++) {
+            this->forward_pass_of_shift(shift, spins, cache, shift == 0u ? cache.deep_angles() : nullptr);
 
-        #else
-
-        this->forward_pass(spins, cache.activations, nullptr);
+            MULTI(j, this->layers[this->num_layers - 1u].size) {
+                generic_atomicAdd(&result, cache.activations()[j]);
+            }
+        }
 
-        #endif
+        SYNC;
+        SINGLE {
+            #ifdef TRANSLATIONAL_INVARIANCE
+            result *= 1.0 / this->N;
+            #endif
 
-        MULTI(j, this->layers[this->num_layers - 1u].size) {
-            generic_atomicAdd(&result, cache.activations[j].real());
+            cache.has_deep_angles = true;
+            cache.deep_angles_spins = spins;
         }
+        SYNC;
+    }
 
+    HDINLINE
+    void log_psi_s_real(double& result, const Spins& spins, Angles& cache) const {
+        // CAUTION: 'result' has to be a shared variable.
+        #include "cuda_kernel_defines.h"
 
-        #ifdef TRANSLATIONAL_INVARIANCE
+        SINGLE {
+            result = 0.0;
+        }
 
-        #if DIM == 1
+        #ifdef PSI_DEEP_BATCHED_SHIFTS
+        if(this->has_batched_shifts()) {
+            this->forward_pass_of_all_shifts(cache, nullptr, [&](const complex_t& activation) {
+                generic_atomicAdd(&result, activation.real());
+            });
         }
+        else
         #endif
-        #if DIM == 2
-        }}
-        #endif
+        for(auto shift = 0u; shift < this->get_num_shifts(); shift++) {
+            this->forward_pass_of_shift(shift, spins, cache, nullptr);
 
-        result *= 1.0 / this->N;
+            MULTI(j, this->layers[this->num_layers - 1u].size) {
+                generic_atomicAdd(&result, cache.activations()[j].real());
+            }
+        }
 
+        #ifdef TRANSLATIONAL_INVARIANCE
+        SYNC;
+        SINGLE {
+            result *= 1.0 / this->N;
+        }
+        SYNC;
         #endif
     }
 
     HDINLINE void flip_spin_of_jth_angle(
         const unsigned int j, const unsigned int position, const Spins& new_spins, Angles& cache
     ) const {
+        #ifdef PSI_DEEP_CACHED_ANGLES
+
+        if(j >= this->get_num_angles()) {
+            return;
+        }
+
+        const Layer& layer = this->layers[0];
+
+        #if defined(TRANSLATIONAL_INVARIANCE) && DIM == 2
+        // a 2d-shift does not map each connection onto a single translation: recompute the column.
+        for(auto shift = 0u; shift < this->get_num_shifts(); shift++) {
+            cache.shift_angles(shift)[j] = this->angle(j, this->shifted_spins(new_spins, shift));
+        }
+        #else
+        // Only units connected to the flipped site change. For the i-th connection of unit j
+        // the flipped site is seen exactly by the translation which moves 'position' onto it.
+        for(auto i = 0u; i < layer.lhs_connectivity; i++) {
+            #ifdef TRANSLATIONAL_INVARIANCE
+            const auto shift = (layer.lhs_connection(i, j) + this->N - position) % this->N;
+            #else
+            if(layer.lhs_connection(i, j) != position) {
+                continue;
+            }
+            const auto shift = 0u;
+            #endif
+
+            cache.shift_angles(shift)[j] += 2.0 * new_spins[position] * layer.lhs_weight(i, j);
+        }
+        #endif
+
+        #endif // PSI_DEEP_CACHED_ANGLES
     }
 
     HDINLINE
@@ -238,8 +417,7 @@ public:
     void foreach_angle(const Spins& spins, Angles& cache, Function function) const {
         #include "cuda_kernel_defines.h"
 
-        SHARED complex_t deep_angles[max_deep_angles];
-        this->forward_pass(spins, cache.activations, deep_angles);
+        const complex_t* deep_angles = this->get_deep_angles(spins, cache);
 
         for(int layer_idx = int(this->num_layers) - 1; layer_idx >= 0; layer_idx--) {
             const Layer& layer = this->layers[layer_idx];
@@ -255,9 +433,7 @@ public:
     void foreach_O_k(const Spins& spins, Angles& cache, Function function) const {
         #include "cuda_kernel_defines.h"
 
-        SHARED complex_t deep_angles[max_deep_angles];
-
-        this->forward_pass(spins, cache.activations, deep_angles);
+        const complex_t* deep_angles = this->get_deep_angles(spins, cache);
 
         for(int layer_idx = int(this->num_layers) - 1; layer_idx >= 0; layer_idx--) {
             const Layer& layer = this->layers[layer_idx];
@@ -266,7 +442,7 @@ public:
             // here, these are the back-propagated derivatives.
             if(layer_idx == this->num_layers - 1) {
                 MULTI(j, layer.size) {
-                    cache.activations[j] = my_tanh(deep_angles[
+                    cache.activations()[j] = my_tanh(deep_angles[
                         layer.begin_angles + j
                     ]);
                 }
@@ -275,9 +451,11 @@ public:
                 #ifdef __CUDA_ARCH__
                 complex_t unit_activation(0.0, 0.0);
                 #else
-                complex_t unit_activation[Angles::max_width];
+                complex_t* unit_activation = cache.activations_out();
                 #endif
 
+                const Layer& rhs_layer = this->layers[layer_idx + 1];
+
                 SYNC;
                 MULTI(i, layer.size) {
                     #ifndef __CUDA_ARCH__
@@ -291,7 +469,9 @@ public:
                         unit_activation[i] +=
                         #endif
                         (
-                            layer.rhs_weight(i, j) * cache.activations[
+                            rhs_layer.dense_weights != nullptr ?
+                            rhs_layer.dense_weight(i, j) * cache.activations()[j] :
+                            layer.rhs_weight(i, j) * cache.activations()[
                                 layer.rhs_connection(i, j)
                             ]
                         );
@@ -308,14 +488,14 @@ public:
                 SYNC;
                 MULTI(j, layer.size) {
                     #ifdef __CUDA_ARCH__
-                    cache.activations[j] = unit_activation;
+                    cache.activations()[j] = unit_activation;
                     #else
-                    cache.activations[j] = unit_activation[j];
+                    cache.activations()[j] = unit_activation[j];
                     #endif
                 }
             }
             MULTI(j, layer.size) {
-                function(layer.begin_params + j, cache.activations[j]);
+                function(layer.begin_params + j, cache.activations()[j]);
 
                 for(auto i = 0u; i < layer.lhs_connectivity; i++) {
                     const auto lhs_unit_idx = layer.lhs_connection(i, j);
@@ -323,7 +503,7 @@ public:
 
                     function(
                         layer.begin_params + layer.size + i * layer.size + j,
-                        cache.activations[j] * (
+                        cache.activations()[j] * (
                             layer_idx == 0 ?
                             complex_t(spins[lhs_unit_idx], 0.0) :
                             my_logcosh(
@@ -369,6 +549,34 @@ public:
         return this->layers[0].size;
     }
 
+    HDINLINE
+    unsigned int get_num_shifts() const {
+        #ifdef TRANSLATIONAL_INVARIANCE
+        #if DIM == 1
+        return this->N;
+        #endif
+        #if DIM == 2
+        return this->N_i * this->N_j;
+        #endif
+        #else
+        return 1u;
+        #endif
+    }
+
+    HDINLINE
+    Spins shifted_spins(const Spins& spins, const unsigned int shift) const {
+        #ifdef TRANSLATIONAL_INVARIANCE
+        #if DIM == 1
+        return spins.rotate_left(shift, this->N);
+        #endif
+        #if DIM == 2
+        return spins.shift_2d(shift / this->N_j, shift % this->N_j, this->N_i, this->N_j);
+        #endif
+        #else
+        return spins;
+        #endif
+    }
+
     HDINLINE
     unsigned int get_num_units() const {
         return this->num_units;
@@ -380,30 +588,64 @@ public:
     }
 };
 
+#ifdef PSI_DEEP_BATCHED_SHIFTS
+constexpr auto psi_deep_batched_shared_memory = 2u * PsiDeep::max_batched_activations * sizeof(complex_t);
+#else
+constexpr auto psi_deep_batched_shared_memory = 0u;
+#endif
+
+// The largest kernels hold the angles of a sample and one scratch for the connected configurations in static shared
+// memory, see Operator::local_energy(), besides the buffers of the batched forward pass and a few shared scalars.
+static_assert(
+    2u * sizeof(PsiDeep::Angles) + psi_deep_batched_shared_memory + 2048u <= MAX_SHARED_MEMORY - MAX_DYNAMIC_SHARED_MEMORY,
+    "PsiDeep: the kernels exceed the static shared memory of a block, lower MAX_SPINS or PSI_DEEP_WORKSPACE_SIZE"
+);
+
 } // namespace kernel
 
 
 class PsiDeep : public kernel::PsiDeep {
 public:
-    Array<double> alpha_array;
-    Array<double> beta_array;
-    const bool    free_quantum_axis;
-
+    // Topology of a layer. It is immutable and shared between all copies of a network.
     struct Layer {
-        unsigned int        size;
-        unsigned int        lhs_connectivity;
-        Array<unsigned int> lhs_connections;
-        Array<unsigned int> rhs_connections;
-        Array<complex_t>    lhs_weights;
-        Array<complex_t>    rhs_weights;
-        Array<complex_t>    biases;
+        unsigned int            size;
+        unsigned int            lhs_connectivity;
+        unsigned int            begin_params;
+        Array<unsigned int>     lhs_connections;
+        Array<unsigned int>     rhs_connections;
+        vector<unsigned int>    rhs_positions;      // position of each lhs-weight within the rhs-weights of the previous layer
+        bool                    dense;              // each unit is connected to each unit of the lhs exactly once
+    };
+    using Layers = vector<Layer>;
+
+    // The parameters and all buffers derived from them.
+    // They are shared between copies of a network until one of them is modified, see make_params_unique().
+    struct Weights {
+        Array<complex_t>            params;         // [alpha | beta | biases_0 | lhs_weights_0 | biases_1 | ...]
+        vector<Array<complex_t>>    rhs_weights;    // derived from the lhs-weights of the next layer
+        vector<Array<complex_t>>    dense_weights;  // only filled for dense layers
+        kernel::PsiDeep::Layer*     kernel_layers;  // layer descriptors handed to the kernel
+        unsigned int                num_layers;
+        bool                        gpu;
+
+        Weights(Array<complex_t>&& params, const Layers& layers, const unsigned int N, const bool gpu);
+        Weights(const Weights& other);
+        ~Weights() noexcept(false);
     };
-    list<Layer> layers;
+
+    shared_ptr<const Layers>    layers;
+    CopyOnWrite<Weights>        weights;
+
+    // views onto the blocks of the parameters, bound by update_kernel()
+    RealArrayView               alpha_array;
+    RealArrayView               beta_array;
+    const bool                  free_quantum_axis;
 
     bool gpu;
 
 public:
     PsiDeep(const PsiDeep& other);
+    PsiDeep(const NetworkFile& file, const bool gpu);
 
 #ifdef __PYTHONCC__
 
@@ -416,95 +658,42 @@ public:
         const double prefactor,
         const bool free_quantum_axis,
         const bool gpu
-    ) : alpha_array(alpha, false), beta_array(beta, false), free_quantum_axis(free_quantum_axis), gpu(gpu) {
+    ) : free_quantum_axis(free_quantum_axis), gpu(gpu) {
         this->N = alpha.shape()[0];
         this->prefactor = prefactor;
-        this->num_layers = lhs_weights_list.size();
-        this->width = this->N;
-        this->num_units = 0u;
 
-        Array<unsigned int> rhs_connections_array(0, false);
-        Array<complex_t> rhs_weights_array(0, false);
+        vector<LayerTopology> topology;
+        for(auto layer_idx = 0u; layer_idx < lhs_weights_list.size(); layer_idx++) {
+            topology.push_back({
+                (unsigned int)biases_list[layer_idx].size(),
+                (unsigned int)lhs_connections_list[layer_idx].shape()[0],
+                lhs_connections_list[layer_idx].data()
+            });
+        }
+        const auto num_params = this->init_layers(topology);
 
-        for(auto layer_idx = int(this->num_layers) - 1; layer_idx >= 0; layer_idx--) {
-            const auto& lhs_connections = lhs_connections_list[layer_idx];
-            const auto& lhs_weights = lhs_weights_list[layer_idx];
+        Array<complex_t> params(num_params, gpu);
+        for(auto i = 0u; i < this->N; i++) {
+            params[i] = complex_t(alpha[i], 0.0);
+            params[this->N + i] = complex_t(beta[i], 0.0);
+        }
+        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
+            const auto& layer = (*this->layers)[layer_idx];
             const auto& biases = biases_list[layer_idx];
+            const auto& lhs_weights = lhs_weights_list[layer_idx];
 
-            const unsigned int size = biases.size();
-            const unsigned int lhs_connectivity = lhs_connections.shape()[0];
-
-            if(size > this->width) {
-                this->width = size;
-            }
-
-            this->num_units += size;
-
-            Array<unsigned int> lhs_connections_array(lhs_connections, gpu);
-            Array<complex_t> lhs_weights_array(lhs_weights, gpu);
-            Array<complex_t> biases_array(biases, gpu);
-
-            const auto rhs_connections_and_weights = this->compile_rhs_connections_and_weights(
-                layer_idx > 0 ? biases_list[layer_idx - 1].size() : this->N,
-                size,
-                lhs_connectivity,
-                lhs_connections_array,
-                lhs_weights_array
+            memcpy(params.host_data() + layer.begin_params, biases.data(), sizeof(complex_t) * biases.size());
+            memcpy(
+                params.host_data() + layer.begin_params + layer.size,
+                lhs_weights.data(),
+                sizeof(complex_t) * lhs_weights.size()
             );
-
-            this->layers.push_front({
-                size,
-                lhs_connectivity,
-                move(lhs_connections_array),
-                move(rhs_connections_array),
-                move(lhs_weights_array),
-                move(rhs_weights_array),
-                move(biases_array)
-            });
-
-            rhs_connections_array = move(rhs_connections_and_weights.first);
-            rhs_weights_array = move(rhs_connections_and_weights.second);
         }
 
-        this->init_kernel();
+        this->weights = CopyOnWrite<Weights>(make_shared<Weights>(move(params), *this->layers, this->N, gpu));
 
-        // cout << "N: " << this->N << endl;
-        // cout << "num_layers: " << this->num_layers << endl;
-        // cout << "width: " << this->width << endl;
-        // cout << "num_params: " << this->num_params << endl;
-        // cout << "prefactor: " << this->prefactor << endl;
-        // cout << endl;
-
-        // for(auto layer_idx = int(this->num_layers) - 1; layer_idx >= 0; layer_idx--) {
-        //     const auto& kernel_layer = kernel::PsiDeep::layers[layer_idx];
-        //     const auto& layer = *next(this->layers.begin(), layer_idx);
-
-        //     cout << "Layer: " << layer_idx << endl;
-        //     cout << "size: " << kernel_layer.size << endl;
-        //     cout << "lhs_connectivity: " << kernel_layer.lhs_connectivity << endl;
-        //     cout << "rhs_connectivity: " << kernel_layer.rhs_connectivity << endl;
-        //     cout << "begin_params: " << kernel_layer.begin_params << endl;
-        //     cout << "begin_angles: " << kernel_layer.begin_angles << endl;
-        //     cout << "lhs_weights.size: " << layer.lhs_weights.size() << endl;
-        //     cout << "rhs_weights.size: " << layer.rhs_weights.size() << endl;
-        //     cout << "biases.size: " << layer.biases.size() << endl;
-        //     cout << "rhs_connections.size: " << layer.rhs_connections.size() << endl;
-        //     cout << "lhs_connections: " << endl;
-        //     for(auto i = 0u; i < layer.lhs_connectivity; i++) {
-        //         for(auto j = 0u; j < layer.size; j++) {
-        //             cout << layer.lhs_connections[i * layer.size + j] << ", ";
-        //         }
-        //         cout << endl;
-        //     }
-        //     cout << "rhs_connections: " << endl;
-        //     for(auto i = 0u; i < layer.size; i++) {
-        //         for(auto j = 0u; j < kernel_layer.rhs_connectivity; j++) {
-        //             cout << layer.rhs_connections[i * kernel_layer.rhs_connectivity + j] << ", ";
-        //         }
-        //         cout << endl;
-        //     }
-        //     cout << endl;
-        // }
+        this->init_kernel();
+        this->update_params();
     }
 
     PsiDeep copy() const {
@@ -518,8 +707,8 @@ public:
     inline vector<xt::pytensor<complex<double>, 1>> get_b() const {
         vector<xt::pytensor<complex<double>, 1>> result;
 
-        for(const auto& layer : this->layers) {
-            result.push_back(layer.biases.to_pytensor<1u>());
+        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
+            result.push_back(this->get_biases(layer_idx).to_pytensor<1u>());
         }
 
         return result;
@@ -528,8 +717,10 @@ public:
     inline vector<xt::pytensor<complex<double>, 2>> get_W() const {
         vector<xt::pytensor<complex<double>, 2>> result;
 
-        for(const auto& layer : this->layers) {
-            result.push_back(layer.lhs_weights.to_pytensor<2u>(shape_t<2u>{
+        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
+            const auto& layer = (*this->layers)[layer_idx];
+
+            result.push_back(this->get_lhs_weights(layer_idx).to_pytensor<2u>(shape_t<2u>{
                 (long int)layer.lhs_connectivity, (long int)layer.size
             }));
         }
@@ -540,7 +731,7 @@ public:
     inline vector<xt::pytensor<unsigned int, 2>> get_connections() const {
         vector<xt::pytensor<unsigned int, 2>> result;
 
-        for(const auto& layer : this->layers) {
+        for(const auto& layer : *this->layers) {
             result.push_back(layer.lhs_connections.to_pytensor<2u>(shape_t<2u>{
                 (long int)layer.lhs_connectivity, (long int)layer.size
             }));
@@ -558,20 +749,58 @@ public:
         return psi_norm(*this, exact_summation);
     }
 
-    Array<complex_t> get_params() const;
-    void set_params(const Array<complex_t>& new_params);
+    void save(const string& file_name) const;
+
+    // Carries the cached angles along the flips at 'positions' starting from 'spins', as a Markov chain does.
+    // Returns log(psi) after each flip.
+    vector<complex<double>> log_psi_s_along_flips(const Spins& spins, const vector<unsigned int>& positions) const;
+
+    inline const Array<complex_t>& get_params() const {
+        return this->weights->params;
+    }
+    void set_params(const complex_t* new_params);
+    void update_params();
+    void make_params_unique();
+    // the store as long as a reference to it escaped, to be matched by unpin_params()
+    Array<complex_t>& pin_params();
+    inline void unpin_params() {
+        this->weights.unpin();
+    }
+
+    inline ArrayView<const complex_t> get_biases(const unsigned int layer_idx) const {
+        const auto& layer = (*this->layers)[layer_idx];
+        return {this->weights->params.host_data() + layer.begin_params, layer.size};
+    }
+
+    inline ArrayView<const complex_t> get_lhs_weights(const unsigned int layer_idx) const {
+        const auto& layer = (*this->layers)[layer_idx];
+        return {this->weights->params.host_data() + layer.begin_params + layer.size, layer.lhs_connectivity * layer.size};
+    }
 
     void init_kernel();
     void update_kernel();
 
 private:
-    pair<Array<unsigned int>, Array<complex_t>> compile_rhs_connections_and_weights(
+    // sets up the topology from the lhs-connections of each layer and returns the number of parameters.
+    unsigned int init_layers(const vector<LayerTopology>& topology);
+
+    void scatter_dense_weights(Array<complex_t>& dense_weights, const unsigned int layer_idx) const;
+
+    bool is_dense(
+        const unsigned int prev_size,
+        const unsigned int size,
+        const unsigned int lhs_connectivity,
+        const Array<unsigned int>& lhs_connections
+    ) const;
+
+    vector<unsigned int> compile_rhs_positions(
         const unsigned int prev_size,
         const unsigned int size,
         const unsigned int lhs_connectivity,
-        const Array<unsigned int>& lhs_connections,
-        const Array<complex_t>& lhs_weights
-    );
+        const Array<unsigned int>& lhs_connections
+    ) const;
+
+    Array<unsigned int> compile_rhs_connections(const Layer& layer, const Layer& next_layer) const;
 };
 
 } // namespace rbm_on_gpu
@@ -4,24 +4,131 @@
 #include "types.h"
 
 
+// Caching the first-layer angles of every translation takes MAX_SPINS * width complex numbers
+// of shared memory per cache, which only fits into a block for small systems.
+// The same holds for the two activation buffers of the batched forward pass over all translations.
+// Together they bound the static shared memory of the kernels, which is checked in PsiDeep.hpp.
+#if MAX_SPINS <= 16
+#define PSI_DEEP_CACHED_ANGLES
+#define PSI_DEEP_BATCHED_SHIFTS
+#endif
+
+// Capacity of the per-sample workspace of PsiDeep in complex numbers. The workspace is carved into
+// the buffers needed by the actual network, hence the depth and the width of the network are only
+// bounded by its total size. Can be raised at compile time for larger networks.
+#ifndef PSI_DEEP_WORKSPACE_SIZE
+#ifdef PSI_DEEP_CACHED_ANGLES
+#define PSI_DEEP_WORKSPACE_SIZE (8 * MAX_SPINS + 2 * MAX_SPINS * MAX_SPINS)
+#else
+#define PSI_DEEP_WORKSPACE_SIZE (8 * MAX_SPINS)
+#endif
+#endif
+
+
 namespace rbm_on_gpu {
 
 // #ifdef __CUDACC__
 
 struct PsiDeepAngles {
-    static constexpr unsigned int max_width = 2 * MAX_SPINS;
+    static constexpr unsigned int max_workspace = PSI_DEEP_WORKSPACE_SIZE;
+
+    complex_t workspace[max_workspace];
 
-    complex_t activations[max_width];
+    // Offsets of the views into the workspace, set up by init() according to the network. Offsets instead of
+    // pointers keep a by-value copy, e.g. when passing the cache to a kernel, consistent with its own workspace.
+    //
+    // activations          width
+    // activations_out      width, scratch of the forward and the backward pass
+    // deep_angles          num_units, angles of all layers of the unshifted forward pass, filled by log_psi_s() and
+    //                      read by the backward pass in foreach_O_k() as long as they belong to 'deep_angles_spins'
+    // angles               first-layer angles (pre-activations) for each translation: shift x num_angles
+    unsigned int activations_out_begin;
+    unsigned int deep_angles_begin;
+
+    Spins      deep_angles_spins;
+    bool       has_deep_angles;
+
+#ifdef PSI_DEEP_CACHED_ANGLES
+    unsigned int angles_begin;
+    unsigned int num_angles;
+#endif
 
     PsiDeepAngles() = default;
 
+    template<typename Psi_t>
+    HDINLINE void assign_workspace(const Psi_t& psi) {
+        this->activations_out_begin = psi.get_width();
+        this->deep_angles_begin = 2u * psi.get_width();
+
+        #ifdef PSI_DEEP_CACHED_ANGLES
+        this->angles_begin = this->deep_angles_begin + psi.get_num_units();
+        this->num_angles = psi.get_num_angles();
+        #endif
+    }
+
+    HDINLINE complex_t* activations() {
+        return this->workspace;
+    }
+
+    HDINLINE complex_t* activations_out() {
+        return this->workspace + this->activations_out_begin;
+    }
+
+    HDINLINE complex_t* deep_angles() {
+        return this->workspace + this->deep_angles_begin;
+    }
+
     template<typename Psi_t>
     HDINLINE void init(const Psi_t& psi, const PsiDeepAngles& other) {
+        #include "cuda_kernel_defines.h"
+
+        SINGLE {
+            this->assign_workspace(psi);
+            this->has_deep_angles = false;
+        }
+        SYNC;
+
+        #ifdef PSI_DEEP_CACHED_ANGLES
+
+        MULTI(j, psi.get_num_angles())
+        {
+            for(auto shift = 0u; shift < psi.get_num_shifts(); shift++) {
+                this->shift_angles(shift)[j] = other.shift_angles(shift)[j];
+            }
+        }
+        #endif
     }
 
     template<typename Psi_t>
     HDINLINE void init(const Psi_t& psi, const Spins& spins) {
+        #include "cuda_kernel_defines.h"
+
+        SINGLE {
+            this->assign_workspace(psi);
+            this->has_deep_angles = false;
+        }
+        SYNC;
+
+        #ifdef PSI_DEEP_CACHED_ANGLES
+
+        MULTI(j, psi.get_num_angles())
+        {
+            for(auto shift = 0u; shift < psi.get_num_shifts(); shift++) {
+                this->shift_angles(shift)[j] = psi.angle(j, psi.shifted_spins(spins, shift));
+            }
+        }
+        #endif
+    }
+
+#ifdef PSI_DEEP_CACHED_ANGLES
+    HDINLINE complex_t* shift_angles(const unsigned int shift) {
+        return this->workspace + this->angles_begin + shift * this->num_angles;
+    }
+
+    HDINLINE const complex_t* shift_angles(const unsigned int shift) const {
+        return this->workspace + this->angles_begin + shift * this->num_angles;
     }
+#endif
 
 };
 
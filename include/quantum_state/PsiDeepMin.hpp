@@ -1,7 +1,6 @@
 #pragma once
 
 #include <vector>
-#include <list>
 #include <complex>
 #include <memory>
 #include <cassert>
@@ -9,6 +8,13 @@
 #include <algorithm>
 #include <string>
 #include <fstream>
+#include <iterator>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <cstdint>
+
+#include "NetworkFile.hpp"
 
 #ifndef MAX_SPINS
 #define MAX_SPINS 64
@@ -17,25 +23,47 @@
 using namespace std;
 using complex_std = std::complex<double>;
 
-inline complex_std read_complex(ifstream& infile) {
-    double value_re, value_im;
-    infile >> value_re >> value_im;
-    return complex_std(value_re, value_im);
-}
-
 
 namespace rbm_on_gpu {
 
 namespace kernel {
 
+// Rational approximation of log(cosh(z)), cf. my_logcosh() in psi_functions.hpp.
+// Since logcosh(z) = logcosh(-z), the polynomials are evaluated at w = sign(Re z) * z, which avoids any branch.
+// Operates on real and imaginary part separately such that the loops of the forward pass can be vectorized.
+inline void activation_function(double& re, double& im) {
+    const auto sign = 1.0 - 2.0 * double(re <= 0.0);
+    const auto w_re = sign * re;
+    const auto w_im = sign * im;
+
+    // denominator: 9.19376335670885 + w * (10.2180213465 + w * (7.771429504240965 + w * (3.746646023906276 + w)))
+    auto d_re = w_re + 3.746646023906276;
+    auto d_im = w_im;
+    auto tmp = d_re * w_re - d_im * w_im + 7.771429504240965;
+    d_im = d_re * w_im + d_im * w_re;
+    d_re = tmp;
+    tmp = d_re * w_re - d_im * w_im + 10.2180213465;
+    d_im = d_re * w_im + d_im * w_re;
+    d_re = tmp;
+    tmp = d_re * w_re - d_im * w_im + 9.19376335670885;
+    d_im = d_re * w_im + d_im * w_re;
+    d_re = tmp;
+
+    const auto n_re = 5.49914721954 - 2.16564366435 * w_re;
+    const auto n_im = -2.16564366435 * w_im;
+
+    const auto inv_norm = 1.0 / (d_re * d_re + d_im * d_im);
+
+    re = 0.9003320053750442 * w_re + (n_re * d_re + n_im * d_im) * inv_norm - 0.598139;
+    im = 0.9003320053750442 * w_im + (n_im * d_re - n_re * d_im) * inv_norm;
+}
+
 inline complex_std activation_function(const complex_std z) {
-    const auto sign = z.real() > 0.0 ? 1.0 : -1.0;
+    auto re = z.real();
+    auto im = z.imag();
+    activation_function(re, im);
 
-    return sign * 0.9003320053750442 * z + (
-        5.49914721954 - sign * 2.16564366435 * z
-    ) / (
-        9.19376335670885 + z * (sign * 10.2180213465 + z * (7.771429504240965 + z * (sign * 3.746646023906276 + z)))
-    ) - 0.598139;
+    return complex_std(re, im);
 }
 
 
@@ -45,17 +73,19 @@ public:
     static constexpr unsigned int max_width = 2 * MAX_SPINS;
     static constexpr unsigned int max_deep_angles = max_layers * MAX_SPINS;
 
-    // TODO: Try to use stack-allocated arrays
+    // configurations per thread below which batched evaluation doesn't spawn more threads.
+    static constexpr unsigned int min_batch_per_thread = 16u;
+
     struct Layer {
         unsigned int  size;                 // number of units
         unsigned int  begin_params;         // index of the first unit of this layer in a global list of parameters
         unsigned int  lhs_connectivity;     // number of connections to the lhs per unit
         unsigned int  rhs_connectivity;     // number of connections to the rhs per unit
-        unsigned int* lhs_connections;      // connectivity matrix to the lhs: lhs-connectivity x size
-        unsigned int* rhs_connections;      // connectivity matrix to the rhs: size x rhs-connectivity
-        complex_std*    lhs_weights;          // weight matrix to the lhs: lhs-connectivity x size
-        complex_std*    rhs_weights;          // weight matrix to the rhs: size x rhs-connectivity
-        complex_std*    biases;               // bias factors
+        const unsigned int* lhs_connections;    // connectivity matrix to the lhs: lhs-connectivity x size
+        const unsigned int* rhs_connections;    // connectivity matrix to the rhs: size x rhs-connectivity
+        const complex_std*  lhs_weights;        // weight matrix to the lhs: lhs-connectivity x size
+        const complex_std*  rhs_weights;        // weight matrix to the rhs: size x rhs-connectivity
+        const complex_std*  biases;             // bias factors
 
         inline unsigned int lhs_connection(const unsigned int i, const unsigned int j) const {
             return this->lhs_connections[i * this->size + j];
@@ -71,70 +101,153 @@ public:
         }
     };
 
+    // Scratch of the forward pass over all translations at once. All activations are stored as
+    // unit x shift, separately for real and imaginary part, such that the innermost loops run
+    // over the shifts with unit stride.
+    struct Workspace {
+        vector<double> buffer;
+
+        double* spins;      // 2N, the input spins twice. Translation 'shift' starts at spins + shift.
+        double* in_re;      // width x N
+        double* in_im;
+        double* out_re;
+        double* out_im;
+
+        inline void assign(const unsigned int N, const unsigned int width) {
+            const auto activations_size = width * N;
+            if(this->buffer.size() < 2u * N + 4u * activations_size) {
+                this->buffer.resize(2u * N + 4u * activations_size);
+            }
+
+            this->spins = this->buffer.data();
+            this->in_re = this->spins + 2u * N;
+            this->in_im = this->in_re + activations_size;
+            this->out_re = this->in_im + activations_size;
+            this->out_im = this->out_re + activations_size;
+        }
+    };
+
     unsigned int   N;
     Layer          layers[max_layers];
     unsigned int   num_layers;
+    unsigned int   width;               // size of the widest layer
 
     unsigned int   num_params;
     double         prefactor;
     double         log_prefactor;
 
-    // using Angles = rbm_on_gpu::PsiDeepMinAngles;
-
 public:
 
-    inline
-    void forward_pass(
-        const vector<int>& spins,
-        complex_std* activations_in /* once this functions has finished, this holds the *output*-activations of the last layer */
-    ) const
-    {
-        complex_std activations_out[max_width];
+    // Evaluates the network for all N translations of the spins at once.
+    // 'spins' can be any type whose operator[] yields +1/-1, e.g. a vector<int> or bit-packed Spins.
+    template<typename Spins_t>
+    inline complex_std log_psi_s(const Spins_t& spins, Workspace& workspace) const {
+        const auto N = this->N;
+        workspace.assign(N, this->width);
 
-        for(auto i = 0u; i < this->N; i++) {
-            activations_in[i] = spins[i];
+        // shifting the spins to the left by 'shift' amounts to starting to read at 'shift'.
+        for(auto i = 0u; i < N; i++) {
+            workspace.spins[i] = workspace.spins[i + N] = double(spins[i]);
         }
 
         for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
-
             const Layer& layer = this->layers[layer_idx];
+
             for(auto j = 0u; j < layer.size; j++) {
-                activations_out[j] = complex_std(0.0, 0.0);
+                auto out_re = workspace.out_re + j * N;
+                auto out_im = workspace.out_im + j * N;
+
+                for(auto shift = 0u; shift < N; shift++) {
+                    out_re[shift] = layer.biases[j].real();
+                    out_im[shift] = layer.biases[j].imag();
+                }
 
                 for(auto i = 0u; i < layer.lhs_connectivity; i++) {
-                    activations_out[j] += (
-                        layer.lhs_weight(i, j) *
-                        activations_in[layer.lhs_connection(i, j)]
-                    );
+                    const auto w_re = layer.lhs_weight(i, j).real();
+                    const auto w_im = layer.lhs_weight(i, j).imag();
+                    const auto lhs_idx = layer.lhs_connection(i, j);
+
+                    if(layer_idx == 0u) {
+                        const auto in = workspace.spins + lhs_idx;
+
+                        for(auto shift = 0u; shift < N; shift++) {
+                            out_re[shift] += w_re * in[shift];
+                            out_im[shift] += w_im * in[shift];
+                        }
+                    }
+                    else {
+                        const auto in_re = workspace.in_re + lhs_idx * N;
+                        const auto in_im = workspace.in_im + lhs_idx * N;
+
+                        for(auto shift = 0u; shift < N; shift++) {
+                            out_re[shift] += w_re * in_re[shift] - w_im * in_im[shift];
+                            out_im[shift] += w_re * in_im[shift] + w_im * in_re[shift];
+                        }
+                    }
                 }
-                activations_out[j] += layer.biases[j];
-            }
 
-            for(auto k = 0u; k < layer.size; k++) {
-                activations_in[k] = activation_function(activations_out[k]);
+                for(auto shift = 0u; shift < N; shift++) {
+                    activation_function(out_re[shift], out_im[shift]);
+                }
             }
+
+            swap(workspace.in_re, workspace.out_re);
+            swap(workspace.in_im, workspace.out_im);
+        }
+
+        const auto num_outputs = this->layers[this->num_layers - 1u].size * N;
+        auto result_re = 0.0;
+        auto result_im = 0.0;
+        for(auto k = 0u; k < num_outputs; k++) {
+            result_re += workspace.in_re[k];
+            result_im += workspace.in_im[k];
         }
-    }
 
-    inline
-    complex_std log_psi_s(const vector<int>& spins_in) const {
-        complex_std activations[max_width];
+        return complex_std(result_re, result_im) / double(N) + this->log_prefactor;
+    }
 
-        complex_std result (0.0, 0.0);
-        vector<int> spins(spins_in);
+    // Uses a workspace per thread, which is only allocated on the first call.
+    template<typename Spins_t>
+    inline complex_std log_psi_s(const Spins_t& spins) const {
+        thread_local Workspace workspace;
 
-        for(auto shift = 0u; shift < this->N; shift++) {
-            this->forward_pass(spins, activations);
+        return this->log_psi_s(spins, workspace);
+    }
 
-            for(auto j = 0u; j < this->layers[this->num_layers - 1u].size; j++) {
-                result += activations[j];
+    // Evaluates a batch of configurations, split into contiguous chunks over 'num_threads' threads.
+    // A 'num_threads' of zero picks the number of hardware threads.
+    template<typename Spins_t>
+    inline void log_psi_s_batch(
+        complex_std* result, const Spins_t* spins, const size_t num_configurations, unsigned int num_threads = 0u
+    ) const {
+        if(num_threads == 0u) {
+            num_threads = max(thread::hardware_concurrency(), 1u);
+        }
+        num_threads = max(
+            min<size_t>(num_threads, num_configurations / min_batch_per_thread),
+            size_t(1u)
+        );
+
+        const auto evaluate_chunk = [&](const unsigned int thread_idx) {
+            Workspace workspace;
+
+            const auto begin = num_configurations * thread_idx / num_threads;
+            const auto end = num_configurations * (thread_idx + 1u) / num_threads;
+            for(auto n = begin; n < end; n++) {
+                result[n] = this->log_psi_s(spins[n], workspace);
             }
+        };
 
-            rotate(spins.begin(), spins.begin() + 1, spins.end());
+        vector<thread> threads;
+        threads.reserve(num_threads - 1u);
+        for(auto thread_idx = 1u; thread_idx < num_threads; thread_idx++) {
+            threads.emplace_back(evaluate_chunk, thread_idx);
         }
-        result /= this->N;
+        evaluate_chunk(0u);
 
-        return result + this->log_prefactor;
+        for(auto& worker : threads) {
+            worker.join();
+        }
     }
 
     PsiDeepMin& get_kernel() {
@@ -149,168 +262,302 @@ public:
 } // namespace kernel
 
 
+// Whitespace separated numbers of a text file. The file is read at once and parsed with strtod(),
+// which is a lot faster than formatted stream input.
+class NumberReader {
+    string      text;
+    const char* position;
+
+public:
+    inline NumberReader(const string& file_name) {
+        ifstream infile(file_name, ios::binary);
+        if(!infile) {
+            throw runtime_error("could not open '" + file_name + "'");
+        }
+        this->text.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+        this->position = this->text.c_str();
+    }
+
+    inline double read_double() {
+        char* end;
+        const auto result = strtod(this->position, &end);
+        if(end == this->position) {
+            throw runtime_error("unexpected end of data");
+        }
+        this->position = end;
+        return result;
+    }
+
+    inline unsigned int read_unsigned() {
+        char* end;
+        const auto result = strtoul(this->position, &end, 10);
+        if(end == this->position) {
+            throw runtime_error("unexpected end of data");
+        }
+        this->position = end;
+        return (unsigned int)result;
+    }
+
+    inline complex_std read_complex() {
+        const auto value_re = this->read_double();
+        return complex_std(value_re, this->read_double());
+    }
+};
+
+
 class PsiDeepMin : public kernel::PsiDeepMin {
 public:
 
     struct Layer {
-        unsigned int        size;
-        unsigned int        lhs_connectivity;
-        vector<unsigned int> lhs_connections;
-        vector<unsigned int> rhs_connections;
-        vector<complex_std>    lhs_weights;
-        vector<complex_std>    rhs_weights;
-        vector<complex_std>    biases;
+        unsigned int            size;
+        unsigned int            lhs_connectivity;
+        unsigned int            begin_params;
+        vector<unsigned int>    lhs_connections;
+        vector<unsigned int>    rhs_connections;
+        vector<complex_std>     rhs_weights;
+        vector<unsigned int>    rhs_positions;    // position of each lhs-weight within the rhs-weights of the previous layer
     };
-    list<Layer> layers;
+    vector<Layer> layers;
+
+    // All parameters: [biases_0 | lhs_weights_0 | biases_1 | ...]. They are read in-place from the mapping
+    // of a network file, until set_params() moves them into 'own_params'.
+    shared_ptr<const MappedFile>    mapping;
+    vector<complex_std>             own_params;
+    const complex_std*              params;
 
     bool gpu;
 
-    inline PsiDeepMin(const string data_file_name) : gpu(false) {
-        ifstream infile(data_file_name);
+    // Loads either a network file, see NetworkFile.hpp, or the text format of 'psi_<index>_compressed.txt'.
+    inline explicit PsiDeepMin(const string& file_name) : params(nullptr), gpu(false) {
+        if(NetworkFile::is_network_file(file_name)) {
+            this->load_network_file(file_name);
+        }
+        else {
+            this->load_text_file(file_name);
+        }
+    }
+
+    inline PsiDeepMin(const PsiDeepMin& other)
+        :
+        kernel::PsiDeepMin(other),
+        layers(other.layers),
+        mapping(other.mapping),
+        own_params(other.own_params),
+        params(other.params == other.own_params.data() ? this->own_params.data() : other.params),
+        gpu(other.gpu)
+    {
+        this->update_kernel();
+    }
+
+    PsiDeepMin& operator=(const PsiDeepMin&) = delete;
+
+    inline void save(const string& file_name) const {
+        vector<uint32_t> topology = {this->num_layers};
+        for(const auto& layer : this->layers) {
+            append_layer_topology(topology, {layer.size, layer.lhs_connectivity, layer.lhs_connections.data()});
+        }
+
+        NetworkFile::write(
+            file_name,
+            NetworkType::PsiDeepMin,
+            this->N,
+            0u,
+            this->prefactor,
+            this->log_prefactor,
+            topology,
+            this->params,
+            this->num_params
+        );
+    }
+
+    inline void set_params(const vector<complex_std>& new_params) {
+        if(new_params.size() != this->num_params) {
+            throw runtime_error(
+                "PsiDeepMin has " + to_string(this->num_params) + " parameters, got " + to_string(new_params.size())
+            );
+        }
+
+        this->own_params.assign(new_params.begin(), new_params.end());
+        this->params = this->own_params.data();
+        this->mapping.reset();
+
+        this->update_kernel();
+        this->update_rhs_weights();
+    }
+
+    inline void init_kernel() {
+        this->num_params = 0u;
+        this->width = 0u;
+        for(auto& layer : this->layers) {
+            layer.begin_params = this->num_params;
+            this->num_params += layer.size + layer.lhs_connections.size();
+            this->width = max(this->width, layer.size);
+        }
+        this->update_kernel();
+    }
+
+    inline void update_kernel() {
+        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
+            const auto& layer = this->layers[layer_idx];
+            auto& kernel_layer = kernel::PsiDeepMin::layers[layer_idx];
+
+            kernel_layer.size = layer.size;
+            kernel_layer.lhs_connectivity = layer.lhs_connectivity;
+            kernel_layer.rhs_connectivity = layer.rhs_connections.size() / layer.size;
+            kernel_layer.begin_params = layer.begin_params;
+
+            kernel_layer.lhs_connections = layer.lhs_connections.data();
+            kernel_layer.rhs_connections = layer.rhs_connections.data();
+            kernel_layer.biases = this->params ? this->params + layer.begin_params : nullptr;
+            kernel_layer.lhs_weights = this->params ? this->params + layer.begin_params + layer.size : nullptr;
+            kernel_layer.rhs_weights = layer.rhs_weights.data();
+        }
+    }
+
+private:
+    inline void load_text_file(const string& file_name) {
+        NumberReader infile(file_name);
 
         // read fixed params
 
-        infile >> this->N;
-        infile >> this->num_layers;
-        infile >> this->log_prefactor;
+        this->N = infile.read_unsigned();
+        this->num_layers = infile.read_unsigned();
+        this->log_prefactor = infile.read_double();
         this->prefactor = exp(this->log_prefactor);
+        this->check_num_layers();
 
         vector<unsigned int> layer_sizes;
         for(auto i = 0u; i < this->num_layers; i++) {
-            unsigned int size;
-            infile >> size;
-
-            layer_sizes.push_back(size);
+            layer_sizes.push_back(infile.read_unsigned());
         }
 
-        vector<unsigned int> rhs_connections_array(0);
-        vector<complex_std> rhs_weights_array(0);
-
+        // the connections are stored starting from the last layer.
+        vector<vector<unsigned int>> lhs_connections_list(this->num_layers);
         for(auto layer_idx = int(this->num_layers) - 1; layer_idx >= 0; layer_idx--) {
             const auto size = layer_sizes[layer_idx];
+            const auto lhs_connectivity = infile.read_unsigned();
 
-            unsigned int lhs_connectivity;
-            infile >> lhs_connectivity;
-
-            vector<unsigned int> lhs_connections_array(lhs_connectivity * size);
-            for(auto i = 0u; i < lhs_connectivity; i++) {
-                for(auto j = 0u; j < size; j++) {
-                    infile >> lhs_connections_array[i * size + j];
-                }
+            auto& lhs_connections = lhs_connections_list[layer_idx];
+            lhs_connections.resize(lhs_connectivity * size);
+            for(auto k = 0u; k < lhs_connections.size(); k++) {
+                lhs_connections[k] = infile.read_unsigned();
             }
-            vector<complex_std> lhs_weights_array(lhs_connectivity * size);
-            vector<complex_std> biases_array(size);
-
-            const auto rhs_connections_and_weights = this->compile_rhs_connections_and_weights(
-                layer_idx > 0 ? layer_sizes[layer_idx - 1] : this->N,
-                size,
-                lhs_connectivity,
-                lhs_connections_array,
-                lhs_weights_array
-            );
+        }
+        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
+            const auto size = layer_sizes[layer_idx];
+            const auto& lhs_connections = lhs_connections_list[layer_idx];
 
-            this->layers.push_front({
-                size,
-                lhs_connectivity,
-                move(lhs_connections_array),
-                move(rhs_connections_array),
-                move(lhs_weights_array),
-                move(rhs_weights_array),
-                move(biases_array)
-            });
-
-            rhs_connections_array = move(rhs_connections_and_weights.first);
-            rhs_weights_array = move(rhs_connections_and_weights.second);
+            this->add_layer(size, lhs_connections.size() / size, lhs_connections.data());
         }
-        this->init_kernel();
+        this->init_layers();
 
         // read dynamical params
 
         vector<complex_std> dynamical_params(this->num_params);
         for(auto i = 0u; i < this->num_params; i++) {
-            dynamical_params[i] = read_complex(infile);
+            dynamical_params[i] = infile.read_complex();
         }
-        infile.close();
 
         this->set_params(dynamical_params);
     }
 
-    inline void set_params(const vector<complex_std>& new_params) {
-        auto it = new_params.begin();
+    inline void load_network_file(const string& file_name) {
+        NetworkFile file(file_name);
+        file.expect_type(NetworkType::PsiDeepMin);
 
-        for(auto layer_it = this->layers.begin(); layer_it != this->layers.end(); layer_it++) {
-            auto& layer = *layer_it;
+        this->N = file.header().N;
+        this->log_prefactor = file.header().log_prefactor;
+        this->prefactor = file.header().prefactor;
 
-            copy(it, it + layer.biases.size(), layer.biases.begin());
-            it += layer.size;
+        const auto topology = read_layer_topology(file, this->N);
+        this->num_layers = topology.size();
+        this->check_num_layers();
 
-            copy(it, it + layer.lhs_weights.size(), layer.lhs_weights.begin());
-            it += layer.lhs_weights.size();
+        for(const auto& layer : topology) {
+            this->add_layer(layer.size, layer.lhs_connectivity, layer.lhs_connections);
+        }
+        this->init_layers();
 
-            if(layer_it != this->layers.begin()) {
-                prev(layer_it)->rhs_weights = this->compile_rhs_connections_and_weights(
-                    prev(layer_it)->size,
-                    layer.size,
-                    layer.lhs_connectivity,
-                    layer.lhs_connections,
-                    layer.lhs_weights
-                ).second;
-            }
+        if(file.num_params() != this->num_params) {
+            throw runtime_error(
+                "'" + file_name + "' holds " + to_string(file.num_params()) +
+                " parameters, but the network has " + to_string(this->num_params)
+            );
         }
 
+        // the parameters are used in-place, as long as they aren't modified.
+        this->mapping = file.mapping;
+        this->params = file.params();
+
         this->update_kernel();
+        this->update_rhs_weights();
     }
 
-    inline void init_kernel() {
-        this->num_params = 0u;
-        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
-            const auto& layer = *next(this->layers.begin(), layer_idx);
-            auto& kernel_layer = kernel::PsiDeepMin::layers[layer_idx];
-            kernel_layer.size = layer.size;
-            kernel_layer.lhs_connectivity = layer.lhs_connectivity;
+    inline void check_num_layers() const {
+        if(this->num_layers == 0u || this->num_layers > kernel::PsiDeepMin::max_layers) {
+            throw runtime_error(
+                "PsiDeepMin supports between 1 and " + to_string(kernel::PsiDeepMin::max_layers) +
+                " layers, got " + to_string(this->num_layers)
+            );
+        }
+    }
 
-            kernel_layer.begin_params = this->num_params;
+    inline void add_layer(const unsigned int size, const unsigned int lhs_connectivity, const unsigned int* lhs_connections) {
+        const auto prev_size = this->layers.empty() ? this->N : this->layers.back().size;
+
+        vector<unsigned int> lhs_connections_array(lhs_connections, lhs_connections + lhs_connectivity * size);
+        auto rhs_positions = this->compile_rhs_positions(prev_size, size, lhs_connectivity, lhs_connections_array);
+
+        this->layers.push_back({
+            size,
+            lhs_connectivity,
+            0u,
+            move(lhs_connections_array),
+            vector<unsigned int>(),
+            vector<complex_std>(),
+            move(rhs_positions)
+        });
+    }
 
-            this->num_params += layer.size + layer.lhs_weights.size();
-        }
-        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
-            auto& layer = kernel::PsiDeepMin::layers[layer_idx];
-            auto next_layer = kernel::PsiDeepMin::layers + layer_idx + 1;
+    inline void init_layers() {
+        // the rhs-connections of a layer follow from the lhs-connections of the next one.
+        for(auto layer_idx = 0u; layer_idx + 1u < this->num_layers; layer_idx++) {
+            auto& layer = this->layers[layer_idx];
+            const auto& next_layer = this->layers[layer_idx + 1u];
 
-            layer.rhs_connectivity = (
-                layer_idx + 1 < this->num_layers ?
-                next_layer->size * next_layer->lhs_connectivity / layer.size :
-                0u
-            );
+            layer.rhs_connections.resize(next_layer.lhs_connections.size());
+            for(auto k = 0u; k < next_layer.lhs_connections.size(); k++) {
+                layer.rhs_connections[next_layer.rhs_positions[k]] = k % next_layer.size;
+            }
+            layer.rhs_weights.resize(next_layer.lhs_connections.size());
         }
-        this->update_kernel();
+
+        this->init_kernel();
     }
 
-    inline void update_kernel() {
-        for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
-            Layer& layer = *next(this->layers.begin(), layer_idx);
-            auto& kernel_layer = kernel::PsiDeepMin::layers[layer_idx];
+    inline void update_rhs_weights() {
+        // The topology is fixed, hence the rhs-weights are scattered in-place into the existing buffers.
+        for(auto layer_idx = 1u; layer_idx < this->num_layers; layer_idx++) {
+            const auto& layer = this->layers[layer_idx];
+            const auto lhs_weights = this->params + layer.begin_params + layer.size;
+            auto& rhs_weights = this->layers[layer_idx - 1u].rhs_weights;
 
-            kernel_layer.lhs_connections = layer.lhs_connections.data();
-            kernel_layer.rhs_connections = layer.rhs_connections.data();
-            kernel_layer.lhs_weights = layer.lhs_weights.data();
-            kernel_layer.rhs_weights = layer.rhs_weights.data();
-            kernel_layer.biases = layer.biases.data();
+            for(auto k = 0u; k < layer.lhs_connections.size(); k++) {
+                rhs_weights[layer.rhs_positions[k]] = lhs_weights[k];
+            }
         }
     }
 
-private:
-    inline pair<vector<unsigned int>, vector<complex_std>> compile_rhs_connections_and_weights(
+    inline vector<unsigned int> compile_rhs_positions(
         const unsigned int prev_size,
         const unsigned int size,
         const unsigned int lhs_connectivity,
-        const vector<unsigned int>& lhs_connections,
-        const vector<complex_std>& lhs_weights
-    ) {
+        const vector<unsigned int>& lhs_connections
+    ) const {
+        // position of each lhs-weight (i, j) within the rhs-weights of the previous layer.
         const auto rhs_connectivity = size * lhs_connectivity / prev_size;
 
-        vector<unsigned int> rhs_connections(prev_size * rhs_connectivity);
-        vector<complex_std> rhs_weights(prev_size * rhs_connectivity);
+        vector<unsigned int> result(lhs_connectivity * size);
 
         vector<unsigned int> lhs_num_connections;
         lhs_num_connections.assign(prev_size, 0u);
@@ -319,17 +566,20 @@ private:
             for(auto i = 0u; i < lhs_connectivity; i++) {
                 const auto lhs_idx = lhs_connections[i * size + j];
 
-                rhs_connections[lhs_idx * rhs_connectivity + lhs_num_connections[lhs_idx]] = j;
-                rhs_weights[lhs_idx * rhs_connectivity + lhs_num_connections[lhs_idx]] = lhs_weights[
-                    i * size + j
-                ];
+                result[i * size + j] = lhs_idx * rhs_connectivity + lhs_num_connections[lhs_idx];
                 lhs_num_connections[lhs_idx]++;
             }
         }
 
-        return {move(rhs_connections), move(rhs_weights)};
+        return result;
     }
 };
 
 
+// Converts a network from the text format of 'psi_<index>_compressed.txt' into a network file.
+inline void convert_to_network_file(const string& text_file_name, const string& network_file_name) {
+    PsiDeepMin(text_file_name).save(network_file_name);
+}
+
+
 } // namespace rbm_on_gpu
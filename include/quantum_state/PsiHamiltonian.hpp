@@ -24,15 +24,33 @@
 
 namespace rbm_on_gpu {
 
+// Carries the diagonal energy along a Markov chain, which is updated on every flip in O(degree).
+// The updates accumulate rounding errors, hence the energy is recomputed from scratch every 'num_flips_per_refresh'
+// flips, see PsiHamiltonian::flip_spin_of_jth_angle().
 struct PsiHamiltonianAngles {
+    complex_t       energy;
+    unsigned int    num_flips;  // since the last recomputation
+
     PsiHamiltonianAngles() = default;
 
     template<typename Psi_t>
     HDINLINE void init(const Psi_t& psi, const PsiHamiltonianAngles& other) {
+        #include "cuda_kernel_defines.h"
+
+        SINGLE {
+            this->energy = other.energy;
+            this->num_flips = other.num_flips;
+        }
     }
 
     template<typename Psi_t>
     HDINLINE void init(const Psi_t& psi, const Spins& spins) {
+        #include "cuda_kernel_defines.h"
+
+        psi.hamiltonian.diagonal_energy(this->energy, spins);
+        SINGLE {
+            this->num_flips = 0u;
+        }
     }
 
 };
@@ -44,6 +62,7 @@ public:
     unsigned int N;
 
     static constexpr unsigned int  max_N = MAX_SPINS;
+    static constexpr unsigned int  num_flips_per_refresh = 256u;
 
     Operator hamiltonian;
 
@@ -76,16 +95,29 @@ public:
 
     HDINLINE
     void log_psi_s_real(double& result, const Spins& spins, const Angles& angles) const {
+        #include "cuda_kernel_defines.h"
         // CAUTION: 'result' has to be a shared variable.
         // j = threadIdx.x
 
-        result = this->log_psi_s(spins).real();
+        SYNC;
+        SINGLE {
+            result = angles.energy.real();
+        }
+        SYNC;
     }
 
     HDINLINE void flip_spin_of_jth_angle(
         const unsigned int j, const unsigned int position, const Spins& new_spins, Angles& angles
     ) const {
-
+        if(j == 0u) {
+            if(++angles.num_flips < num_flips_per_refresh) {
+                angles.energy += this->hamiltonian.diagonal_energy_difference(new_spins, position);
+            }
+            else {
+                angles.energy = this->hamiltonian.diagonal_energy(new_spins);
+                angles.num_flips = 0u;
+            }
+        }
     }
 
     HDINLINE
@@ -112,7 +144,8 @@ public:
 
     HDINLINE
     unsigned int get_num_angles() const {
-        return 0u;
+        // a single 'angle' holding the energy
+        return 1u;
     }
 
     HDINLINE
@@ -141,6 +174,10 @@ public:
         this->hamiltonian = hamiltonian;
     }
 
+    // Carries the diagonal energy along the flips at 'positions' starting from 'spins', as a Markov chain does.
+    // Returns the carried energy after each flip.
+    vector<complex<double>> carried_energies(const Spins& spins, const vector<unsigned int>& positions) const;
+
 };
 
 } // namespace rbm_on_gpu
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "Array.hpp"
+#include "Spins.h"
+#include "types.h"
+#ifdef __CUDACC__
+    #include "utils.kernel"
+#endif
+#include "cuda_complex.hpp"
+
+#include <vector>
+#include <complex>
+#include <memory>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __PYTHONCC__
+    #define FORCE_IMPORT_ARRAY
+    #include "xtensor-python/pytensor.hpp"
+
+    using namespace std::complex_literals;
+#endif // __PYTHONCC__
+
+
+namespace rbm_on_gpu {
+
+// Cache of the local fields h_i = sum_j J_ij s_j. Flipping a spin updates each field by a single term.
+struct PsiJastrowAngles {
+    complex_t fields[MAX_SPINS];
+
+    PsiJastrowAngles() = default;
+
+    template<typename Psi_t>
+    HDINLINE void init(const Psi_t& psi, const PsiJastrowAngles& other) {
+        #include "cuda_kernel_defines.h"
+
+        MULTI(i, psi.get_num_spins())
+        {
+            this->fields[i] = other[i];
+        }
+    }
+
+    template<typename Psi_t>
+    HDINLINE void init(const Psi_t& psi, const Spins& spins) {
+        #include "cuda_kernel_defines.h"
+
+        MULTI(i, psi.get_num_spins())
+        {
+            this->fields[i] = psi.field(i, spins);
+        }
+    }
+
+    HDINLINE complex_t& operator[](const unsigned int i) {
+        return this->fields[i];
+    }
+
+    HDINLINE const complex_t& operator[](const unsigned int i) const {
+        return this->fields[i];
+    }
+};
+
+namespace kernel {
+
+// Two-body Jastrow factor: log(psi(s)) = sum_{i<j} J_ij s_i s_j.
+// It is cheap compared to a network and is meant to be multiplied with one, see ProductPsi.
+class PsiJastrow {
+public:
+    unsigned int N;
+
+    static constexpr unsigned int  max_N = MAX_SPINS;
+
+    // one parameter per pair i < j, in row-major order of the upper triangle
+    unsigned int   num_params;
+    double         prefactor;
+
+    // symmetric N x N matrix of the parameters with zero diagonal
+    complex_t* J;
+
+    using Angles = rbm_on_gpu::PsiJastrowAngles;
+
+public:
+
+    HDINLINE
+    static unsigned int pair_index(const unsigned int i, const unsigned int j, const unsigned int N) {
+        // i < j
+        return i * N - i * (i + 1u) / 2u + j - i - 1u;
+    }
+
+    HDINLINE
+    complex_t field(const unsigned int i, const Spins& spins) const {
+        complex_t result(0.0, 0.0);
+
+        const auto J_i = &(this->J[i * this->N]);
+        for(auto j = 0u; j < this->N; j++) {
+            result += J_i[j] * spins[j];
+        }
+
+        return result;
+    }
+
+    HDINLINE
+    complex_t log_psi_s(const Spins& spins) const {
+        complex_t result(0.0, 0.0);
+        for(auto i = 0u; i < this->N; i++) {
+            result += 0.5 * spins[i] * this->field(i, spins);
+        }
+
+        return result;
+    }
+
+#ifdef __CUDACC__
+
+    HDINLINE
+    void log_psi_s(complex_t& result, const Spins& spins, const Angles& angles) const {
+        // CAUTION: 'result' has to be a shared variable.
+        // i = threadIdx.x
+
+        #ifdef __CUDA_ARCH__
+
+        auto summand = complex_t(
+            (threadIdx.x < this->N ? 0.5 * spins[threadIdx.x] * angles[threadIdx.x] : complex_t(0.0, 0.0))
+        );
+
+        tree_sum(result, this->N, summand);
+
+        #else
+
+        result = complex_t(0.0, 0.0);
+        for(auto i = 0u; i < this->N; i++) {
+            result += 0.5 * spins[i] * angles[i];
+        }
+
+        #endif
+    }
+
+    HDINLINE
+    void log_psi_s_real(double& result, const Spins& spins, const Angles& angles) const {
+        // CAUTION: 'result' has to be a shared variable.
+        // i = threadIdx.x
+
+        #ifdef __CUDA_ARCH__
+
+        auto summand = double(
+            (threadIdx.x < this->N ? 0.5 * spins[threadIdx.x] * angles[threadIdx.x].real() : 0.0)
+        );
+
+        tree_sum(result, this->N, summand);
+
+        #else
+
+        result = 0.0;
+        for(auto i = 0u; i < this->N; i++) {
+            result += 0.5 * spins[i] * angles[i].real();
+        }
+
+        #endif
+    }
+
+    HDINLINE void flip_spin_of_jth_angle(
+        const unsigned int j, const unsigned int position, const Spins& new_spins, Angles& angles
+    ) const {
+        if(j < this->get_num_angles()) {
+            angles[j] += 2.0 * new_spins[position] * this->J[position * this->N + j];
+        }
+    }
+
+    HDINLINE
+    complex_t psi_s(const Spins& spins, const Angles& angles) const {
+        #include "cuda_kernel_defines.h"
+
+        SHARED complex_t log_psi;
+        this->log_psi_s(log_psi, spins, angles);
+
+        return exp(log(this->prefactor) + log_psi);
+    }
+
+    template<typename Function>
+    HDINLINE
+    void foreach_O_k(const Spins& spins, const Angles& angles, Function function) const {
+        #include "cuda_kernel_defines.h"
+
+        LOOP(i, this->N) {
+            for(auto j = i + 1u; j < this->N; j++) {
+                function(pair_index(i, j, this->N), complex_t(spins[i] * spins[j], 0.0));
+            }
+        }
+    }
+
+    PsiJastrow get_kernel() const {
+        return *this;
+    }
+
+#endif // __CUDACC__
+
+    HDINLINE
+    double probability_s(const double log_psi_s_real) const {
+        return exp(2.0 * (log(this->prefactor) + log_psi_s_real));
+    }
+
+    HDINLINE
+    unsigned int get_num_spins() const {
+        return this->N;
+    }
+
+    HDINLINE
+    unsigned int get_num_angles() const {
+        return this->N;
+    }
+
+    HDINLINE
+    unsigned int get_width() const {
+        return this->N;
+    }
+
+    HDINLINE
+    static constexpr unsigned int get_max_spins() {
+        return max_N;
+    }
+
+    HDINLINE
+    unsigned int get_num_params() const {
+        return this->num_params;
+    }
+};
+
+} // namespace kernel
+
+
+class PsiJastrow : public kernel::PsiJastrow {
+public:
+    Array<complex_t> params;
+    // dense symmetric copy of 'params', which is what the kernel reads
+    Array<complex_t> J_array;
+
+    bool gpu;
+
+public:
+    PsiJastrow(const unsigned int N, const bool gpu);
+    PsiJastrow(const PsiJastrow& other);
+
+    PsiJastrow& operator=(const PsiJastrow& other) = delete;
+
+#ifdef __PYTHONCC__
+    inline PsiJastrow(const xt::pytensor<std::complex<double>, 1u>& params, const unsigned int N, const bool gpu)
+        : PsiJastrow(N, gpu) {
+        if(params.size() != this->num_params) {
+            throw invalid_argument("a Jastrow factor of N spins has N * (N - 1) / 2 parameters");
+        }
+
+        this->set_params(params.data());
+    }
+
+    PsiJastrow copy() const {
+        return *this;
+    }
+
+#endif // __PYTHONCC__
+
+    void get_params(complex<double>* result) const;
+    void set_params(const complex<double>* new_params);
+    void update_params();
+
+    void update_kernel();
+};
+
+} // namespace rbm_on_gpu
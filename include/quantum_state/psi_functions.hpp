@@ -3,10 +3,115 @@
 #include "types.h"
 
 
+// Accuracy tier of the activation function log(cosh(z)) and its derivative tanh(z):
+//  - rational:  hand-fitted rational function (default). Its asymptotic slope is 0.9 rather than 1,
+//               hence it deviates from log(cosh(z)) by up to 0.3 for large |Re(z)|.
+//  - low_order: rational approximation of lower order, cheaper, e.g. for sampling
+//  - exact:     log(cosh(z)) itself, for validation
+// The tiers are different functions of the angles, so a network has to be evaluated with the tier it was trained with.
+#ifndef ACTIVATION_TIER
+#define ACTIVATION_TIER rational
+#endif
+
+
 namespace rbm_on_gpu {
 
 constexpr auto b = 0.0;
 
+enum class ActivationTier { rational, low_order, exact };
+
+
+// All tiers are written branch-free: the sign of the real part enters as a factor
+// which is computed without a conditional jump. log(cosh(z)) is even, hence the
+// approximations are fitted for Re(z) > 0 and evaluated at sign * z.
+
+HDINLINE double activation_sign(const complex_t z) {
+    return 1.0 - 2.0 * double(z.real() <= 0.0);
+}
+
+// Complex division without the rescaling and the inf/nan handling of the generic one, which dominate
+// the cost of the approximations below. Their denominators have no zeros for Re(sign * z) >= 0.
+HDINLINE complex_t fast_divide(const complex_t a, const complex_t b) {
+    const auto inv_norm = 1.0 / (b.real() * b.real() + b.imag() * b.imag());
+
+    return complex_t(
+        (a.real() * b.real() + a.imag() * b.imag()) * inv_norm,
+        (a.imag() * b.real() - a.real() * b.imag()) * inv_norm
+    );
+}
+
+template<ActivationTier tier>
+HDINLINE complex_t logcosh(const complex_t z);
+
+template<ActivationTier tier>
+HDINLINE complex_t logcosh_derivative(const complex_t z);
+
+
+template<>
+HDINLINE complex_t logcosh<ActivationTier::rational>(const complex_t z) {
+    const auto sign = activation_sign(z);
+
+    return sign * 0.9003320053750442 * z + fast_divide(
+        5.49914721954 - sign * 2.16564366435 * z,
+        9.19376335670885 + z * (sign * 10.2180213465 + z * (7.771429504240965 + z * (sign * 3.746646023906276 + z)))
+    ) - 0.598139;
+}
+
+template<>
+HDINLINE complex_t logcosh_derivative<ActivationTier::rational>(const complex_t z) {
+    const auto sign = activation_sign(z);
+
+    const auto denominator = 9.19376335670885 + z * (sign * 10.218021346543315 + z * (7.771429504240965 + z * (sign * 3.746646023906276 + z)));
+    return fast_divide(
+        z * (
+            83.68563506532087 + z * (
+                sign * 177.6769746361748 + z * (
+                    199.24474920889975 + z * (
+                        sign * 146.36284300074402 + z * (
+                            70.82878897882324 + z * (
+                                sign * 26.632014683761202 + z * (
+                                    6.746450656267947 + sign * 0.9003320053750442 * z
+        ))))))),
+        denominator * denominator
+    );
+}
+
+
+template<>
+HDINLINE complex_t logcosh<ActivationTier::low_order>(const complex_t z) {
+    const auto sign = activation_sign(z);
+
+    return sign * z + fast_divide(1.81168 - sign * 1.22741 * z, 2.61371 + z * (sign * 2.0 + z)) - 0.693147;
+}
+
+template<>
+HDINLINE complex_t logcosh_derivative<ActivationTier::low_order>(const complex_t z) {
+    const auto sign = activation_sign(z);
+
+    const auto denominator = 2.61371 + z * (sign * 2.0 + z);
+    return fast_divide(
+        z * (6.83146 + z * (sign * 10.4548 + z * (4.0 + sign * z))),
+        denominator * denominator
+    );
+}
+
+
+template<>
+HDINLINE complex_t logcosh<ActivationTier::exact>(const complex_t z) {
+    // log(cosh(z)) = sign * z + log(1 + exp(-2 sign * z)) - log(2), which does not overflow for large |Re(z)|.
+    const auto sign = activation_sign(z);
+
+    return sign * z + log(1.0 + exp(-2.0 * sign * z)) - 0.6931471805599453;
+}
+
+template<>
+HDINLINE complex_t logcosh_derivative<ActivationTier::exact>(const complex_t z) {
+    const auto sign = activation_sign(z);
+    const auto e = exp(-2.0 * sign * z);
+
+    return sign * (1.0 - e) / (1.0 + e);
+}
+
 HDINLINE
 complex_t my_logcosh(const complex_t z) {
     // const auto r = abs(z);
@@ -45,15 +150,7 @@ complex_t my_logcosh(const complex_t z) {
 
     // return log((exp(z) - 1.0) / z);
 
-    const auto sign = z.real() > 0.0 ? 1.0 : -1.0;
-
-    // return sign * z + (1.81168 - sign * 1.22741 * z) / (2.61371 + z * (sign * 2.0 + z)) - 0.693147;
-
-    return sign * 0.9003320053750442 * z + (
-        5.49914721954 - sign * 2.16564366435 * z
-    ) / (
-        9.19376335670885 + z * (sign * 10.2180213465 + z * (7.771429504240965 + z * (sign * 3.746646023906276 + z)))
-    ) - 0.598139;
+    return logcosh<ActivationTier::ACTIVATION_TIER>(z);
 }
 
 HDINLINE
@@ -93,24 +190,25 @@ complex_t my_tanh(const complex_t z) {
     // const auto exp_z = exp(z);
     // return -1.0 / z + exp_z / (exp_z - 1.0);
 
-    const auto sign = z.real() > 0.0 ? 1.0 : -1.0;
-    // const auto denominator = 2.61371 + z * (sign * 2.0 + z);
-    // return (
-    //     z * (6.83146 + z * (sign * 10.4548 + z * (4.0 + sign * z)))
-    // ) / (denominator * denominator);
+    return logcosh_derivative<ActivationTier::ACTIVATION_TIER>(z);
+}
 
-    const auto denominator = 9.19376335670885 + z * (sign * 10.218021346543315 + z * (7.771429504240965 + z * (sign * 3.746646023906276 + z)));
-    return (
-        z * (
-            83.68563506532087 + z * (
-                sign * 177.6769746361748 + z * (
-                    199.24474920889975 + z * (
-                        sign * 146.36284300074402 + z * (
-                            70.82878897882324 + z * (
-                                sign * 26.632014683761202 + z * (
-                                    6.746450656267947 + sign * 0.9003320053750442 * z
-        )))))))
-    ) / (denominator * denominator);
+
+// Batched versions for host code evaluating many angles at once, e.g. over all samples
+// of an exact summation. They are free of branches and hence auto-vectorized by the compiler.
+
+template<ActivationTier tier = ActivationTier::ACTIVATION_TIER>
+inline void logcosh_batch(complex_t* __restrict__ result, const complex_t* __restrict__ z, const unsigned int n) {
+    for(auto i = 0u; i < n; i++) {
+        result[i] = logcosh<tier>(z[i]);
+    }
+}
+
+template<ActivationTier tier = ActivationTier::ACTIVATION_TIER>
+inline void logcosh_derivative_batch(complex_t* __restrict__ result, const complex_t* __restrict__ z, const unsigned int n) {
+    for(auto i = 0u; i < n; i++) {
+        result[i] = logcosh_derivative<tier>(z[i]);
+    }
 }
 
 
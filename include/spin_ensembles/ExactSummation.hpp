@@ -116,14 +116,17 @@ public:
     void set_total_z_symmetry(const int sector);
 
 #ifdef __CUDACC__
+    // 'shared_memory_size' bytes of dynamic_shared_memory() are available to 'function'.
     template<typename Psi_t, typename Function>
-    inline void foreach(const Psi_t& psi, const Function& function, const int blockDim=-1) const {
+    inline void foreach(
+        const Psi_t& psi, const Function& function, const int blockDim=-1, const unsigned int shared_memory_size=0u
+    ) const {
         auto this_kernel = this->get_kernel();
         const auto psi_kernel = psi.get_kernel();
         if(psi.gpu) {
             const auto blockDim_ = blockDim == -1 ? psi.get_width() : blockDim;
 
-            cuda_kernel<<<this->num_spin_configurations, blockDim_>>>(
+            cuda_kernel<<<this->num_spin_configurations, blockDim_, shared_memory_size>>>(
                 [=] __device__ () {this_kernel.kernel_foreach(psi_kernel, function);}
             );
         }
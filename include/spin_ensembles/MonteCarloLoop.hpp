@@ -313,8 +313,11 @@ public:
     }
 
 #ifdef __CUDACC__
+    // 'shared_memory_size' bytes of dynamic_shared_memory() are available to 'function'.
     template<typename Psi_t, typename Function>
-    inline void foreach(const Psi_t& psi, const Function& function, const int blockDim=-1) const {
+    inline void foreach(
+        const Psi_t& psi, const Function& function, const int blockDim=-1, const unsigned int shared_memory_size=0u
+    ) const {
         auto this_kernel = this->get_kernel();
         auto psi_kernel = psi.get_kernel();
 
@@ -326,12 +329,12 @@ public:
             const auto blockDim_ = blockDim == -1 ? psi.get_width() : blockDim;
 
             if(this->has_total_z_symmetry) {
-                cuda_kernel<<<this->num_markov_chains, blockDim_>>>(
+                cuda_kernel<<<this->num_markov_chains, blockDim_, shared_memory_size>>>(
                     [=] __device__ () {this_kernel.kernel_foreach<true>(psi_kernel, function);}
                 );
             }
             else {
-                cuda_kernel<<<this->num_markov_chains, blockDim_>>>(
+                cuda_kernel<<<this->num_markov_chains, blockDim_, shared_memory_size>>>(
                     [=] __device__ () {this_kernel.kernel_foreach<false>(psi_kernel, function);}
                 );
             }
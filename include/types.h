@@ -77,6 +77,27 @@ void generic_atomicAdd(T* address, const T& value) {
 
 constexpr auto MAX_HIDDEN_SPINS = 2 * MAX_SPINS;
 
+// Shared memory of a block without opting in to more, static and dynamic shared memory together.
+// 'MAX_DYNAMIC_SHARED_MEMORY' of it is left to buffers sized at runtime, see OperatorProduct.
+constexpr auto MAX_SHARED_MEMORY = 48u * 1024u;
+constexpr auto MAX_DYNAMIC_SHARED_MEMORY = 8u * 1024u;
+
+#ifdef __CUDACC__
+
+// Shared memory sized at the launch of a kernel by the 'shared_memory_size' argument of the ensembles' foreach().
+// The host runs the blocks one after another, hence each host thread owns a buffer of the maximal size.
+HDINLINE void* dynamic_shared_memory() {
+    #ifdef __CUDA_ARCH__
+    extern __shared__ __align__(16) unsigned char buffer[];
+    #else
+    alignas(16) static thread_local unsigned char buffer[MAX_DYNAMIC_SHARED_MEMORY];
+    #endif
+
+    return buffer;
+}
+
+#endif // __CUDACC__
+
 /**
  * Print a cuda error message including file/line info to stderr
  */
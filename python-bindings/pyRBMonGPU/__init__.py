@@ -1,5 +1,11 @@
 from ._pyRBMonGPU import (
     Operator,
+    CompressionReport,
+    MeasurementPlan,
+    OperatorProduct,
+    SpinBasis,
+    GroundState,
+    ground_state,
     Spins,
     MonteCarloLoop,
     ExactSummation,
@@ -9,11 +15,17 @@ from ._pyRBMonGPU import (
     get_O_k_vector,
     psi_angles,
     activation_function,
+    convert_to_network_file,
+    convert_classical_to_network_files,
+    log_psi_table,
     setDevice,
     start_profiling,
     stop_profiling,
     PsiClassical,
     PsiDeepMin,
+    PsiJastrow,
+    PsiWithJastrow,
+    PsiDeepWithJastrow,
     PsiHamiltonian
 )
 
@@ -4,7 +4,14 @@
 #include "quantum_state/PsiDeep.hpp"
 #include "quantum_state/PsiDeepMin.hpp"
 #include "quantum_state/PsiHamiltonian.hpp"
+#include "quantum_state/PsiJastrow.hpp"
+#include "quantum_state/ProductPsi.hpp"
 #include "operator/Operator.hpp"
+#include "operator/MeasurementPlan.hpp"
+#include "operator/OperatorProduct.hpp"
+#include "operator/SpinBasis.hpp"
+#include "operator/SparseMatrix.hpp"
+#include "operator/Lanczos.hpp"
 #include "spin_ensembles/ExactSummation.hpp"
 #include "spin_ensembles/MonteCarloLoop.hpp"
 #include "network_functions/ExpectationValue.hpp"
@@ -12,10 +19,12 @@
 #include "network_functions/PsiOkVector.hpp"
 #include "network_functions/PsiAngles.hpp"
 #include "network_functions/S_matrix.hpp"
+#include "network_functions/LogPsiTable.hpp"
 
 #include <pybind11/pybind11.h>
 #include <pybind11/operators.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 
 #define FORCE_IMPORT_ARRAY
 #include "xtensor/xadapt.hpp"
@@ -36,6 +45,41 @@ using complex_tensor = xt::pytensor<std::complex<double>, dim>;
 template<unsigned int dim>
 using real_tensor = xt::pytensor<double, dim>;
 
+// Writable numpy array sharing the contiguous parameter store of a network.
+// After writing to the array in-place, the network has to be synced by assigning to `params` or by `update_params()`.
+// As long as the array is alive, copies of the network get their own parameters instead of sharing them.
+// Its base keeps the network alive and releases the pin once the array and all views onto it are gone.
+template<typename Psi_t>
+py::array_t<std::complex<double>> params_view(py::object psi_object) {
+    auto& params = psi_object.cast<Psi_t&>().pin_params();
+
+    const py::capsule base(new py::object(psi_object), [](void* pointer) {
+        const auto psi_object = reinterpret_cast<py::object*>(pointer);
+        psi_object->cast<Psi_t&>().unpin_params();
+        delete psi_object;
+    });
+
+    return py::array_t<std::complex<double>>(
+        {(long int)params.size()},
+        {(long int)sizeof(complex_t)},
+        reinterpret_cast<std::complex<double>*>(params.host_data()),
+        base
+    );
+}
+
+// Numpy array taking over the buffer of 'vector' without copying it.
+template<typename T>
+py::array_t<T> numpy_array(vector<T>&& buffer) {
+    auto owner = new std::vector<T>(move(buffer));
+
+    return py::array_t<T>(
+        {(long int)owner->size()},
+        {(long int)sizeof(T)},
+        owner->data(),
+        py::capsule(owner, [](void* pointer) {delete reinterpret_cast<std::vector<T>*>(pointer);})
+    );
+}
+
 // Python Module and Docstrings
 
 PYBIND11_MODULE(_pyRBMonGPU, m)
@@ -53,6 +97,10 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
             const bool
         >())
         .def("copy", &Psi::copy)
+        .def("save", &Psi::save)
+        .def_static("load", [](const string& file_name, const bool gpu) {
+            return Psi(NetworkFile(file_name), gpu);
+        })
         .def_property_readonly("_vector", &Psi::as_vector_py)
         .def("norm", &Psi::norm_function)
         .def("O_k_vector", &Psi::O_k_vector_py)
@@ -62,26 +110,53 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         .def_readonly("M", &Psi::M)
         .def_property(
             "alpha",
-            [](const Psi& psi){return psi.alpha_array.to_pytensor<1u>();},
-            [](Psi& psi, const real_tensor<1u>& input) {psi.alpha_array = input;}
+            [](const Psi& psi){return psi.alpha_array.to_pytensor();},
+            [](Psi& psi, const real_tensor<1u>& input) {
+                psi.make_params_unique();
+                for(auto i = 0u; i < psi.N; i++) {
+                    (*psi.params)[i] = complex_t(input[i], 0.0);
+                }
+                psi.update_params();
+            }
         )
         .def_property(
             "beta",
-            [](const Psi& psi){return psi.beta_array.to_pytensor<1u>();},
-            [](Psi& psi, const real_tensor<1u>& input) {psi.beta_array = input;}
+            [](const Psi& psi){return psi.beta_array.to_pytensor();},
+            [](Psi& psi, const real_tensor<1u>& input) {
+                psi.make_params_unique();
+                for(auto i = 0u; i < psi.N; i++) {
+                    (*psi.params)[psi.N + i] = complex_t(input[i], 0.0);
+                }
+                psi.update_params();
+            }
         )
         .def_property(
             "b",
             [](const Psi& psi){return psi.b_array.to_pytensor<1u>();},
-            [](Psi& psi, const complex_tensor<1u>& input) {psi.b_array = input; psi.update_kernel();}
+            [](Psi& psi, const complex_tensor<1u>& input) {
+                psi.make_params_unique();
+                memcpy(psi.b_array.data(), input.data(), sizeof(complex_t) * psi.b_array.size());
+                psi.update_params();
+            }
         )
         .def_property(
             "W",
             [](const Psi& psi){return psi.W_array.to_pytensor<2u>(shape_t<2u>{psi.N, psi.M});},
-            [](Psi& psi, const complex_tensor<2u>& input) {psi.W_array = input; psi.update_kernel();}
+            [](Psi& psi, const complex_tensor<2u>& input) {
+                psi.make_params_unique();
+                memcpy(psi.W_array.data(), input.data(), sizeof(complex_t) * psi.W_array.size());
+                psi.update_params();
+            }
         )
         .def_readonly("num_params", &Psi::num_params)
-        .def_property("params", &Psi::get_params_py, &Psi::set_params_py)
+        .def_property(
+            "params",
+            [](const Psi& psi) {return psi.params->to_pytensor<1u>();},
+            [](Psi& psi, const complex_tensor<1u>& new_params) {psi.set_params(new_params.data());}
+        )
+        .def("params_view", &params_view<Psi>)
+        .def("shares_params_with", [](const Psi& psi, const Psi& other) {return psi.params.shares_payload_with(other.params);})
+        .def("update_params", &Psi::update_params)
         .def_property_readonly("free_quantum_axis", [](const Psi& psi) {return psi.free_quantum_axis;})
         .def_property_readonly("num_angles", &Psi::get_num_angles);
 
@@ -97,6 +172,10 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
             const bool
         >())
         .def("copy", &PsiDeep::copy)
+        .def("save", &PsiDeep::save)
+        .def_static("load", [](const string& file_name, const bool gpu) {
+            return PsiDeep(NetworkFile(file_name), gpu);
+        })
         .def_readwrite("prefactor", &PsiDeep::prefactor)
         .def_readwrite("N_i", &PsiDeep::N_i)
         .def_readwrite("N_j", &PsiDeep::N_j)
@@ -106,30 +185,92 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         .def_property(
             "params",
             [](const PsiDeep& psi) {return psi.get_params().to_pytensor<1u>();},
-            [](PsiDeep& psi, const complex_tensor<1u>& new_params) {psi.set_params(Array<complex_t>(new_params, false));}
+            [](PsiDeep& psi, const complex_tensor<1u>& new_params) {
+                psi.set_params(reinterpret_cast<const complex_t*>(new_params.data()));
+            }
         )
-        .def_property_readonly("alpha", [](const PsiDeep& psi) {return psi.alpha_array.to_pytensor<1u>();})
-        .def_property_readonly("beta", [](const PsiDeep& psi) {return psi.beta_array.to_pytensor<1u>();})
+        .def("params_view", &params_view<PsiDeep>)
+        .def("shares_params_with", [](const PsiDeep& psi, const PsiDeep& other) {
+            return psi.weights.shares_payload_with(other.weights);
+        })
+        .def("update_params", &PsiDeep::update_params)
+        .def_property_readonly("alpha", [](const PsiDeep& psi) {return psi.alpha_array.to_pytensor();})
+        .def_property_readonly("beta", [](const PsiDeep& psi) {return psi.beta_array.to_pytensor();})
         .def_property_readonly("b", &PsiDeep::get_b)
         .def_property_readonly("connections", &PsiDeep::get_connections)
         .def_property_readonly("W", &PsiDeep::get_W)
         .def_property_readonly("_vector", [](const PsiDeep& psi) {return psi.as_vector().to_pytensor<1u>();})
         .def_property_readonly("free_quantum_axis", [](const PsiDeep& psi) {return psi.free_quantum_axis;})
         .def("norm", &PsiDeep::norm)
-        .def("O_k_vector", &PsiDeep::O_k_vector_py);
+        .def("O_k_vector", &PsiDeep::O_k_vector_py)
+        .def("log_psi_s_along_flips", &PsiDeep::log_psi_s_along_flips);
+
+    py::class_<PsiJastrow>(m, "PsiJastrow")
+        .def(py::init<
+            const complex_tensor<1u>&,
+            const unsigned int,
+            const bool
+        >())
+        .def("copy", &PsiJastrow::copy)
+        .def_readwrite("prefactor", &PsiJastrow::prefactor)
+        .def_readonly("gpu", &PsiJastrow::gpu)
+        .def_readonly("N", &PsiJastrow::N)
+        .def_readonly("num_params", &PsiJastrow::num_params)
+        .def_property(
+            "params",
+            [](const PsiJastrow& psi) {return psi.params.to_pytensor<1u>();},
+            [](PsiJastrow& psi, const complex_tensor<1u>& new_params) {psi.set_params(new_params.data());}
+        )
+        .def_property_readonly("J", [](const PsiJastrow& psi) {
+            return psi.J_array.to_pytensor<2u>(shape_t<2u>{psi.N, psi.N});
+        })
+        .def_property_readonly("vector", [](const PsiJastrow& psi) {return psi_vector(psi).to_pytensor<1u>();});
+
+    py::class_<PsiWithJastrow>(m, "PsiWithJastrow")
+        .def(py::init<
+            const Psi&,
+            const PsiJastrow&
+        >())
+        .def("copy", &PsiWithJastrow::copy)
+        .def_readonly("gpu", &PsiWithJastrow::gpu)
+        .def_readonly("N", &PsiWithJastrow::N)
+        .def_readonly("num_params", &PsiWithJastrow::num_params)
+        .def_property("params", &PsiWithJastrow::get_params_py, &PsiWithJastrow::set_params_py)
+        .def("O_k_vector", &PsiWithJastrow::O_k_vector_py)
+        .def_property_readonly("first", [](const PsiWithJastrow& psi) {return psi.first_factor.copy();})
+        .def_property_readonly("second", [](const PsiWithJastrow& psi) {return psi.second_factor.copy();})
+        .def_property_readonly("vector", [](const PsiWithJastrow& psi) {return psi.as_vector().to_pytensor<1u>();})
+        .def_property_readonly("free_quantum_axis", [](const PsiWithJastrow& psi) {return psi.free_quantum_axis;});
+
+    py::class_<PsiDeepWithJastrow>(m, "PsiDeepWithJastrow")
+        .def(py::init<
+            const PsiDeep&,
+            const PsiJastrow&
+        >())
+        .def("copy", &PsiDeepWithJastrow::copy)
+        .def_readonly("gpu", &PsiDeepWithJastrow::gpu)
+        .def_readonly("N", &PsiDeepWithJastrow::N)
+        .def_readonly("num_params", &PsiDeepWithJastrow::num_params)
+        .def_property("params", &PsiDeepWithJastrow::get_params_py, &PsiDeepWithJastrow::set_params_py)
+        .def("O_k_vector", &PsiDeepWithJastrow::O_k_vector_py)
+        .def_property_readonly("first", [](const PsiDeepWithJastrow& psi) {return psi.first_factor.copy();})
+        .def_property_readonly("second", [](const PsiDeepWithJastrow& psi) {return psi.second_factor.copy();})
+        .def_property_readonly("vector", [](const PsiDeepWithJastrow& psi) {return psi.as_vector().to_pytensor<1u>();})
+        .def_property_readonly("free_quantum_axis", [](const PsiDeepWithJastrow& psi) {return psi.free_quantum_axis;});
 
     py::class_<PsiClassical>(m, "PsiClassical")
         .def(py::init<
             const string,
             const int,
             const unsigned int,
+            const bool,
+            const int
+        >(), "directory"_a, "index"_a, "N"_a, "gpu"_a, "perturbation_order"_a = 1)
+        .def(py::init<
+            const complex_tensor<1u>&,
+            const unsigned int,
             const bool
         >())
-        // .def(py::init<
-        //     const complex_tensor<1u>&,
-        //     const unsigned int,
-        //     const bool
-        // >())
         .def_readonly("gpu", &PsiClassical::gpu)
         .def_readonly("N", &PsiClassical::N)
         // .def_property(
@@ -137,9 +278,12 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         //     [](const PsiClassical& psi){return psi.W_array.to_pytensor<2u>(shape_t<2u>{psi.N, psi.M});},
         //     [](PsiClassical& psi, const complex_tensor<2u>& input) {psi.W_array = input; psi.update_kernel();}
         //
-        // .def("log_psi_s", &PsiClassical::log_psi_s)
+        .def("log_psi_s", &PsiClassical::log_psi_s_py)
+        .def("log_psi_s_batch", &PsiClassical::log_psi_s_batch_py, py::arg("configurations"), py::arg("num_threads") = 0u)
         .def_property_readonly("vector", [](const PsiClassical& psi) {return psi_vector(psi).to_pytensor<1u>();})
-        // .def("log_psi_s", &PsiClassical::log_psi_s)
+        .def("tabulate", &PsiClassical::tabulate, py::arg("num_threads") = 0u)
+        .def("clear_table", &PsiClassical::clear_table)
+        .def_property_readonly("tabulated", &PsiClassical::is_tabulated)
         .def_readonly("num_params", &PsiClassical::num_params)
         .def_property_readonly("free_quantum_axis", [](const PsiClassical& psi) {return psi.free_quantum_axis;})
         .def_property_readonly("num_angles", &PsiClassical::get_num_angles);
@@ -149,16 +293,31 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
             const string
         >())
         .def_readonly("N", &PsiDeepMin::N)
+        .def("save", &PsiDeepMin::save)
         // .def_property_readonly("vector", [](const PsiClassical& psi) {return psi_vector(psi).to_pytensor<1u>();})
-        .def("log_psi_s", &PsiDeepMin::log_psi_s);
+        .def("log_psi_s", [](const PsiDeepMin& psi, const vector<int>& spins) {
+            return psi.log_psi_s(spins);
+        })
+        .def("log_psi_s_batch", [](const PsiDeepMin& psi, const xt::pytensor<uint64_t, 1u>& configurations, const unsigned int num_threads) {
+            vector<rbm_on_gpu::Spins> spins(configurations.size());
+            for(auto n = 0u; n < spins.size(); n++) {
+                spins[n] = rbm_on_gpu::Spins(configurations[n]);
+            }
+
+            xt::pytensor<complex<double>, 1u> result(shape_t<1u>{(long int)spins.size()});
+            psi.log_psi_s_batch(result.data(), spins.data(), spins.size(), num_threads);
+            return result;
+        }, py::arg("configurations"), py::arg("num_threads") = 0u);
 
     py::class_<PsiHamiltonian>(m, "PsiHamiltonian")
         .def(py::init<
             const unsigned int,
             const Operator&
         >())
+        .def("carried_energies", &PsiHamiltonian::carried_energies)
         .def_readonly("gpu", &PsiHamiltonian::gpu)
-        .def_readonly("N", &PsiHamiltonian::N);
+        .def_readonly("N", &PsiHamiltonian::N)
+        .def_readonly_static("num_flips_per_refresh", &PsiHamiltonian::num_flips_per_refresh);
 
     py::class_<Operator>(m, "Operator")
         .def(py::init<
@@ -174,10 +333,114 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         .def_property_readonly("expr", &Operator::to_expr)
         .def_readonly("gpu", &Operator::gpu)
         .def_readonly("num_strings", &Operator::num_strings)
+        .def_readonly("num_groups", &Operator::num_groups)
+        .def_readonly("num_compiled_strings", &Operator::num_compiled_strings)
         .def_readonly("max_string_length", &Operator::max_string_length)
         .def_property_readonly("coefficients", &Operator::get_coefficients_py)
         .def_property_readonly("pauli_types", &Operator::get_pauli_types_py)
-        .def_property_readonly("pauli_indices", &Operator::get_pauli_indices_py);
+        .def_property_readonly("pauli_indices", &Operator::get_pauli_indices_py)
+        .def("compress", [](const Operator& operator_, const double tolerance) {
+            CompressionReport report;
+            auto result = operator_.compress(tolerance, report);
+
+            return make_pair(result, report);
+        }, "tolerance"_a=0.0)
+        .def("enable_jit", &Operator::enable_jit, "cache_directory"_a="")
+        .def("disable_jit", &Operator::disable_jit)
+        .def_property_readonly("jit_enabled", &Operator::jit_enabled)
+        .def("sparse_matrix", [](const Operator& operator_, const SpinBasis& basis, const unsigned int num_threads) {
+            auto matrix = sparse_matrix(operator_, basis, num_threads);
+
+            return py::module::import("scipy.sparse").attr("csr_matrix")(
+                py::make_tuple(
+                    numpy_array(move(matrix.data)), numpy_array(move(matrix.indices)), numpy_array(move(matrix.indptr))
+                ),
+                "shape"_a=py::make_tuple(matrix.dimension, matrix.dimension)
+            );
+        }, "basis"_a, "num_threads"_a=0u);
+
+    py::class_<SpinBasis>(m, "SpinBasis")
+        .def(py::init<unsigned int, int>(), "N"_a, "num_up"_a=-1)
+        .def_readonly("N", &SpinBasis::N)
+        .def_readonly("num_up", &SpinBasis::num_up)
+        .def("__len__", &SpinBasis::size)
+        .def("index", &SpinBasis::index)
+        .def("state", &SpinBasis::state)
+        .def_property_readonly("states", [](const SpinBasis& basis) {
+            vector<uint64_t> states(basis.size());
+            basis.foreach_chunk(0u, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+                auto configuration = basis.state(begin);
+                for(auto index = begin; index < end; index++) {
+                    states[index] = configuration;
+                    if(index + 1u < end) {
+                        configuration = basis.next(configuration);
+                    }
+                }
+            });
+
+            return numpy_array(move(states));
+        });
+
+    py::class_<GroundState>(m, "GroundState")
+        .def_readonly("basis", &GroundState::basis)
+        .def_readonly("energy", &GroundState::energy)
+        .def_readonly("residual", &GroundState::residual)
+        .def_readonly("num_iterations", &GroundState::num_iterations)
+        .def_readonly("converged", &GroundState::converged)
+        .def_property_readonly("vector", [](py::object ground_state_object) {
+            const auto& amplitudes = ground_state_object.cast<const GroundState&>().amplitudes;
+
+            return py::array_t<std::complex<double>>(
+                {(long int)amplitudes.size()},
+                {(long int)sizeof(std::complex<double>)},
+                amplitudes.data(),
+                ground_state_object
+            );
+        })
+        .def_property_readonly("full_vector", [](const GroundState& ground_state) {
+            return numpy_array(ground_state.full_vector());
+        });
+
+    m.def(
+        "ground_state", &ground_state,
+        "operator_"_a, "basis"_a, "max_iterations"_a=1000u, "tolerance"_a=1e-10, "num_threads"_a=0u, "seed"_a=0u
+    );
+
+    py::class_<CompressionReport>(m, "CompressionReport")
+        .def_readonly("num_strings", &CompressionReport::num_strings)
+        .def_readonly("num_merged_strings", &CompressionReport::num_merged_strings)
+        .def_readonly("num_compressed_strings", &CompressionReport::num_compressed_strings)
+        .def_readonly("error_bound", &CompressionReport::error_bound)
+        .def_readonly("relative_error_bound", &CompressionReport::relative_error_bound)
+        .def("__repr__", [](const CompressionReport& report) {
+            return (
+                "strings: " + to_string(report.num_strings) +
+                " -> " + to_string(report.num_merged_strings) + " merged" +
+                " -> " + to_string(report.num_compressed_strings) + " kept" +
+                ", error bound: " + to_string(report.error_bound) +
+                " (relative " + to_string(report.relative_error_bound) + ")"
+            );
+        });
+
+    py::class_<MeasurementPlan>(m, "MeasurementPlan")
+        .def(py::init<
+            const vector<Operator>&,
+            const bool
+        >())
+        .def_readonly("gpu", &MeasurementPlan::gpu)
+        .def_readonly("num_operators", &MeasurementPlan::num_operators)
+        .def_readonly("num_groups", &MeasurementPlan::num_groups)
+        .def_readonly("num_terms", &MeasurementPlan::num_terms);
+
+    py::class_<OperatorProduct>(m, "OperatorProduct")
+        .def(py::init<
+            const vector<Operator>&,
+            const bool
+        >())
+        .def_readonly("gpu", &OperatorProduct::gpu)
+        .def_readonly("num_factors", &OperatorProduct::num_factors)
+        .def_readonly("num_transitions", &OperatorProduct::num_transitions)
+        .def_property_readonly("num_configurations", &OperatorProduct::get_num_configurations);
 
     py::class_<rbm_on_gpu::Spins>(m, "Spins")
         .def(py::init<rbm_on_gpu::Spins::type>())
@@ -201,12 +464,20 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         .def(py::init<bool>())
         .def("__call__", &ExpectationValue::__call__<Psi, ExactSummation>)
         .def("__call__", &ExpectationValue::__call__vector<Psi, ExactSummation>)
+        .def("__call__", &ExpectationValue::__call__plan<Psi, ExactSummation>)
         .def("__call__", &ExpectationValue::__call__<Psi, MonteCarloLoop>)
         .def("__call__", &ExpectationValue::__call__vector<Psi, MonteCarloLoop>)
+        .def("__call__", &ExpectationValue::__call__plan<Psi, MonteCarloLoop>)
         .def("__call__", &ExpectationValue::__call__<PsiDeep, ExactSummation>)
         .def("__call__", &ExpectationValue::__call__vector<PsiDeep, ExactSummation>)
+        .def("__call__", &ExpectationValue::__call__plan<PsiDeep, ExactSummation>)
         .def("__call__", &ExpectationValue::__call__<PsiDeep, MonteCarloLoop>)
         .def("__call__", &ExpectationValue::__call__vector<PsiDeep, MonteCarloLoop>)
+        .def("__call__", &ExpectationValue::__call__plan<PsiDeep, MonteCarloLoop>)
+        .def("__call__", &ExpectationValue::__call__<PsiWithJastrow, ExactSummation>)
+        .def("__call__", &ExpectationValue::__call__<PsiWithJastrow, MonteCarloLoop>)
+        .def("__call__", &ExpectationValue::__call__<PsiDeepWithJastrow, ExactSummation>)
+        .def("__call__", &ExpectationValue::__call__<PsiDeepWithJastrow, MonteCarloLoop>)
         .def("__call__", &ExpectationValue::__call__<PsiHamiltonian, MonteCarloLoop>)
         .def("fluctuation", &ExpectationValue::fluctuation<Psi, ExactSummation>)
         .def("fluctuation", &ExpectationValue::fluctuation<Psi, MonteCarloLoop>)
@@ -216,14 +487,22 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         .def("gradient", &ExpectationValue::gradient_py<Psi, MonteCarloLoop>)
         .def("gradient", &ExpectationValue::gradient_py<PsiDeep, ExactSummation>)
         .def("gradient", &ExpectationValue::gradient_py<PsiDeep, MonteCarloLoop>)
+        .def("gradient", &ExpectationValue::gradient_py<PsiWithJastrow, ExactSummation>)
+        .def("gradient", &ExpectationValue::gradient_py<PsiWithJastrow, MonteCarloLoop>)
+        .def("gradient", &ExpectationValue::gradient_py<PsiDeepWithJastrow, ExactSummation>)
+        .def("gradient", &ExpectationValue::gradient_py<PsiDeepWithJastrow, MonteCarloLoop>)
         .def("fluctuation_gradient", &ExpectationValue::fluctuation_gradient_py<Psi, ExactSummation>)
         .def("fluctuation_gradient", &ExpectationValue::fluctuation_gradient_py<Psi, MonteCarloLoop>)
         .def("fluctuation_gradient", &ExpectationValue::fluctuation_gradient_py<PsiDeep, ExactSummation>)
         .def("fluctuation_gradient", &ExpectationValue::fluctuation_gradient_py<PsiDeep, MonteCarloLoop>)
-        .def("difference", &ExpectationValue::difference<Psi, ExactSummation>)
-        .def("difference", &ExpectationValue::difference<Psi, MonteCarloLoop>)
-        .def("difference", &ExpectationValue::difference<PsiDeep, ExactSummation>)
-        .def("difference", &ExpectationValue::difference<PsiDeep, MonteCarloLoop>);
+        .def("difference", &ExpectationValue::difference_vector<Psi, ExactSummation>)
+        .def("difference", &ExpectationValue::difference_plan<Psi, ExactSummation>)
+        .def("difference", &ExpectationValue::difference_vector<Psi, MonteCarloLoop>)
+        .def("difference", &ExpectationValue::difference_plan<Psi, MonteCarloLoop>)
+        .def("difference", &ExpectationValue::difference_vector<PsiDeep, ExactSummation>)
+        .def("difference", &ExpectationValue::difference_plan<PsiDeep, ExactSummation>)
+        .def("difference", &ExpectationValue::difference_vector<PsiDeep, MonteCarloLoop>)
+        .def("difference", &ExpectationValue::difference_plan<PsiDeep, MonteCarloLoop>);
 
     py::class_<HilbertSpaceDistance>(m, "HilbertSpaceDistance")
         .def(py::init<unsigned int, unsigned int, bool>())
@@ -239,9 +518,25 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         .def("gradient", &HilbertSpaceDistance::gradient_py<Psi, Psi, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
         .def("gradient", &HilbertSpaceDistance::gradient_py<PsiDeep, PsiDeep, ExactSummation>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
         .def("gradient", &HilbertSpaceDistance::gradient_py<PsiDeep, PsiDeep, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<PsiWithJastrow, PsiWithJastrow, ExactSummation>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<PsiWithJastrow, PsiWithJastrow, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiWithJastrow, PsiWithJastrow, ExactSummation>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiWithJastrow, PsiWithJastrow, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<PsiDeepWithJastrow, PsiDeepWithJastrow, ExactSummation>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<PsiDeepWithJastrow, PsiDeepWithJastrow, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiDeepWithJastrow, PsiDeepWithJastrow, ExactSummation>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiDeepWithJastrow, PsiDeepWithJastrow, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
         .def("__call__", &HilbertSpaceDistance::distance<PsiClassical, PsiDeep, ExactSummation>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
         .def("gradient", &HilbertSpaceDistance::gradient_py<PsiClassical, PsiDeep, ExactSummation>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
-        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiClassical, PsiDeep, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a);;
+        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiClassical, PsiDeep, MonteCarloLoop>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<Psi, Psi, ExactSummation, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<Psi, Psi, MonteCarloLoop, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<PsiDeep, PsiDeep, ExactSummation, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("__call__", &HilbertSpaceDistance::distance<PsiDeep, PsiDeep, MonteCarloLoop, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<Psi, Psi, ExactSummation, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<Psi, Psi, MonteCarloLoop, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiDeep, PsiDeep, ExactSummation, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a)
+        .def("gradient", &HilbertSpaceDistance::gradient_py<PsiDeep, PsiDeep, MonteCarloLoop, OperatorProduct>, "psi"_a, "psi_prime"_a, "operator_"_a, "is_unitary"_a, "spin_ensemble"_a);
 
     m.def("get_S_matrix", [](const Psi& psi, const ExactSummation& spin_ensemble){
         return get_S_matrix(psi, spin_ensemble).to_pytensor<2u>(shape_t<2u>{psi.num_params, psi.num_params});
@@ -275,6 +570,34 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
             result_and_result_std.second.to_pytensor<1u>()
         );
     });
+    m.def("get_O_k_vector", [](const PsiWithJastrow& psi, const ExactSummation& spin_ensemble) {
+        auto result_and_result_std = psi_O_k_vector(psi, spin_ensemble);
+        return make_pair(
+            result_and_result_std.first.to_pytensor<1u>(),
+            result_and_result_std.second.to_pytensor<1u>()
+        );
+    });
+    m.def("get_O_k_vector", [](const PsiWithJastrow& psi, const MonteCarloLoop& spin_ensemble) {
+        auto result_and_result_std = psi_O_k_vector(psi, spin_ensemble);
+        return make_pair(
+            result_and_result_std.first.to_pytensor<1u>(),
+            result_and_result_std.second.to_pytensor<1u>()
+        );
+    });
+    m.def("get_O_k_vector", [](const PsiDeepWithJastrow& psi, const ExactSummation& spin_ensemble) {
+        auto result_and_result_std = psi_O_k_vector(psi, spin_ensemble);
+        return make_pair(
+            result_and_result_std.first.to_pytensor<1u>(),
+            result_and_result_std.second.to_pytensor<1u>()
+        );
+    });
+    m.def("get_O_k_vector", [](const PsiDeepWithJastrow& psi, const MonteCarloLoop& spin_ensemble) {
+        auto result_and_result_std = psi_O_k_vector(psi, spin_ensemble);
+        return make_pair(
+            result_and_result_std.first.to_pytensor<1u>(),
+            result_and_result_std.second.to_pytensor<1u>()
+        );
+    });
 
     m.def("psi_angles", [](const PsiDeep& psi, const ExactSummation& spin_ensemble) {
         auto result_and_result_std = psi_angles(psi, spin_ensemble);
@@ -291,6 +614,28 @@ PYBIND11_MODULE(_pyRBMonGPU, m)
         );
     });
 
+    m.def("convert_to_network_file", convert_to_network_file);
+    m.def("convert_classical_to_network_files", Peter::convert_to_network_files, "directory"_a, "index"_a);
+
+    m.def("log_psi_table", [](const Psi& psi, const unsigned int num_threads) {
+        return log_psi_table(psi, num_threads).to_pytensor<1u>();
+    }, py::arg("psi"), py::arg("num_threads") = 0u);
+    m.def("log_psi_table", [](const PsiDeep& psi, const unsigned int num_threads) {
+        return log_psi_table(psi, num_threads).to_pytensor<1u>();
+    }, py::arg("psi"), py::arg("num_threads") = 0u);
+    m.def("log_psi_table", [](const PsiWithJastrow& psi, const unsigned int num_threads) {
+        return log_psi_table(psi, num_threads).to_pytensor<1u>();
+    }, py::arg("psi"), py::arg("num_threads") = 0u);
+    m.def("log_psi_table", [](const PsiDeepWithJastrow& psi, const unsigned int num_threads) {
+        return log_psi_table(psi, num_threads).to_pytensor<1u>();
+    }, py::arg("psi"), py::arg("num_threads") = 0u);
+    m.def("log_psi_table", [](const PsiClassical& psi, const unsigned int num_threads) {
+        return log_psi_table(psi, num_threads).to_pytensor<1u>();
+    }, py::arg("psi"), py::arg("num_threads") = 0u);
+    m.def("log_psi_table", [](const PsiDeepMin& psi, const unsigned int num_threads) {
+        return log_psi_table(psi, num_threads).to_pytensor<1u>();
+    }, py::arg("psi"), py::arg("num_threads") = 0u);
+
     m.def("activation_function", [](const complex<double>& x) {
         return my_logcosh(complex_t(x.real(), x.imag())).to_std();
     });
@@ -0,0 +1,214 @@
+#include "NetworkFile.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace rbm_on_gpu {
+
+namespace {
+
+constexpr char network_file_magic[8] = {'R', 'B', 'M', 'o', 'n', 'G', 'P', 'U'};
+
+inline size_t align(const size_t offset, const size_t alignment) {
+    return (offset + alignment - 1u) / alignment * alignment;
+}
+
+} // namespace
+
+
+MappedFile::MappedFile(const string& file_name) : address(nullptr), length(0u) {
+    const auto fd = open(file_name.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw runtime_error("could not open '" + file_name + "': " + strerror(errno));
+    }
+
+    struct stat status;
+    if(fstat(fd, &status) != 0) {
+        close(fd);
+        throw runtime_error("could not stat '" + file_name + "': " + strerror(errno));
+    }
+    this->length = status.st_size;
+
+    if(this->length > 0u) {
+        this->address = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if(this->address == MAP_FAILED) {
+        throw runtime_error("could not map '" + file_name + "': " + strerror(errno));
+    }
+}
+
+
+MappedFile::~MappedFile() {
+    if(this->address != nullptr) {
+        munmap(this->address, this->length);
+    }
+}
+
+
+NetworkFile::NetworkFile(const string& file_name) : mapping(make_shared<const MappedFile>(file_name)) {
+    const auto size = this->mapping->size();
+
+    if(size < sizeof(NetworkFileHeader) || memcmp(this->header().magic, network_file_magic, 8u) != 0) {
+        throw runtime_error("'" + file_name + "' is not a network file");
+    }
+
+    const auto& header = this->header();
+    if(header.version > NetworkFileHeader::current_version) {
+        throw runtime_error(
+            "'" + file_name + "' has version " + to_string(header.version) +
+            ", only versions up to " + to_string(NetworkFileHeader::current_version) + " are supported"
+        );
+    }
+    if(header.byte_order != NetworkFileHeader::byte_order_mark) {
+        throw runtime_error("'" + file_name + "' has been written on a machine of different byte order");
+    }
+    if(
+        header.topology_offset % sizeof(uint32_t) != 0u ||
+        header.topology_offset > size ||
+        header.topology_length > (size - header.topology_offset) / sizeof(uint32_t) ||
+        header.params_offset % params_alignment != 0u ||
+        header.params_offset > size ||
+        header.num_params > (size - header.params_offset) / sizeof(complex<double>)
+    ) {
+        throw runtime_error("'" + file_name + "' is truncated or corrupt");
+    }
+}
+
+
+bool NetworkFile::is_network_file(const string& file_name) {
+    ifstream infile(file_name, ios::binary);
+
+    char magic[8];
+    return infile.read(magic, 8u) && memcmp(magic, network_file_magic, 8u) == 0;
+}
+
+
+void NetworkFile::write(
+    const string& file_name,
+    const NetworkType type,
+    const unsigned int N,
+    const uint32_t flags,
+    const double prefactor,
+    const double log_prefactor,
+    const vector<uint32_t>& topology,
+    const complex<double>* params,
+    const size_t num_params
+) {
+    NetworkFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, network_file_magic, 8u);
+    header.version = NetworkFileHeader::current_version;
+    header.byte_order = NetworkFileHeader::byte_order_mark;
+    header.type = static_cast<uint32_t>(type);
+    header.N = N;
+    header.flags = flags;
+    header.prefactor = prefactor;
+    header.log_prefactor = log_prefactor;
+    header.topology_offset = sizeof(NetworkFileHeader);
+    header.topology_length = topology.size();
+    header.params_offset = align(
+        header.topology_offset + sizeof(uint32_t) * topology.size(), params_alignment
+    );
+    header.num_params = num_params;
+
+    // write to a temporary file first, such that readers never see a partially written file.
+    const auto tmp_file_name = file_name + ".tmp";
+    {
+        ofstream outfile(tmp_file_name, ios::binary | ios::trunc);
+        if(!outfile) {
+            throw runtime_error("could not open '" + tmp_file_name + "' for writing");
+        }
+
+        const vector<char> padding(
+            header.params_offset - header.topology_offset - sizeof(uint32_t) * topology.size(), 0
+        );
+
+        outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        outfile.write(reinterpret_cast<const char*>(topology.data()), sizeof(uint32_t) * topology.size());
+        outfile.write(padding.data(), padding.size());
+        outfile.write(reinterpret_cast<const char*>(params), sizeof(complex<double>) * num_params);
+
+        if(!outfile) {
+            throw runtime_error("could not write '" + tmp_file_name + "'");
+        }
+    }
+
+    if(rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+        throw runtime_error("could not rename '" + tmp_file_name + "' to '" + file_name + "': " + strerror(errno));
+    }
+}
+
+
+void NetworkFile::expect_type(const NetworkType type) const {
+    if(this->type() != type) {
+        throw runtime_error(
+            "the network file holds a network of type " + to_string(this->header().type) +
+            ", expected type " + to_string(static_cast<uint32_t>(type))
+        );
+    }
+}
+
+
+const uint32_t* TopologyReader::read(const size_t length) {
+    if(length > size_t(this->end - this->position)) {
+        throw runtime_error("the topology of the network file is truncated");
+    }
+
+    const auto result = this->position;
+    this->position += length;
+    return result;
+}
+
+
+vector<LayerTopology> read_layer_topology(const NetworkFile& file, const unsigned int N) {
+    TopologyReader reader(file);
+
+    const auto num_layers = reader.read();
+
+    vector<LayerTopology> result;
+    result.reserve(num_layers);
+
+    auto prev_size = N;
+    for(auto layer_idx = 0u; layer_idx < num_layers; layer_idx++) {
+        LayerTopology layer;
+        layer.size = reader.read();
+        layer.lhs_connectivity = reader.read();
+        layer.lhs_connections = reader.read(size_t(layer.lhs_connectivity) * layer.size);
+
+        for(auto k = 0u; k < layer.lhs_connectivity * layer.size; k++) {
+            if(layer.lhs_connections[k] >= prev_size) {
+                throw runtime_error(
+                    "layer " + to_string(layer_idx) + " of the network file is connected to a non-existing unit"
+                );
+            }
+        }
+
+        result.push_back(layer);
+        prev_size = layer.size;
+    }
+
+    return result;
+}
+
+
+void append_layer_topology(vector<uint32_t>& topology, const LayerTopology& layer) {
+    topology.push_back(layer.size);
+    topology.push_back(layer.lhs_connectivity);
+    topology.insert(
+        topology.end(), layer.lhs_connections, layer.lhs_connections + layer.lhs_connectivity * layer.size
+    );
+}
+
+} // namespace rbm_on_gpu
@@ -4,6 +4,7 @@
 #include "quantum_state/Psi.hpp"
 #include "quantum_state/PsiDeep.hpp"
 #include "quantum_state/PsiHamiltonian.hpp"
+#include "quantum_state/ProductPsi.hpp"
 #include "Array.hpp"
 
 
@@ -156,8 +157,11 @@ complex<double> ExpectationValue::gradient(
         ) {
             #include "cuda_kernel_defines.h"
 
+            // one scratch for the connected configurations of both passes over the operator
+            SHARED typename Psi_t::Angles angles_prime;
+
             SHARED complex_t local_energy;
-            op_kernel.local_energy(local_energy, psi_kernel, spins, log_psi, angles);
+            op_kernel.local_energy(local_energy, psi_kernel, spins, log_psi, angles, angles_prime);
 
             SINGLE
             {
@@ -176,7 +180,7 @@ complex<double> ExpectationValue::gradient(
             SYNC;
 
             op_kernel.foreach_E_k_s_prime(
-                psi_kernel, spins, log_psi, angles, [&](const unsigned int k, const complex_t& E_k_s_prime) {
+                psi_kernel, spins, log_psi, angles, angles_prime, [&](const unsigned int k, const complex_t& E_k_s_prime) {
                     generic_atomicAdd(&E_loc_k_ptr[k], weight * E_k_s_prime);
                 }
             );
@@ -241,8 +245,11 @@ void ExpectationValue::fluctuation_gradient(complex<double>* result, const Psi_t
         ) {
             #include "cuda_kernel_defines.h"
 
+            // one scratch for the connected configurations of both passes over the operator
+            SHARED typename Psi_t::Angles angles_prime;
+
             SHARED complex_t local_energy;
-            op_kernel.local_energy(local_energy, psi_kernel, spins, log_psi, angles);
+            op_kernel.local_energy(local_energy, psi_kernel, spins, log_psi, angles, angles_prime);
 
             SINGLE
             {
@@ -262,7 +269,7 @@ void ExpectationValue::fluctuation_gradient(complex<double>* result, const Psi_t
             SYNC;
 
             op_kernel.foreach_E_k_s_prime(
-                psi_kernel, spins, log_psi, angles, [&](const unsigned int k, const complex_t& E_k_s_prime) {
+                psi_kernel, spins, log_psi, angles, angles_prime, [&](const unsigned int k, const complex_t& E_k_s_prime) {
                     generic_atomicAdd(&E_loc_k_ptr[k], weight * E_k_s_prime);
                     generic_atomicAdd(&E_loc_E_loc_k_ptr[k], weight * (conj(local_energy) * E_k_s_prime));
                 }
@@ -297,28 +304,29 @@ void ExpectationValue::fluctuation_gradient(complex<double>* result, const Psi_t
 
 template<typename Psi_t, typename SpinEnsemble>
 vector<complex<double>> ExpectationValue::difference(
-    const Psi_t& psi, const Psi_t& psi_prime, const vector<Operator>& operator_list_host, const SpinEnsemble& spin_ensemble
+    const Psi_t& psi, const Psi_t& psi_prime, const MeasurementPlan& plan, const SpinEnsemble& spin_ensemble
 ) const {
-    const auto length = operator_list_host.size();
+    if(plan.gpu != psi.gpu) {
+        throw invalid_argument("the measurement plan has to reside on the same device as the network");
+    }
 
+    const auto length = plan.num_operators;
 
-    Operator* operator_list;
-    complex_t* a_list;
-    complex_t* b_list;
-    double* probability_ratio_avg;
+    Array<complex_t> a_list(length, psi.gpu);
+    Array<complex_t> b_list(length, psi.gpu);
+    Array<double> probability_ratio_avg(1, psi.gpu);
 
-    MALLOC(operator_list, sizeof(Operator) * length, psi.gpu);
-    MEMCPY(operator_list, operator_list_host.data(), sizeof(Operator) * length, psi.gpu, false);
+    a_list.clear();
+    b_list.clear();
+    probability_ratio_avg.clear();
 
-    MALLOC(a_list, sizeof(complex_t) * length, psi.gpu);
-    MALLOC(b_list, sizeof(complex_t) * length, psi.gpu);
-    MEMSET(a_list, 0, sizeof(complex_t) * length, psi.gpu);
-    MEMSET(b_list, 0, sizeof(complex_t) * length, psi.gpu);
-    MALLOC(probability_ratio_avg, sizeof(double), psi.gpu);
-    MEMSET(probability_ratio_avg, 0, sizeof(double), psi.gpu);
+    auto a_ptr = a_list.data();
+    auto b_ptr = b_list.data();
+    auto probability_ratio_ptr = probability_ratio_avg.data();
 
     const auto psi_kernel = psi.get_kernel();
     const auto psi_prime_kernel = psi_prime.get_kernel();
+    const auto plan_kernel = plan.get_kernel();
 
     spin_ensemble.foreach(
         psi,
@@ -331,94 +339,79 @@ vector<complex<double>> ExpectationValue::difference(
         ) {
             #include "cuda_kernel_defines.h"
 
-            SHARED typename Psi_t::Angles angles_prime;
-            angles_prime.init(psi_prime_kernel, spins);
+            // The angles of psi_prime at 'spins' are kept, such that those of its connected configurations follow
+            // from flipping spins. A single scratch serves the connected configurations of both terms.
+            SHARED typename Psi_t::Angles angles_of_psi_prime;
+            angles_of_psi_prime.init(psi_prime_kernel, spins);
 
             SHARED complex_t log_psi_prime;
-            psi_prime_kernel.log_psi_s(log_psi_prime, spins, angles_prime);
+            psi_prime_kernel.log_psi_s(log_psi_prime, spins, angles_of_psi_prime);
 
-            double probability_ratio;
+            SHARED typename Psi_t::Angles angles_prime;
+
+            SHARED double probability_ratio;
             SINGLE
             {
                 probability_ratio = exp(2.0 * (log_psi.real() - log_psi_prime.real()));
+                generic_atomicAdd(probability_ratio_ptr, weight * probability_ratio);
             }
+            SYNC;
 
-            SHARED complex_t local_energy;
-            SHARED complex_t local_energy_prime;
-
-            for(auto i = 0u; i < length; i++) {
-                operator_list[i].local_energy(local_energy, psi_kernel, spins, log_psi, angles);
-                operator_list[i].local_energy(local_energy_prime, psi_prime_kernel, spins, log_psi_prime, angles_prime);
-
-                SINGLE
-                {
-                    generic_atomicAdd(&a_list[i], weight * local_energy_prime);
-                    generic_atomicAdd(&b_list[i], weight * probability_ratio * local_energy);
+            plan_kernel.foreach_local_energy(
+                psi_prime_kernel, spins, log_psi_prime, angles_of_psi_prime, angles_prime,
+                [&](const unsigned int i, const complex_t& local_energy_prime) {
+                    generic_atomicAdd(&a_ptr[i], weight * local_energy_prime);
                 }
-            }
-
-            SINGLE
-            {
-                generic_atomicAdd(probability_ratio_avg, weight * probability_ratio);
-            }
+            );
+            plan_kernel.foreach_local_energy(
+                psi_kernel, spins, log_psi, angles, angles_prime,
+                [&](const unsigned int i, const complex_t& local_energy) {
+                    generic_atomicAdd(&b_ptr[i], weight * probability_ratio * local_energy);
+                }
+            );
         }
     );
 
-    vector<complex<double>> a_list_host(length);
-    vector<complex<double>> b_list_host(length);
-    double probability_ratio_host;
-
-    MEMCPY_TO_HOST(a_list_host.data(), a_list, sizeof(complex_t) * length, psi.gpu);
-    MEMCPY_TO_HOST(b_list_host.data(), b_list, sizeof(complex_t) * length, psi.gpu);
-    MEMCPY_TO_HOST(&probability_ratio_host, probability_ratio_avg, sizeof(double), psi.gpu);
+    a_list.update_host();
+    b_list.update_host();
+    probability_ratio_avg.update_host();
 
-    FREE(operator_list, psi.gpu);
-    FREE(a_list, psi.gpu);
-    FREE(b_list, psi.gpu);
-    FREE(probability_ratio_avg, psi.gpu);
-
-    for(auto& a : a_list_host) {
-        a *= 1.0 / spin_ensemble.get_num_steps();
-    }
-    for(auto& b : b_list_host) {
-        b *= 1.0 / spin_ensemble.get_num_steps();
-    }
-    probability_ratio_host *= 1.0 / spin_ensemble.get_num_steps();
+    const auto probability_ratio_host = probability_ratio_avg.front() * (1.0 / spin_ensemble.get_num_steps());
 
     vector<complex<double>> result(length);
     for(auto i = 0u; i < length; i++) {
-        result[i] = a_list_host[i] - b_list_host[i] / probability_ratio_host;
+        const auto a = a_list[i] * (1.0 / spin_ensemble.get_num_steps());
+        const auto b = b_list[i] * (1.0 / spin_ensemble.get_num_steps());
+
+        result[i] = (a - b * (1.0 / probability_ratio_host)).to_std();
     }
 
     return result;
 }
 
+template<typename Psi_t, typename SpinEnsemble>
+vector<complex<double>> ExpectationValue::difference(
+    const Psi_t& psi, const Psi_t& psi_prime, const vector<Operator>& operator_list_host, const SpinEnsemble& spin_ensemble
+) const {
+    return this->difference(psi, psi_prime, MeasurementPlan(operator_list_host, psi.gpu), spin_ensemble);
+}
+
 template<typename Psi_t, typename SpinEnsemble>
 vector<complex<double>> ExpectationValue::operator() (
     const Psi_t& psi,
-    const vector<Operator>& operator_list_host,
+    const MeasurementPlan& plan,
     const SpinEnsemble& spin_ensemble
 ) const {
-    const auto length = operator_list_host.size();
-    vector<complex<double>> result_host(length);
-
-    const Operator* operator_list;
-    complex_t* result;
-
-    if(this->gpu) {
-        CUDA_CHECK(cudaMalloc(&operator_list, sizeof(Operator) * length));
-        CUDA_CHECK(cudaMemcpy((void*)operator_list, operator_list_host.data(), sizeof(Operator) * length, cudaMemcpyHostToDevice));
-
-        CUDA_CHECK(cudaMalloc(&result, sizeof(complex_t) * length));
-        CUDA_CHECK(cudaMemset(result, 0, sizeof(complex_t) * length));
-    }
-    else {
-        operator_list = operator_list_host.data();
-        result_host.assign(length, complex<double>(0.0, 0.0));
-        result = (complex_t*)result_host.data();
+    if(plan.gpu != psi.gpu) {
+        throw invalid_argument("the measurement plan has to reside on the same device as the network");
     }
 
+    Array<complex_t> result(plan.num_operators, psi.gpu);
+    result.clear();
+
+    auto result_ptr = result.data();
     const auto psi_kernel = psi.get_kernel();
+    const auto plan_kernel = plan.get_kernel();
 
     spin_ensemble.foreach(
         psi,
@@ -429,42 +422,34 @@ vector<complex<double>> ExpectationValue::operator() (
             const typename Psi_t::Angles& angles,
             const double weight
         ) {
-            #ifdef __CUDA_ARCH__
-
-            __shared__ complex_t local_energy;
-            for(auto i = 0u; i < length; i++) {
-                operator_list[i].local_energy(local_energy, psi_kernel, spins, log_psi, angles);
-                if(threadIdx.x == 0) {
-                    atomicAdd(&result[i], weight * local_energy);
+            plan_kernel.foreach_local_energy(
+                psi_kernel, spins, log_psi, angles,
+                [&](const unsigned int i, const complex_t& local_energy) {
+                    generic_atomicAdd(&result_ptr[i], weight * local_energy);
                 }
-            }
-
-            #else
-
-            complex_t local_energy;
-            for(auto i = 0u; i < length; i++) {
-                operator_list[i].local_energy(local_energy, psi_kernel, spins, log_psi, angles);
-                result[i] += weight * local_energy;
-            }
-
-            #endif
+            );
         }
     );
 
-    if(this->gpu) {
-        CUDA_CHECK(cudaMemcpy(result_host.data(), result, sizeof(complex_t) * length, cudaMemcpyDeviceToHost))
-
-        CUDA_CHECK(cudaFree((void*)operator_list));
-        CUDA_CHECK(cudaFree(result));
-    }
+    result.update_host();
 
-    for(auto& r : result_host) {
-        r *= 1.0 / spin_ensemble.get_num_steps();
+    vector<complex<double>> result_host(plan.num_operators);
+    for(auto i = 0u; i < plan.num_operators; i++) {
+        result_host[i] = (result[i] * (1.0 / spin_ensemble.get_num_steps())).to_std();
     }
 
     return result_host;
 }
 
+template<typename Psi_t, typename SpinEnsemble>
+vector<complex<double>> ExpectationValue::operator() (
+    const Psi_t& psi,
+    const vector<Operator>& operator_list_host,
+    const SpinEnsemble& spin_ensemble
+) const {
+    return (*this)(psi, MeasurementPlan(operator_list_host, psi.gpu), spin_ensemble);
+}
+
 
 template complex<double> ExpectationValue::operator()(const Psi& psi, const Operator& operator_, const ExactSummation&) const;
 template complex<double> ExpectationValue::operator()(const Psi& psi, const Operator& operator_, const MonteCarloLoop&) const;
@@ -495,6 +480,11 @@ template vector<complex<double>> ExpectationValue::difference(const Psi&, const
 template vector<complex<double>> ExpectationValue::difference(const PsiDeep&, const PsiDeep&, const vector<Operator>&, const ExactSummation&) const;
 template vector<complex<double>> ExpectationValue::difference(const PsiDeep&, const PsiDeep&, const vector<Operator>&, const MonteCarloLoop&) const;
 
+template vector<complex<double>> ExpectationValue::difference(const Psi&, const Psi&, const MeasurementPlan&, const ExactSummation&) const;
+template vector<complex<double>> ExpectationValue::difference(const Psi&, const Psi&, const MeasurementPlan&, const MonteCarloLoop&) const;
+template vector<complex<double>> ExpectationValue::difference(const PsiDeep&, const PsiDeep&, const MeasurementPlan&, const ExactSummation&) const;
+template vector<complex<double>> ExpectationValue::difference(const PsiDeep&, const PsiDeep&, const MeasurementPlan&, const MonteCarloLoop&) const;
+
 template vector<complex<double>> ExpectationValue::operator()(
     const Psi& psi, const vector<Operator>& operator_, const ExactSummation&
 ) const;
@@ -508,4 +498,37 @@ template vector<complex<double>> ExpectationValue::operator()(
     const PsiDeep& psi, const vector<Operator>& operator_, const MonteCarloLoop&
 ) const;
 
+template vector<complex<double>> ExpectationValue::operator()(
+    const Psi& psi, const MeasurementPlan& plan, const ExactSummation&
+) const;
+template vector<complex<double>> ExpectationValue::operator()(
+    const Psi& psi, const MeasurementPlan& plan, const MonteCarloLoop&
+) const;
+template vector<complex<double>> ExpectationValue::operator()(
+    const PsiDeep& psi, const MeasurementPlan& plan, const ExactSummation&
+) const;
+template vector<complex<double>> ExpectationValue::operator()(
+    const PsiDeep& psi, const MeasurementPlan& plan, const MonteCarloLoop&
+) const;
+
+template complex<double> ExpectationValue::operator()(const PsiWithJastrow& psi, const Operator& operator_, const ExactSummation&) const;
+template complex<double> ExpectationValue::operator()(const PsiWithJastrow& psi, const Operator& operator_, const MonteCarloLoop&) const;
+template complex<double> ExpectationValue::operator()(const PsiDeepWithJastrow& psi, const Operator& operator_, const ExactSummation&) const;
+template complex<double> ExpectationValue::operator()(const PsiDeepWithJastrow& psi, const Operator& operator_, const MonteCarloLoop&) const;
+
+template pair<double, complex<double>> ExpectationValue::fluctuation(const PsiWithJastrow&, const Operator&, const ExactSummation&) const;
+template pair<double, complex<double>> ExpectationValue::fluctuation(const PsiWithJastrow&, const Operator&, const MonteCarloLoop&) const;
+template pair<double, complex<double>> ExpectationValue::fluctuation(const PsiDeepWithJastrow&, const Operator&, const ExactSummation&) const;
+template pair<double, complex<double>> ExpectationValue::fluctuation(const PsiDeepWithJastrow&, const Operator&, const MonteCarloLoop&) const;
+
+template complex<double> ExpectationValue::gradient(complex<double>*, const PsiWithJastrow&, const Operator&, const ExactSummation&) const;
+template complex<double> ExpectationValue::gradient(complex<double>*, const PsiWithJastrow&, const Operator&, const MonteCarloLoop&) const;
+template complex<double> ExpectationValue::gradient(complex<double>*, const PsiDeepWithJastrow&, const Operator&, const ExactSummation&) const;
+template complex<double> ExpectationValue::gradient(complex<double>*, const PsiDeepWithJastrow&, const Operator&, const MonteCarloLoop&) const;
+
+template void ExpectationValue::fluctuation_gradient(complex<double>*, const PsiWithJastrow&, const Operator&, const ExactSummation&) const;
+template void ExpectationValue::fluctuation_gradient(complex<double>*, const PsiWithJastrow&, const Operator&, const MonteCarloLoop&) const;
+template void ExpectationValue::fluctuation_gradient(complex<double>*, const PsiDeepWithJastrow&, const Operator&, const ExactSummation&) const;
+template void ExpectationValue::fluctuation_gradient(complex<double>*, const PsiDeepWithJastrow&, const Operator&, const MonteCarloLoop&) const;
+
 } // namespace rbm_on_gpu
@@ -4,8 +4,10 @@
 #include "quantum_state/Psi.hpp"
 #include "quantum_state/PsiDeep.hpp"
 #include "quantum_state/PsiClassical.hpp"
+#include "quantum_state/ProductPsi.hpp"
 
 #include <cstring>
+#include <type_traits>
 #include <math.h>
 
 
@@ -14,14 +16,34 @@ namespace rbm_on_gpu {
 namespace kernel {
 
 
-template<bool compute_gradient, bool free_quantum_axis, typename Psi_t, typename Psi_t_prime, typename SpinEnsemble>
+// The local energy is evaluated before 'angles_prime' is used, hence the latter serves as scratch of the operator
+// if psi and psi_prime share the type of their angles.
+template<typename Operator_t, typename Psi_t>
+HDINLINE void local_energy_with_scratch(
+    true_type, complex_t& result, const Operator_t& operator_, const Psi_t& psi, const Spins& spins, const complex_t& log_psi,
+    const typename Psi_t::Angles& angles, typename Psi_t::Angles& angles_prime
+) {
+    operator_.local_energy(result, psi, spins, log_psi, angles, angles_prime);
+}
+
+template<typename Operator_t, typename Psi_t, typename Angles_prime_t>
+HDINLINE void local_energy_with_scratch(
+    false_type, complex_t& result, const Operator_t& operator_, const Psi_t& psi, const Spins& spins, const complex_t& log_psi,
+    const typename Psi_t::Angles& angles, Angles_prime_t& angles_prime
+) {
+    operator_.local_energy(result, psi, spins, log_psi, angles);
+}
+
+
+template<bool compute_gradient, bool free_quantum_axis, typename Psi_t, typename Psi_t_prime, typename Operator_t, typename SpinEnsemble>
 void kernel::HilbertSpaceDistance::compute_averages(
-    const Psi_t& psi, const Psi_t_prime& psi_prime, const Operator& operator_,
+    const Psi_t& psi, const Psi_t_prime& psi_prime, const Operator_t& operator_,
     const bool is_unitary, const SpinEnsemble& spin_ensemble
 ) const {
     const auto num_params = psi_prime.get_num_params();
 
     const auto this_ = *this;
+    const auto operator_kernel = operator_.get_kernel();
     const auto psi_kernel = psi.get_kernel();
     const auto psi_prime_kernel = psi_prime.get_kernel();
     const auto N = psi.get_num_spins();
@@ -37,17 +59,19 @@ void kernel::HilbertSpaceDistance::compute_averages(
         ) {
             #include "cuda_kernel_defines.h"
 
-            SHARED complex_t local_energy;
-            operator_.local_energy(local_energy, psi_kernel, spins, log_psi, angles);
-
             SHARED typename Psi_t_prime::Angles angles_prime;
-            angles_prime.init(psi_prime_kernel, spins);
-
             SHARED complex_t log_psi_prime;
-            psi_prime_kernel.log_psi_s(log_psi_prime, spins, angles_prime);
+
+            SHARED complex_t local_energy;
+            local_energy_with_scratch(
+                is_same<typename Psi_t::Angles, typename Psi_t_prime::Angles>(),
+                local_energy, operator_kernel, psi_kernel, spins, log_psi, angles, angles_prime
+            );
 
             SHARED complex_t psi_i_ratio[MAX_SPINS];
             if(free_quantum_axis) {
+                // the single-flip amplitudes are evaluated first, such that the workspace of 'angles_prime'
+                // belongs to 'spins' afterwards and can be reused by foreach_O_k() below.
                 SHARED Spins spins_i;
                 SHARED complex_t log_psi_prime_i;
                 for(auto i = 0u; i < N; i++) {
@@ -60,10 +84,20 @@ void kernel::HilbertSpaceDistance::compute_averages(
                     angles_prime.init(psi_prime_kernel, spins_i);
                     psi_prime_kernel.log_psi_s(log_psi_prime_i, spins_i, angles_prime);
                     SINGLE {
-                        psi_i_ratio[i] = exp(log_psi_prime_i - log_psi_prime);
+                        psi_i_ratio[i] = log_psi_prime_i;
                     }
                 }
                 SYNC;
+            }
+
+            angles_prime.init(psi_prime_kernel, spins);
+            psi_prime_kernel.log_psi_s(log_psi_prime, spins, angles_prime);
+
+            if(free_quantum_axis) {
+                MULTI(i, N) {
+                    psi_i_ratio[i] = exp(psi_i_ratio[i] - log_psi_prime);
+                }
+                SYNC;
 
                 MULTI(i, N) {
                     generic_atomicAdd(
@@ -78,9 +112,6 @@ void kernel::HilbertSpaceDistance::compute_averages(
                     );
                 }
                 SYNC;
-
-                // TODO: optimize
-                angles_prime.init(psi_prime_kernel, spins);
             }
 
             SHARED complex_t   omega;
@@ -134,7 +165,8 @@ void kernel::HilbertSpaceDistance::compute_averages(
                 );
             }
         },
-        max(psi.get_width(), psi_prime.get_width())
+        max(psi.get_width(), psi_prime.get_width()),
+        operator_.get_shared_memory_size()
     );
 }
 
@@ -193,9 +225,9 @@ void HilbertSpaceDistance::clear() {
 }
 
 
-template<typename Psi_t, typename Psi_t_prime, typename SpinEnsemble>
+template<typename Psi_t, typename Psi_t_prime, typename SpinEnsemble, typename Operator_t>
 double HilbertSpaceDistance::distance(
-    const Psi_t& psi, const Psi_t_prime& psi_prime, const Operator& operator_, const bool is_unitary,
+    const Psi_t& psi, const Psi_t_prime& psi_prime, const Operator_t& operator_, const bool is_unitary,
     const SpinEnsemble& spin_ensemble
 ) {
     this->clear();
@@ -224,9 +256,9 @@ double HilbertSpaceDistance::distance(
 }
 
 
-template<typename Psi_t, typename Psi_t_prime, typename SpinEnsemble>
+template<typename Psi_t, typename Psi_t_prime, typename SpinEnsemble, typename Operator_t>
 double HilbertSpaceDistance::gradient(
-    complex<double>* result, const Psi_t& psi, const Psi_t_prime& psi_prime, const Operator& operator_,
+    complex<double>* result, const Psi_t& psi, const Psi_t_prime& psi_prime, const Operator_t& operator_,
     const bool is_unitary, const SpinEnsemble& spin_ensemble
 ) {
     this->clear();
@@ -323,4 +355,78 @@ template double HilbertSpaceDistance::gradient(
     const bool is_unitary, const MonteCarloLoop& spin_ensemble
 );
 
+
+template double HilbertSpaceDistance::distance(
+    const PsiWithJastrow& psi, const PsiWithJastrow& psi_prime, const Operator& operator_, const bool is_unitary,
+    const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::distance(
+    const PsiWithJastrow& psi, const PsiWithJastrow& psi_prime, const Operator& operator_, const bool is_unitary,
+    const MonteCarloLoop& spin_ensemble
+);
+
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const PsiWithJastrow& psi, const PsiWithJastrow& psi_prime, const Operator& operator_,
+    const bool is_unitary, const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const PsiWithJastrow& psi, const PsiWithJastrow& psi_prime, const Operator& operator_,
+    const bool is_unitary, const MonteCarloLoop& spin_ensemble
+);
+
+template double HilbertSpaceDistance::distance(
+    const PsiDeepWithJastrow& psi, const PsiDeepWithJastrow& psi_prime, const Operator& operator_, const bool is_unitary,
+    const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::distance(
+    const PsiDeepWithJastrow& psi, const PsiDeepWithJastrow& psi_prime, const Operator& operator_, const bool is_unitary,
+    const MonteCarloLoop& spin_ensemble
+);
+
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const PsiDeepWithJastrow& psi, const PsiDeepWithJastrow& psi_prime, const Operator& operator_,
+    const bool is_unitary, const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const PsiDeepWithJastrow& psi, const PsiDeepWithJastrow& psi_prime, const Operator& operator_,
+    const bool is_unitary, const MonteCarloLoop& spin_ensemble
+);
+
+
+template double HilbertSpaceDistance::distance(
+    const Psi& psi, const Psi& psi_prime, const OperatorProduct& operator_, const bool is_unitary,
+    const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::distance(
+    const Psi& psi, const Psi& psi_prime, const OperatorProduct& operator_, const bool is_unitary,
+    const MonteCarloLoop& spin_ensemble
+);
+
+template double HilbertSpaceDistance::distance(
+    const PsiDeep& psi, const PsiDeep& psi_prime, const OperatorProduct& operator_, const bool is_unitary,
+    const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::distance(
+    const PsiDeep& psi, const PsiDeep& psi_prime, const OperatorProduct& operator_, const bool is_unitary,
+    const MonteCarloLoop& spin_ensemble
+);
+
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const Psi& psi, const Psi& psi_prime, const OperatorProduct& operator_,
+    const bool is_unitary, const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const Psi& psi, const Psi& psi_prime, const OperatorProduct& operator_,
+    const bool is_unitary, const MonteCarloLoop& spin_ensemble
+);
+
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const PsiDeep& psi, const PsiDeep& psi_prime, const OperatorProduct& operator_,
+    const bool is_unitary, const ExactSummation& spin_ensemble
+);
+template double HilbertSpaceDistance::gradient(
+    complex<double>* result, const PsiDeep& psi, const PsiDeep& psi_prime, const OperatorProduct& operator_,
+    const bool is_unitary, const MonteCarloLoop& spin_ensemble
+);
+
 } // namespace rbm_on_gpu
@@ -0,0 +1,154 @@
+#include "network_functions/LogPsiTable.hpp"
+#include "quantum_state/Psi.hpp"
+#include "quantum_state/PsiDeep.hpp"
+#include "quantum_state/PsiClassical.hpp"
+#include "quantum_state/PsiDeepMin.hpp"
+#include "quantum_state/ProductPsi.hpp"
+#include "spin_ensembles/ExactSummation.hpp"
+#include "types.h"
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+namespace rbm_on_gpu {
+
+namespace {
+
+void check_table_size(const unsigned int N) {
+    if(N > log_psi_table_max_N) {
+        throw invalid_argument(
+            "a network of " + to_string(N) + " spins is too large to be tabulated, at most " +
+            to_string(log_psi_table_max_N) + " spins are supported"
+        );
+    }
+}
+
+// Evaluates the kernel of a network for all configurations on the host.
+// The configurations are split into contiguous chunks, one per thread.
+template<typename Psi_kernel_t>
+void log_psi_table_host(complex_t* result, const Psi_kernel_t& psi_kernel, const unsigned int N, unsigned int num_threads) {
+    const auto num_configurations = size_t(1u) << N;
+
+    if(num_threads == 0u) {
+        num_threads = max(thread::hardware_concurrency(), 1u);
+    }
+    num_threads = max(min<size_t>(num_threads, num_configurations), size_t(1u));
+
+    const auto evaluate_chunk = [&](const unsigned int thread_idx) {
+        const auto begin = num_configurations * thread_idx / num_threads;
+        const auto end = num_configurations * (thread_idx + 1u) / num_threads;
+        for(auto spin_index = begin; spin_index < end; spin_index++) {
+            const Spins spins = {(Spins::type)spin_index};
+
+            typename Psi_kernel_t::Angles angles;
+            angles.init(psi_kernel, spins);
+
+            psi_kernel.log_psi_s(result[spin_index], spins, angles);
+        }
+    };
+
+    vector<thread> threads;
+    threads.reserve(num_threads - 1u);
+    for(auto thread_idx = 1u; thread_idx < num_threads; thread_idx++) {
+        threads.emplace_back(evaluate_chunk, thread_idx);
+    }
+    evaluate_chunk(0u);
+
+    for(auto& worker : threads) {
+        worker.join();
+    }
+}
+
+} // namespace
+
+
+template<typename Psi_t>
+Array<complex_t> log_psi_table(const Psi_t& psi, const unsigned int num_threads) {
+    check_table_size(psi.N);
+
+    Array<complex_t> result(size_t(1u) << psi.N, psi.gpu);
+
+    if(psi.gpu) {
+        ExactSummation exact_summation(psi.N, psi.gpu);
+        auto result_ptr = result.data();
+
+        exact_summation.foreach(
+            psi,
+            [=] __host__ __device__ (
+                const unsigned int spin_index,
+                const Spins spins,
+                const complex_t log_psi,
+                const typename Psi_t::Angles& angles,
+                const double weight
+            ) {
+                #ifdef __CUDA_ARCH__
+                if(threadIdx.x == 0)
+                #endif
+                {
+                    result_ptr[spin_index] = log_psi;
+                }
+            }
+        );
+
+        result.update_host();
+    }
+    else {
+        log_psi_table_host(result.host_data(), psi.get_kernel(), psi.N, num_threads);
+    }
+
+    return result;
+}
+
+
+// The classical network can only be evaluated on the host. A table residing on the GPU is uploaded afterwards.
+template<>
+Array<complex_t> log_psi_table(const PsiClassical& psi, const unsigned int num_threads) {
+    check_table_size(psi.N);
+
+    Array<complex_t> result(size_t(1u) << psi.N, psi.gpu);
+
+    auto psi_kernel = psi.get_kernel();
+    psi_kernel.log_psi_ptr = nullptr;
+    log_psi_table_host(result.host_data(), psi_kernel, psi.N, num_threads);
+
+    result.update_device();
+
+    return result;
+}
+
+
+template<>
+Array<complex_t> log_psi_table(const PsiDeepMin& psi, const unsigned int num_threads) {
+    check_table_size(psi.N);
+
+    const auto num_configurations = size_t(1u) << psi.N;
+    Array<complex_t> result(num_configurations, false);
+
+    // the configurations are generated in blocks, each of them is evaluated by all threads.
+    const auto block_size = min(num_configurations, size_t(1u) << 16u);
+    vector<Spins> spins(block_size);
+
+    for(auto begin = size_t(0u); begin < num_configurations; begin += block_size) {
+        for(auto n = 0u; n < block_size; n++) {
+            spins[n] = Spins((Spins::type)(begin + n));
+        }
+
+        psi.log_psi_s_batch(
+            reinterpret_cast<complex_std*>(result.host_data() + begin), spins.data(), block_size, num_threads
+        );
+    }
+
+    return result;
+}
+
+
+template Array<complex_t> log_psi_table(const Psi& psi, const unsigned int num_threads);
+template Array<complex_t> log_psi_table(const PsiDeep& psi, const unsigned int num_threads);
+template Array<complex_t> log_psi_table(const PsiWithJastrow& psi, const unsigned int num_threads);
+template Array<complex_t> log_psi_table(const PsiDeepWithJastrow& psi, const unsigned int num_threads);
+
+} // namespace rbm_on_gpu
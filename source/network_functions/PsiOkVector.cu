@@ -1,6 +1,7 @@
 #include "network_functions/PsiOkVector.hpp"
 #include "quantum_state/Psi.hpp"
 #include "quantum_state/PsiDeep.hpp"
+#include "quantum_state/ProductPsi.hpp"
 #include "spin_ensembles/ExactSummation.hpp"
 #include "spin_ensembles/MonteCarloLoop.hpp"
 #include "types.h"
@@ -15,6 +16,7 @@ void psi_O_k_vector(complex<double>* result, const Psi_t& psi, const Spins& spin
     auto psi_kernel = psi.get_kernel();
 
     MALLOC(result_ptr, sizeof(complex_t) * O_k_length, psi.gpu);
+    MEMSET(result_ptr, 0, sizeof(complex_t) * O_k_length, psi.gpu);
 
     const auto functor = [=] __host__ __device__ () {
         #include "cuda_kernel_defines.h"
@@ -145,17 +147,27 @@ pair<Array<complex_t>, Array<double>> psi_O_k_vector(const Psi_t& psi, const Spi
 
 template void psi_O_k_vector(complex<double>* result, const Psi& psi, const Spins& spins);
 template void psi_O_k_vector(complex<double>* result, const PsiDeep& psi, const Spins& spins);
+template void psi_O_k_vector(complex<double>* result, const PsiWithJastrow& psi, const Spins& spins);
+template void psi_O_k_vector(complex<double>* result, const PsiDeepWithJastrow& psi, const Spins& spins);
 
 
 template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const Psi& psi, const ExactSummation& spin_ensemble);
 template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const Psi& psi, const MonteCarloLoop& spin_ensemble);
 template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const PsiDeep& psi, const ExactSummation& spin_ensemble);
+template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const PsiWithJastrow& psi, const ExactSummation& spin_ensemble);
+template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const PsiDeepWithJastrow& psi, const ExactSummation& spin_ensemble);
 template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const PsiDeep& psi, const MonteCarloLoop& spin_ensemble);
+template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const PsiWithJastrow& psi, const MonteCarloLoop& spin_ensemble);
+template void psi_O_k_vector(complex<double>* result, complex<double>* result_std, const PsiDeepWithJastrow& psi, const MonteCarloLoop& spin_ensemble);
 
 
 template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const Psi& psi, const ExactSummation& spin_ensemble);
 template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const Psi& psi, const MonteCarloLoop& spin_ensemble);
 template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const PsiDeep& psi, const ExactSummation& spin_ensemble);
+template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const PsiWithJastrow& psi, const ExactSummation& spin_ensemble);
+template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const PsiDeepWithJastrow& psi, const ExactSummation& spin_ensemble);
 template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const PsiDeep& psi, const MonteCarloLoop& spin_ensemble);
+template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const PsiWithJastrow& psi, const MonteCarloLoop& spin_ensemble);
+template pair<Array<complex_t>, Array<double>> psi_O_k_vector(const PsiDeepWithJastrow& psi, const MonteCarloLoop& spin_ensemble);
 
 } // namespace rbm_on_gpu
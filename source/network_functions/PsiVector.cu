@@ -3,6 +3,7 @@
 #include "quantum_state/PsiDeep.hpp"
 #include "quantum_state/PsiClassical.hpp"
 #include "quantum_state/PsiDeepMin.hpp"
+#include "quantum_state/ProductPsi.hpp"
 #include "spin_ensembles/ExactSummation.hpp"
 #include "types.h"
 
@@ -53,10 +54,16 @@ Array<complex_t> psi_vector(const Psi_t& psi) {
 template void psi_vector(complex<double>* result, const Psi& psi);
 template void psi_vector(complex<double>* result, const PsiDeep& psi);
 template void psi_vector(complex<double>* result, const PsiClassical& psi);
+template void psi_vector(complex<double>* result, const PsiJastrow& psi);
+template void psi_vector(complex<double>* result, const PsiWithJastrow& psi);
+template void psi_vector(complex<double>* result, const PsiDeepWithJastrow& psi);
 // template void psi_vector(complex<double>* result, const PsiDeepMin& psi);
 
 template Array<complex_t> psi_vector(const Psi& psi);
 template Array<complex_t> psi_vector(const PsiDeep& psi);
 template Array<complex_t> psi_vector(const PsiClassical& psi);
+template Array<complex_t> psi_vector(const PsiJastrow& psi);
+template Array<complex_t> psi_vector(const PsiWithJastrow& psi);
+template Array<complex_t> psi_vector(const PsiDeepWithJastrow& psi);
 
 } // namespace rbm_on_gpu
@@ -0,0 +1,357 @@
+#include "operator/Lanczos.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <string>
+
+
+using namespace std;
+
+namespace rbm_on_gpu {
+
+namespace {
+
+// If given, 'diagonal' holds the diagonal group per basis state, which is then skipped.
+void apply_kernel(
+    complex<double>* y,
+    const kernel::Operator& kernel,
+    const SpinBasis& basis,
+    const complex<double>* x,
+    const unsigned int num_threads,
+    const double* diagonal = nullptr
+) {
+    const auto first_group = diagonal != nullptr && kernel.num_groups > 0u && kernel.is_diagonal(0u) ? 1u : 0u;
+
+    basis.foreach_chunk(num_threads, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+        auto configuration = basis.state(begin);
+        for(auto index = begin; index < end; index++) {
+            if(index > begin) {
+                configuration = basis.next(configuration);
+            }
+
+            complex<double> result = first_group > 0u ? diagonal[index] * x[index] : complex<double>(0.0, 0.0);
+            for(auto group = first_group; group < kernel.num_groups; group++) {
+                const auto configuration_prime = configuration ^ kernel.group_flip_masks[group];
+                if(basis.contains(configuration_prime)) {
+                    result += (
+                        kernel.group_coefficient(Spins(configuration), group).to_std() * x[basis.index(configuration_prime)]
+                    );
+                }
+            }
+            y[index] = result;
+        }
+    });
+}
+
+// Calls function(begin, end) on contiguous chunks and returns the sum of their results in a fixed order.
+template<typename T, typename Function>
+T reduce_chunks(const SpinBasis& basis, const unsigned int num_threads, Function function) {
+    vector<T> partial_results(num_threads, T(0));
+    basis.foreach_chunk(num_threads, [&](const unsigned int thread_idx, const uint64_t begin, const uint64_t end) {
+        partial_results[thread_idx] = function(begin, end);
+    });
+
+    return accumulate(partial_results.begin(), partial_results.end(), T(0));
+}
+
+double uniform_hash(uint64_t x) {
+    // splitmix64
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27u)) * 0x94d049bb133111ebull;
+    x ^= x >> 31u;
+
+    return (x >> 11u) * (1.0 / 9007199254740992.0) - 0.5;
+}
+
+// number of eigenvalues of the symmetric tridiagonal matrix (alpha, beta) below x
+unsigned int sturm_count(const vector<double>& alpha, const vector<double>& beta, const double x) {
+    auto result = 0u;
+    auto q = 1.0;
+    for(auto i = 0u; i < alpha.size(); i++) {
+        q = alpha[i] - x - (i > 0u ? beta[i - 1u] * beta[i - 1u] / q : 0.0);
+        if(q == 0.0) {
+            q = -numeric_limits<double>::min();
+        }
+        if(q < 0.0) {
+            result++;
+        }
+    }
+    return result;
+}
+
+// Lowest eigenvalue of the symmetric tridiagonal matrix with diagonal 'alpha' and off-diagonal 'beta' by bisection,
+// followed by inverse iteration for its normalized eigenvector 'y'.
+double lowest_eigenpair(vector<double>& y, const vector<double>& alpha, const vector<double>& beta) {
+    const auto m = alpha.size();
+
+    auto lower = numeric_limits<double>::max();
+    auto upper = -numeric_limits<double>::max();
+    for(auto i = 0u; i < m; i++) {
+        const auto radius = (i > 0u ? abs(beta[i - 1u]) : 0.0) + (i + 1u < m ? abs(beta[i]) : 0.0);
+        lower = min(lower, alpha[i] - radius);
+        upper = max(upper, alpha[i] + radius);
+    }
+    const auto scale = max(max(abs(lower), abs(upper)), numeric_limits<double>::min());
+    lower -= 1e-12 * scale;
+
+    // 'lower' stays below all eigenvalues
+    for(auto step = 0u; step < 200u && upper - lower > 4.0 * numeric_limits<double>::epsilon() * scale; step++) {
+        const auto middle = 0.5 * (lower + upper);
+        if(sturm_count(alpha, beta, middle) == 0u) {
+            lower = middle;
+        }
+        else {
+            upper = middle;
+        }
+    }
+
+    // T - lower is positive definite, hence the LDL^T factorization needs no pivoting
+    vector<double> d(m), l(m);
+    for(auto i = 0u; i < m; i++) {
+        d[i] = alpha[i] - lower;
+        if(i > 0u) {
+            l[i] = beta[i - 1u] / d[i - 1u];
+            d[i] -= l[i] * beta[i - 1u];
+        }
+        d[i] = max(d[i], numeric_limits<double>::min());
+    }
+
+    y.assign(m, 1.0);
+    for(auto iteration = 0u; iteration < 3u; iteration++) {
+        for(auto i = 1u; i < m; i++) {
+            y[i] -= l[i] * y[i - 1u];
+        }
+        for(auto i = 0u; i < m; i++) {
+            y[i] /= d[i];
+        }
+        for(auto i = m - 1u; i > 0u; i--) {
+            y[i - 1u] -= l[i] * y[i];
+        }
+
+        const auto norm = sqrt(inner_product(y.begin(), y.end(), y.begin(), 0.0));
+        for(auto& y_i : y) {
+            y_i /= norm;
+        }
+    }
+
+    return 0.5 * (lower + upper);
+}
+
+} // namespace
+
+
+void apply_operator(
+    complex<double>* y, const Operator& operator_, const SpinBasis& basis, const complex<double>* x, unsigned int num_threads
+) {
+    if(operator_.gpu) {
+        // the rows are evaluated on the host
+        apply_operator(y, Operator(operator_.to_expr(), false), basis, x, num_threads);
+        return;
+    }
+
+    apply_kernel(y, operator_.get_kernel(), basis, x, basis.get_num_threads(num_threads));
+}
+
+vector<complex<double>> GroundState::full_vector() const {
+    vector<complex<double>> result((size_t)1u << this->basis.N, complex<double>(0.0, 0.0));
+
+    this->basis.foreach_chunk(0u, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+        auto configuration = this->basis.state(begin);
+        for(auto index = begin; index < end; index++) {
+            if(index > begin) {
+                configuration = this->basis.next(configuration);
+            }
+            result[configuration] = this->amplitudes[index];
+        }
+    });
+
+    return result;
+}
+
+GroundState ground_state(
+    const Operator&     operator_,
+    const SpinBasis&    basis,
+    const unsigned int  max_iterations,
+    const double        tolerance,
+    unsigned int        num_threads,
+    const uint64_t      seed
+) {
+    if(operator_.gpu) {
+        return ground_state(Operator(operator_.to_expr(), false), basis, max_iterations, tolerance, num_threads, seed);
+    }
+    if(max_iterations == 0u) {
+        throw invalid_argument("the Lanczos method needs at least one iteration");
+    }
+
+    const auto kernel = operator_.get_kernel();
+    const auto dimension = basis.size();
+    num_threads = basis.get_num_threads(num_threads);
+
+    // the diagonal of a hermitian operator is real and evaluated only once
+    vector<double> diagonal(dimension);
+    basis.foreach_chunk(num_threads, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+        auto configuration = basis.state(begin);
+        for(auto index = begin; index < end; index++) {
+            if(index > begin) {
+                configuration = basis.next(configuration);
+            }
+            diagonal[index] = (
+                kernel.num_groups > 0u && kernel.is_diagonal(0u) ?
+                kernel.group_coefficient(Spins(configuration), 0u).real() :
+                0.0
+            );
+        }
+    });
+
+    vector<complex<double>> v_prev(dimension), v(dimension), w(dimension);
+
+    const auto start_vector = [&](vector<complex<double>>& result) {
+        const auto norm_squared = reduce_chunks<double>(basis, num_threads, [&](const uint64_t begin, const uint64_t end) {
+            auto configuration = basis.state(begin);
+            auto local_norm_squared = 0.0;
+            for(auto index = begin; index < end; index++) {
+                if(index > begin) {
+                    configuration = basis.next(configuration);
+                }
+                const auto key = 2u * configuration ^ (seed * 0xd1342543de82ef95ull);
+                result[index] = complex<double>(uniform_hash(key), uniform_hash(key ^ 1u));
+                local_norm_squared += norm(result[index]);
+            }
+            return local_norm_squared;
+        });
+
+        const auto inverse_norm = 1.0 / sqrt(norm_squared);
+        basis.foreach_chunk(num_threads, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+            for(auto index = begin; index < end; index++) {
+                result[index] *= inverse_norm;
+            }
+        });
+    };
+
+    // w <- (O - alpha) v - beta_prev v_prev, returning | w |^2. On the first pass 'alpha' = < v | O | v > is computed.
+    const auto lanczos_step = [&](double& alpha, const double beta_prev, const bool first_pass) {
+        apply_kernel(w.data(), kernel, basis, v.data(), num_threads, diagonal.data());
+
+        if(first_pass) {
+            alpha = reduce_chunks<double>(basis, num_threads, [&](const uint64_t begin, const uint64_t end) {
+                auto result = 0.0;
+                for(auto index = begin; index < end; index++) {
+                    result += (conj(v[index]) * w[index]).real();
+                }
+                return result;
+            });
+        }
+
+        return reduce_chunks<double>(basis, num_threads, [&](const uint64_t begin, const uint64_t end) {
+            auto result = 0.0;
+            for(auto index = begin; index < end; index++) {
+                w[index] -= alpha * v[index] + beta_prev * v_prev[index];
+                result += norm(w[index]);
+            }
+            return result;
+        });
+    };
+
+    // v_prev <- v, v <- w / beta
+    const auto advance = [&](const double beta) {
+        swap(v_prev, v);
+        swap(v, w);
+        basis.foreach_chunk(num_threads, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+            for(auto index = begin; index < end; index++) {
+                v[index] /= beta;
+            }
+        });
+    };
+
+    // first pass: the tridiagonal matrix
+    vector<double> alpha, beta;
+    vector<double> y;
+    auto energy = 0.0;
+    auto converged = false;
+
+    start_vector(v);
+    fill(v_prev.begin(), v_prev.end(), complex<double>(0.0, 0.0));
+
+    for(auto iteration = 0u; iteration < max_iterations; iteration++) {
+        double alpha_j;
+        const auto beta_j = sqrt(lanczos_step(alpha_j, iteration > 0u ? beta.back() : 0.0, true));
+
+        alpha.push_back(alpha_j);
+        energy = lowest_eigenpair(y, alpha, beta);
+
+        const auto scale = max(1.0, abs(energy));
+        if(beta_j * abs(y.back()) <= tolerance * scale || beta_j <= 1e-14 * scale) {
+            converged = true;
+            break;
+        }
+
+        beta.push_back(beta_j);
+        advance(beta_j);
+    }
+
+    // second pass: regenerate the Krylov vectors and sum up the Ritz vector
+    const auto num_iterations = alpha.size();
+
+    vector<complex<double>> x(dimension, complex<double>(0.0, 0.0));
+
+    start_vector(v);
+    fill(v_prev.begin(), v_prev.end(), complex<double>(0.0, 0.0));
+
+    for(auto iteration = 0u; iteration < num_iterations; iteration++) {
+        basis.foreach_chunk(num_threads, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+            for(auto index = begin; index < end; index++) {
+                x[index] += y[iteration] * v[index];
+            }
+        });
+
+        if(iteration + 1u < num_iterations) {
+            auto alpha_j = alpha[iteration];
+            lanczos_step(alpha_j, iteration > 0u ? beta[iteration - 1u] : 0.0, false);
+            advance(beta[iteration]);
+        }
+    }
+    v_prev = vector<complex<double>>();
+    v = vector<complex<double>>();
+
+    // normalize, fix the global phase and measure the actual residual
+    const auto largest = distance(x.begin(), max_element(x.begin(), x.end(), [](const complex<double>& a, const complex<double>& b) {
+        return norm(a) < norm(b);
+    }));
+    const auto x_norm = sqrt(reduce_chunks<double>(basis, num_threads, [&](const uint64_t begin, const uint64_t end) {
+        auto result = 0.0;
+        for(auto index = begin; index < end; index++) {
+            result += norm(x[index]);
+        }
+        return result;
+    }));
+    const auto phase = conj(x[largest]) / (abs(x[largest]) * x_norm);
+    basis.foreach_chunk(num_threads, [&](const unsigned int, const uint64_t begin, const uint64_t end) {
+        for(auto index = begin; index < end; index++) {
+            x[index] *= phase;
+        }
+    });
+
+    apply_kernel(w.data(), kernel, basis, x.data(), num_threads, diagonal.data());
+    energy = reduce_chunks<double>(basis, num_threads, [&](const uint64_t begin, const uint64_t end) {
+        auto result = 0.0;
+        for(auto index = begin; index < end; index++) {
+            result += (conj(x[index]) * w[index]).real();
+        }
+        return result;
+    });
+    const auto residual = sqrt(reduce_chunks<double>(basis, num_threads, [&](const uint64_t begin, const uint64_t end) {
+        auto result = 0.0;
+        for(auto index = begin; index < end; index++) {
+            result += norm(w[index] - energy * x[index]);
+        }
+        return result;
+    }));
+
+    return {basis, energy, move(x), residual, (unsigned int)num_iterations, converged};
+}
+
+} // namespace rbm_on_gpu
@@ -0,0 +1,176 @@
+#include "operator/MeasurementPlan.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <complex>
+
+
+namespace rbm_on_gpu {
+
+MeasurementPlan::MeasurementPlan(const std::vector<Operator>& operators, const bool gpu) : gpu(gpu) {
+    struct Term {
+        Spins::type             flip_mask;
+        Spins::type             sign_mask;
+        std::complex<double>    coefficient;
+        unsigned int            operator_index;
+    };
+
+    std::vector<Term> terms;
+    std::vector<std::complex<double>> quadratic_form_data;
+
+    for(auto i = 0u; i < operators.size(); i++) {
+        const auto& operator_ = operators[i];
+
+        if(operator_.quadratic_form.N > 0u) {
+            auto quadratic_form = operator_.quadratic_form;
+            const auto offset = quadratic_form_data.size();
+
+            quadratic_form_data.resize(offset + quadratic_form.size());
+            MEMCPY_TO_HOST(
+                &quadratic_form_data[offset], quadratic_form.data, sizeof(complex_t) * quadratic_form.size(), operator_.gpu
+            );
+            quadratic_form.data = nullptr;
+
+            this->host_quadratic_forms.push_back(quadratic_form);
+            this->host_quadratic_form_offsets.push_back(offset);
+            this->host_quadratic_form_operator.push_back(i);
+        }
+
+        std::vector<unsigned int> group_begin(operator_.num_groups + 1u);
+        std::vector<Spins::type> group_flip_masks(operator_.num_groups);
+        std::vector<std::complex<double>> coefficients(operator_.num_compiled_strings);
+        std::vector<Spins::type> sign_masks(operator_.num_compiled_strings);
+
+        MEMCPY_TO_HOST(group_begin.data(), operator_.group_begin, sizeof(unsigned int) * group_begin.size(), operator_.gpu);
+        MEMCPY_TO_HOST(group_flip_masks.data(), operator_.group_flip_masks, sizeof(Spins::type) * group_flip_masks.size(), operator_.gpu);
+        MEMCPY_TO_HOST(coefficients.data(), operator_.compiled_coefficients, sizeof(complex_t) * coefficients.size(), operator_.gpu);
+        MEMCPY_TO_HOST(sign_masks.data(), operator_.sign_masks, sizeof(Spins::type) * sign_masks.size(), operator_.gpu);
+
+        for(auto group = 0u; group < operator_.num_groups; group++) {
+            for(auto n = group_begin[group]; n < group_begin[group + 1u]; n++) {
+                terms.push_back({group_flip_masks[group], sign_masks[n], coefficients[n], i});
+            }
+        }
+    }
+
+    // merge the groups of all operators
+    std::stable_sort(terms.begin(), terms.end(), [](const Term& a, const Term& b) {
+        return a.flip_mask < b.flip_mask;
+    });
+
+    std::vector<unsigned int> group_begin;
+    std::vector<Spins::type> group_flip_masks;
+    std::vector<std::complex<double>> coefficients(terms.size());
+    std::vector<Spins::type> sign_masks(terms.size());
+    std::vector<unsigned int> operator_index(terms.size());
+
+    for(auto t = 0u; t < terms.size(); t++) {
+        if(t == 0u || terms[t].flip_mask != group_flip_masks.back()) {
+            group_begin.push_back(t);
+            group_flip_masks.push_back(terms[t].flip_mask);
+        }
+
+        coefficients[t] = terms[t].coefficient;
+        sign_masks[t] = terms[t].sign_mask;
+        operator_index[t] = terms[t].operator_index;
+    }
+    group_begin.push_back(terms.size());
+
+    this->num_operators = operators.size();
+    this->num_groups = group_flip_masks.size();
+    this->num_terms = terms.size();
+
+    this->allocate_memory_and_initialize(
+        group_begin.data(),
+        group_flip_masks.data(),
+        reinterpret_cast<const complex_t*>(coefficients.data()),
+        sign_masks.data(),
+        operator_index.data(),
+        false
+    );
+
+    this->num_quadratic_forms = this->host_quadratic_forms.size();
+    this->quadratic_form_data_size = quadratic_form_data.size();
+    this->allocate_quadratic_forms(reinterpret_cast<const complex_t*>(quadratic_form_data.data()), false);
+}
+
+MeasurementPlan::MeasurementPlan(const MeasurementPlan& other)
+    :
+    gpu(other.gpu),
+    host_quadratic_forms(other.host_quadratic_forms),
+    host_quadratic_form_offsets(other.host_quadratic_form_offsets),
+    host_quadratic_form_operator(other.host_quadratic_form_operator)
+{
+    this->num_operators = other.num_operators;
+    this->num_groups = other.num_groups;
+    this->num_terms = other.num_terms;
+
+    this->allocate_memory_and_initialize(
+        other.group_begin,
+        other.group_flip_masks,
+        other.coefficients,
+        other.sign_masks,
+        other.operator_index,
+        other.gpu
+    );
+
+    this->num_quadratic_forms = other.num_quadratic_forms;
+    this->quadratic_form_data_size = other.quadratic_form_data_size;
+    this->allocate_quadratic_forms(other.quadratic_form_data, other.gpu);
+}
+
+// Copies 'quadratic_form_data' and points the kernel's forms into the copy.
+void MeasurementPlan::allocate_quadratic_forms(const complex_t* quadratic_form_data, const bool pointer_on_gpu) {
+    MALLOC(this->quadratic_form_data, sizeof(complex_t) * this->quadratic_form_data_size, this->gpu);
+    MEMCPY(
+        this->quadratic_form_data, quadratic_form_data, sizeof(complex_t) * this->quadratic_form_data_size, this->gpu, pointer_on_gpu
+    );
+
+    std::vector<kernel::QuadraticForm> quadratic_forms(this->host_quadratic_forms);
+    for(auto f = 0u; f < this->num_quadratic_forms; f++) {
+        quadratic_forms[f].data = this->quadratic_form_data + this->host_quadratic_form_offsets[f];
+    }
+
+    MALLOC(this->quadratic_forms, sizeof(kernel::QuadraticForm) * this->num_quadratic_forms, this->gpu);
+    MALLOC(this->quadratic_form_operator, sizeof(unsigned int) * this->num_quadratic_forms, this->gpu);
+
+    MEMCPY(this->quadratic_forms, quadratic_forms.data(), sizeof(kernel::QuadraticForm) * this->num_quadratic_forms, this->gpu, false);
+    MEMCPY(
+        this->quadratic_form_operator, this->host_quadratic_form_operator.data(), sizeof(unsigned int) * this->num_quadratic_forms,
+        this->gpu, false
+    );
+}
+
+void MeasurementPlan::allocate_memory_and_initialize(
+    const unsigned int* group_begin,
+    const Spins::type*  group_flip_masks,
+    const complex_t*    coefficients,
+    const Spins::type*  sign_masks,
+    const unsigned int* operator_index,
+    const bool          pointers_on_gpu
+) {
+    MALLOC(this->group_begin, sizeof(unsigned int) * (this->num_groups + 1u), this->gpu);
+    MALLOC(this->group_flip_masks, sizeof(Spins::type) * this->num_groups, this->gpu);
+    MALLOC(this->coefficients, sizeof(complex_t) * this->num_terms, this->gpu);
+    MALLOC(this->sign_masks, sizeof(Spins::type) * this->num_terms, this->gpu);
+    MALLOC(this->operator_index, sizeof(unsigned int) * this->num_terms, this->gpu);
+
+    MEMCPY(this->group_begin, group_begin, sizeof(unsigned int) * (this->num_groups + 1u), this->gpu, pointers_on_gpu);
+    MEMCPY(this->group_flip_masks, group_flip_masks, sizeof(Spins::type) * this->num_groups, this->gpu, pointers_on_gpu);
+    MEMCPY(this->coefficients, coefficients, sizeof(complex_t) * this->num_terms, this->gpu, pointers_on_gpu);
+    MEMCPY(this->sign_masks, sign_masks, sizeof(Spins::type) * this->num_terms, this->gpu, pointers_on_gpu);
+    MEMCPY(this->operator_index, operator_index, sizeof(unsigned int) * this->num_terms, this->gpu, pointers_on_gpu);
+}
+
+MeasurementPlan::~MeasurementPlan() noexcept(false) {
+    FREE(this->group_begin, this->gpu);
+    FREE(this->group_flip_masks, this->gpu);
+    FREE(this->coefficients, this->gpu);
+    FREE(this->sign_masks, this->gpu);
+    FREE(this->operator_index, this->gpu);
+    FREE(this->quadratic_forms, this->gpu);
+    FREE(this->quadratic_form_operator, this->gpu);
+    FREE(this->quadratic_form_data, this->gpu);
+}
+
+} // namespace rbm_on_gpu
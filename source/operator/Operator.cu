@@ -1,5 +1,7 @@
 #include "operator/Operator.hpp"
 #include <cstring>
+#include <vector>
+#include <algorithm>
 
 
 namespace rbm_on_gpu {
@@ -51,6 +53,10 @@ Operator::Operator(const Operator& other) : gpu(other.gpu) {
         other.pauli_indices,
         other.gpu
     );
+
+    // the strings compile to the same code, such that the loaded library is shared
+    this->jit_library = other.jit_library;
+    this->jit_group_coefficient = other.jit_group_coefficient;
 }
 
 void Operator::allocate_memory_and_initialize(
@@ -68,6 +74,197 @@ void Operator::allocate_memory_and_initialize(
     MEMCPY(this->coefficients, coefficients, sizeof(complex_t) * this->num_strings, this->gpu, pointers_on_gpu);
     MEMCPY(this->pauli_types, pauli_types, sizeof(PauliMatrices) * num_table_elements, this->gpu, pointers_on_gpu);
     MEMCPY(this->pauli_indices, pauli_indices, sizeof(int) * num_table_elements, this->gpu, pointers_on_gpu);
+
+    this->compile_strings();
+}
+
+namespace {
+
+struct CompiledString {
+    Spins::type             flip_mask;
+    Spins::type             sign_mask;
+    std::complex<double>    coefficient;
+};
+
+// Orders the strings by their flip mask, the diagonal ones (zero mask) first, and by their sign mask within a group.
+// Strings which are identical as operators are merged, those which cancel out are dropped.
+std::vector<CompiledString> merge_compiled_strings(std::vector<CompiledString> strings) {
+    std::stable_sort(strings.begin(), strings.end(), [](const CompiledString& a, const CompiledString& b) {
+        return a.flip_mask < b.flip_mask || (a.flip_mask == b.flip_mask && a.sign_mask < b.sign_mask);
+    });
+
+    std::vector<CompiledString> result;
+    for(const auto& string : strings) {
+        if(
+            !result.empty() &&
+            string.flip_mask == result.back().flip_mask &&
+            string.sign_mask == result.back().sign_mask
+        ) {
+            result.back().coefficient += string.coefficient;
+        }
+        else {
+            result.push_back(string);
+        }
+    }
+
+    result.erase(
+        std::remove_if(result.begin(), result.end(), [](const CompiledString& string) {
+            return string.coefficient == 0.0;
+        }),
+        result.end()
+    );
+
+    return result;
+}
+
+} // namespace
+
+void Operator::compile_to_masks(
+    std::vector<std::complex<double>>&  compiled_coefficients,
+    std::vector<Spins::type>&           flip_masks,
+    std::vector<Spins::type>&           sign_masks
+) const {
+    const auto num_table_elements = this->num_strings * this->max_string_length;
+
+    std::vector<std::complex<double>> coefficients(this->num_strings);
+    std::vector<PauliMatrices> pauli_types(num_table_elements);
+    std::vector<int> pauli_indices(num_table_elements);
+    this->copy_to_host(coefficients.data(), pauli_types.data(), pauli_indices.data());
+
+    compiled_coefficients.resize(this->num_strings);
+    flip_masks.resize(this->num_strings);
+    sign_masks.resize(this->num_strings);
+
+    for(auto n = 0u; n < this->num_strings; n++) {
+        auto coefficient = coefficients[n];
+        Spins::type flip_mask = 0u;
+        Spins::type sign_mask = 0u;
+
+        for(auto table_index = n * this->max_string_length; table_index < (n + 1u) * this->max_string_length; table_index++) {
+            const auto pauli_index = pauli_indices[table_index];
+            if(pauli_index == -1) {
+                break;
+            }
+
+            if(pauli_index >= (int)MAX_SPINS) {
+                throw invalid_argument("Pauli index " + to_string(pauli_index) + " exceeds MAX_SPINS");
+            }
+
+            // Y and Z see the spin as left by the preceding symbols, i.e. flipped if the site has been flipped.
+            const auto site = (Spins::type)1u << pauli_index;
+            const auto pauli_type = pauli_types[table_index];
+            if(pauli_type == PauliMatrices::SigmaY || pauli_type == PauliMatrices::SigmaZ) {
+                sign_mask ^= site;
+                if(flip_mask & site) {
+                    coefficient = -coefficient;
+                }
+            }
+            if(pauli_type == PauliMatrices::SigmaX || pauli_type == PauliMatrices::SigmaY) {
+                flip_mask ^= site;
+            }
+            if(pauli_type == PauliMatrices::SigmaY) {
+                coefficient *= std::complex<double>(0.0, -1.0);
+            }
+        }
+
+        // A spin contributes -1 to the sign if it is down, i.e. if its bit is not set.
+        // The sign is evaluated from the set bits, hence the number of sites is accounted for here.
+        if(bit_parity(sign_mask)) {
+            coefficient = -coefficient;
+        }
+
+        compiled_coefficients[n] = coefficient;
+        flip_masks[n] = flip_mask;
+        sign_masks[n] = sign_mask;
+    }
+}
+
+void Operator::compile_strings() {
+    this->jit_group_coefficient = nullptr;
+
+    std::vector<std::complex<double>> string_coefficients;
+    std::vector<Spins::type> flip_masks;
+    std::vector<Spins::type> string_sign_masks;
+    this->compile_to_masks(string_coefficients, flip_masks, string_sign_masks);
+
+    const auto quadratic = this->compile_quadratic_form(string_coefficients, flip_masks, string_sign_masks);
+
+    // group the remaining strings by their flip mask
+    std::vector<CompiledString> strings;
+    for(auto n = 0u; n < this->num_strings; n++) {
+        if(!quadratic[n]) {
+            strings.push_back({flip_masks[n], string_sign_masks[n], string_coefficients[n]});
+        }
+    }
+    strings = merge_compiled_strings(strings);
+
+    this->num_compiled_strings = strings.size();
+
+    std::vector<std::complex<double>> compiled_coefficients(this->num_compiled_strings);
+    std::vector<Spins::type> sign_masks(this->num_compiled_strings);
+    std::vector<unsigned int> group_begin;
+    std::vector<Spins::type> group_flip_masks;
+
+    if(this->quadratic_form.N > 0u) {
+        // the quadratic form is added to the diagonal group, hence there has to be one
+        group_begin.push_back(0u);
+        group_flip_masks.push_back(0u);
+    }
+
+    for(auto n = 0u; n < this->num_compiled_strings; n++) {
+        if(group_flip_masks.empty() || strings[n].flip_mask != group_flip_masks.back()) {
+            group_begin.push_back(n);
+            group_flip_masks.push_back(strings[n].flip_mask);
+        }
+
+        compiled_coefficients[n] = strings[n].coefficient;
+        sign_masks[n] = strings[n].sign_mask;
+    }
+    group_begin.push_back(this->num_compiled_strings);
+
+    this->num_groups = group_flip_masks.size();
+
+    MALLOC(this->group_begin, sizeof(unsigned int) * (this->num_groups + 1u), this->gpu);
+    MALLOC(this->group_flip_masks, sizeof(Spins::type) * this->num_groups, this->gpu);
+    MALLOC(this->compiled_coefficients, sizeof(complex_t) * this->num_compiled_strings, this->gpu);
+    MALLOC(this->sign_masks, sizeof(Spins::type) * this->num_compiled_strings, this->gpu);
+
+    MEMCPY(this->group_begin, group_begin.data(), sizeof(unsigned int) * (this->num_groups + 1u), this->gpu, false);
+    MEMCPY(this->group_flip_masks, group_flip_masks.data(), sizeof(Spins::type) * this->num_groups, this->gpu, false);
+    MEMCPY(this->compiled_coefficients, compiled_coefficients.data(), sizeof(complex_t) * this->num_compiled_strings, this->gpu, false);
+    MEMCPY(this->sign_masks, sign_masks.data(), sizeof(Spins::type) * this->num_compiled_strings, this->gpu, false);
+
+    // adjacency of the diagonal group
+    const auto num_diagonal_strings = (
+        this->num_groups > 0u && group_flip_masks[0] == 0u ? group_begin[1] : 0u
+    );
+
+    Spins::type diagonal_sites = 0u;
+    for(auto n = 0u; n < num_diagonal_strings; n++) {
+        diagonal_sites |= sign_masks[n];
+    }
+    this->num_sites = 0u;
+    while(this->num_sites < 64u && (diagonal_sites >> this->num_sites) != 0u) {
+        this->num_sites++;
+    }
+
+    std::vector<unsigned int> site_begin;
+    std::vector<unsigned int> site_strings;
+    for(auto site = 0u; site < this->num_sites; site++) {
+        site_begin.push_back(site_strings.size());
+        for(auto n = 0u; n < num_diagonal_strings; n++) {
+            if(sign_masks[n] & ((Spins::type)1u << site)) {
+                site_strings.push_back(n);
+            }
+        }
+    }
+    site_begin.push_back(site_strings.size());
+
+    MALLOC(this->site_begin, sizeof(unsigned int) * site_begin.size(), this->gpu);
+    MALLOC(this->site_strings, sizeof(unsigned int) * site_strings.size(), this->gpu);
+
+    MEMCPY(this->site_begin, site_begin.data(), sizeof(unsigned int) * site_begin.size(), this->gpu, false);
+    MEMCPY(this->site_strings, site_strings.data(), sizeof(unsigned int) * site_strings.size(), this->gpu, false);
 }
 
 void Operator::copy_to_host(
@@ -82,10 +279,178 @@ void Operator::copy_to_host(
     MEMCPY_TO_HOST(pauli_indices, this->pauli_indices, sizeof(int) * num_table_elements, this->gpu);
 }
 
+std::vector<bool> Operator::compile_quadratic_form(
+    const std::vector<std::complex<double>>&    compiled_coefficients,
+    const std::vector<Spins::type>&             flip_masks,
+    const std::vector<Spins::type>&             sign_masks
+) {
+    this->quadratic_form.N = 0u;
+    this->quadratic_form.translation_invariant = false;
+    this->quadratic_form.data = nullptr;
+
+    std::vector<bool> result(this->num_strings, false);
+
+    // the sites the operator acts on
+    Spins::type sites = 0u;
+    for(auto n = 0u; n < this->num_strings; n++) {
+        sites |= flip_masks[n] | sign_masks[n];
+    }
+    auto N = 0u;
+    while(N < 64u && (sites >> N) != 0u) {
+        N++;
+    }
+
+    std::vector<std::complex<double>> fields(N);
+    std::vector<std::complex<double>> couplings(N * N);
+    auto num_pairs = 0u;
+
+    // Z and ZZ strings
+    for(auto n = 0u; n < this->num_strings; n++) {
+        const auto num_sites = bit_count(sign_masks[n]);
+        if(flip_masks[n] != 0u || num_sites == 0u || num_sites > 2u) {
+            continue;
+        }
+
+        // undo the sign of the down spins, which the form accounts for by itself
+        const auto coefficient = num_sites == 1u ? -compiled_coefficients[n] : compiled_coefficients[n];
+
+        const auto i = lowest_set_bit(sign_masks[n]);
+        if(num_sites == 1u) {
+            fields[i] += coefficient;
+        }
+        else {
+            const auto j = lowest_set_bit(sign_masks[n] & (sign_masks[n] - 1u));
+            couplings[i * N + j] += coefficient;
+            couplings[j * N + i] += coefficient;
+            num_pairs++;
+        }
+        result[n] = true;
+    }
+
+    auto translation_invariant = N > 2u;
+    for(auto i = 0u; i < N && translation_invariant; i++) {
+        for(auto j = 0u; j < N; j++) {
+            if(i != j && abs(couplings[i * N + j] - couplings[(j + N - i) % N]) > 1e-14 * (1.0 + abs(couplings[i * N + j]))) {
+                translation_invariant = false;
+                break;
+            }
+        }
+    }
+
+    // The form is evaluated in O(N) if translation invariant and in about N^2 / 4 steps otherwise.
+    // Below that many pairs the strings themselves are cheaper.
+    if(num_pairs == 0u || num_pairs < (translation_invariant ? N : N * N / 4u)) {
+        return std::vector<bool>(this->num_strings, false);
+    }
+
+    this->quadratic_form.N = N;
+    this->quadratic_form.translation_invariant = translation_invariant;
+
+    std::vector<std::complex<double>> data(fields);
+    if(translation_invariant) {
+        data.insert(data.end(), couplings.begin(), couplings.begin() + N);
+    }
+    else {
+        data.insert(data.end(), couplings.begin(), couplings.end());
+        for(auto i = 0u; i < N; i++) {
+            std::complex<double> upper_row_sum = 0.0;
+            for(auto j = i + 1u; j < N; j++) {
+                upper_row_sum += couplings[i * N + j];
+            }
+            data.push_back(upper_row_sum);
+        }
+    }
+
+    MALLOC(this->quadratic_form.data, sizeof(complex_t) * data.size(), this->gpu);
+    MEMCPY(this->quadratic_form.data, data.data(), sizeof(complex_t) * data.size(), this->gpu, false);
+
+    return result;
+}
+
+Operator Operator::compress(const double tolerance, CompressionReport& report) const {
+    std::vector<std::complex<double>> coefficients;
+    std::vector<Spins::type> flip_masks;
+    std::vector<Spins::type> sign_masks;
+    this->compile_to_masks(coefficients, flip_masks, sign_masks);
+
+    std::vector<CompiledString> strings;
+    for(auto n = 0u; n < this->num_strings; n++) {
+        strings.push_back({flip_masks[n], sign_masks[n], coefficients[n]});
+    }
+    strings = merge_compiled_strings(strings);
+
+    report.num_strings = this->num_strings;
+    report.num_merged_strings = strings.size();
+
+    // Every Pauli string has unit norm, hence the dropped coefficients bound the norm of the error.
+    auto max_coefficient = 0.0;
+    auto sum_coefficients = 0.0;
+    for(const auto& string : strings) {
+        max_coefficient = max(max_coefficient, abs(string.coefficient));
+        sum_coefficients += abs(string.coefficient);
+    }
+
+    report.error_bound = 0.0;
+    std::vector<CompiledString> kept_strings;
+    for(const auto& string : strings) {
+        if(abs(string.coefficient) < tolerance * max_coefficient) {
+            report.error_bound += abs(string.coefficient);
+        }
+        else {
+            kept_strings.push_back(string);
+        }
+    }
+    report.num_compressed_strings = kept_strings.size();
+    report.relative_error_bound = sum_coefficients > 0.0 ? report.error_bound / sum_coefficients : 0.0;
+
+    // Back to Pauli strings with one symbol per site in ascending order: X and Y flip, Y and Z carry a sign.
+    std::vector<std::complex<double>> result_coefficients;
+    std::vector<std::vector<PauliMatrices>> result_types;
+    std::vector<std::vector<unsigned int>> result_indices;
+
+    for(const auto& string : kept_strings) {
+        auto coefficient = bit_parity(string.sign_mask) ? -string.coefficient : string.coefficient;
+        std::vector<PauliMatrices> types;
+        std::vector<unsigned int> indices;
+
+        for(auto remaining = string.flip_mask | string.sign_mask; remaining != 0u; remaining &= remaining - 1u) {
+            const auto site_index = lowest_set_bit(remaining);
+            const auto site = (Spins::type)1u << site_index;
+
+            if((string.flip_mask & site) && (string.sign_mask & site)) {
+                types.push_back(PauliMatrices::SigmaY);
+                coefficient *= std::complex<double>(0.0, 1.0);
+            }
+            else if(string.flip_mask & site) {
+                types.push_back(PauliMatrices::SigmaX);
+            }
+            else {
+                types.push_back(PauliMatrices::SigmaZ);
+            }
+            indices.push_back(site_index);
+        }
+
+        result_coefficients.push_back(coefficient);
+        result_types.push_back(types);
+        result_indices.push_back(indices);
+    }
+
+    return Operator(result_coefficients, result_types, result_indices, this->gpu);
+}
+
 Operator::~Operator() noexcept(false) {
+    this->disable_jit();
+
     FREE(this->coefficients, this->gpu);
     FREE(this->pauli_types, this->gpu);
     FREE(this->pauli_indices, this->gpu);
+    FREE(this->group_begin, this->gpu);
+    FREE(this->group_flip_masks, this->gpu);
+    FREE(this->compiled_coefficients, this->gpu);
+    FREE(this->sign_masks, this->gpu);
+    FREE(this->quadratic_form.data, this->gpu);
+    FREE(this->site_begin, this->gpu);
+    FREE(this->site_strings, this->gpu);
 }
 
 void Operator::get_coefficients(complex<double>* coefficients) const {
@@ -0,0 +1,239 @@
+#include "operator/Operator.hpp"
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <string>
+
+
+namespace rbm_on_gpu {
+
+namespace {
+
+constexpr auto jit_symbol = "rbm_on_gpu_group_coefficient";
+
+
+uint64_t fnv1a_hash(const std::string& text) {
+    uint64_t result = 14695981039346656037ull;
+    for(const auto c : text) {
+        result ^= static_cast<unsigned char>(c);
+        result *= 1099511628211ull;
+    }
+    return result;
+}
+
+std::string environment(const char* name, const std::string& fallback) {
+    const auto value = std::getenv(name);
+    return value != nullptr && value[0] != '\0' ? std::string(value) : fallback;
+}
+
+bool make_directories(const std::string& path) {
+    for(auto end = path.find('/', 1u); ; end = path.find('/', end + 1u)) {
+        const auto prefix = path.substr(0u, end);
+        if(mkdir(prefix.c_str(), 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if(end == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+// Whether 'path' is a directory or a regular file (no symbolic link) owned by the current user and not writable by
+// anybody else. Otherwise, others could plant a library which is then loaded into this process.
+bool is_private(const std::string& path, const bool directory) {
+    struct stat status;
+    if(lstat(path.c_str(), &status) != 0) {
+        return false;
+    }
+    if(directory ? !S_ISDIR(status.st_mode) : !S_ISREG(status.st_mode)) {
+        return false;
+    }
+
+    return status.st_uid == getuid() && (status.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool read_file(const std::string& path, std::string& content) {
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        return false;
+    }
+
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+
+    return !file.bad();
+}
+
+std::string default_cache_directory() {
+    const auto home = environment("HOME", "");
+    return environment(
+        "RBM_ON_GPU_JIT_CACHE",
+        home.empty() ? "/tmp/rbm_on_gpu-" + std::to_string(getuid()) : home + "/.cache/rbm_on_gpu"
+    );
+}
+
+std::string quote(const std::string& path) {
+    std::string result = "'";
+    for(const auto c : path) {
+        if(c == '\'') {
+            result += "'\\''";
+        }
+        else {
+            result += c;
+        }
+    }
+    return result + "'";
+}
+
+} // namespace
+
+
+// One case per group, each string unrolled with its sign mask and coefficient as constants.
+std::string Operator::jit_source() const {
+    std::ostringstream source;
+    source << std::setprecision(17);
+
+    source << "// generated by rbm_on_gpu::Operator::enable_jit()\n";
+    source << "#include <cstdint>\n\n";
+    source << "extern \"C\" void " << jit_symbol << "(const std::uint64_t s, const unsigned int group, double* result) {\n";
+    source << "    double re = 0.0;\n";
+    source << "    double im = 0.0;\n\n";
+    source << "    switch(group) {\n";
+
+    for(auto group = 0u; group < this->num_groups; group++) {
+        source << "    case " << group << "u:\n";
+
+        for(auto n = this->group_begin[group]; n < this->group_begin[group + 1u]; n++) {
+            const auto coefficient = this->compiled_coefficients[n];
+            const auto sign_mask = static_cast<uint64_t>(this->sign_masks[n]);
+
+            if(sign_mask == 0u) {
+                source << "        re += " << coefficient.real() << ";";
+                if(coefficient.imag() != 0.0) {
+                    source << " im += " << coefficient.imag() << ";";
+                }
+                source << "\n";
+                continue;
+            }
+
+            source << "        {\n";
+            source << "            const double sign = __builtin_parityll(s & 0x" << std::hex << sign_mask << std::dec
+                   << "ull) ? -1.0 : 1.0;\n";
+            source << "            re += sign * " << coefficient.real() << ";\n";
+            if(coefficient.imag() != 0.0) {
+                source << "            im += sign * " << coefficient.imag() << ";\n";
+            }
+            source << "        }\n";
+        }
+
+        source << "        break;\n";
+    }
+
+    source << "    }\n\n";
+    source << "    result[0] = re;\n";
+    source << "    result[1] = im;\n";
+    source << "}\n";
+
+    return source.str();
+}
+
+bool Operator::enable_jit(const std::string& cache_directory) {
+    if(this->gpu) {
+        // the generated code runs on the host only
+        return false;
+    }
+    if(this->jit_library != nullptr) {
+        return true;
+    }
+
+    const auto compiler = environment("RBM_ON_GPU_JIT_CXX", environment("CXX", "c++"));
+    const auto flags = std::string("-O2 -shared -fPIC -std=c++11");
+    // the build command is part of the source, such that it takes part in the hash and in the comparison below
+    const auto source = "// " + compiler + " " + flags + "\n" + this->jit_source();
+
+    std::ostringstream name;
+    name << "operator_" << std::hex << std::setw(16) << std::setfill('0') << fnv1a_hash(source);
+
+    const auto directory = cache_directory.empty() ? default_cache_directory() : cache_directory;
+    if(!make_directories(directory) || !is_private(directory, true)) {
+        return false;
+    }
+
+    // The source is stored next to the library. As the hash is not cryptographic, a cached library is only taken
+    // if its source is identical to the current one.
+    const auto library_path = directory + "/" + name.str() + ".so";
+    const auto cached_source_path = directory + "/" + name.str() + ".cpp";
+
+    std::string cached_source;
+    if(
+        is_private(library_path, false) && is_private(cached_source_path, false) &&
+        read_file(cached_source_path, cached_source) && cached_source == source &&
+        this->load_jit_library(library_path)
+    ) {
+        return true;
+    }
+
+    // build under a private name and rename, such that concurrent processes never load a partially written file
+    const auto unique = directory + "/" + name.str() + "." + std::to_string(getpid());
+    const auto source_path = unique + ".cpp";
+    const auto temporary_path = unique + ".so";
+
+    auto file = std::fopen(source_path.c_str(), "w");
+    if(file == nullptr) {
+        return false;
+    }
+    const auto written = std::fwrite(source.data(), 1u, source.size(), file) == source.size();
+    std::fclose(file);
+
+    const auto command = (
+        compiler + " " + flags + " " + quote(source_path) + " -o " + quote(temporary_path) + " > /dev/null 2>&1"
+    );
+    const auto compiled = written && std::system(command.c_str()) == 0;
+
+    if(
+        !compiled ||
+        std::rename(source_path.c_str(), cached_source_path.c_str()) != 0 ||
+        std::rename(temporary_path.c_str(), library_path.c_str()) != 0
+    ) {
+        std::remove(source_path.c_str());
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+
+    return this->load_jit_library(library_path);
+}
+
+bool Operator::load_jit_library(const std::string& path) {
+    const auto handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(handle == nullptr) {
+        return false;
+    }
+    std::shared_ptr<void> library(handle, dlclose);
+
+    const auto function = reinterpret_cast<JitGroupCoefficient>(dlsym(handle, jit_symbol));
+    if(function == nullptr) {
+        return false;
+    }
+
+    this->jit_library = library;
+    this->jit_group_coefficient = function;
+
+    return true;
+}
+
+void Operator::disable_jit() {
+    this->jit_group_coefficient = nullptr;
+    this->jit_library.reset();
+}
+
+} // namespace rbm_on_gpu
@@ -0,0 +1,187 @@
+#include "operator/OperatorProduct.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <string>
+
+
+namespace rbm_on_gpu {
+
+OperatorProduct::OperatorProduct(const std::vector<Operator>& operators, const bool gpu)
+    : gpu(gpu), operators(operators)
+{
+    if(operators.empty()) {
+        throw invalid_argument("a product needs at least one factor");
+    }
+    for(const auto& operator_ : operators) {
+        if(operator_.gpu != gpu) {
+            throw invalid_argument("all factors of a product have to reside on the same device as the product");
+        }
+    }
+
+    this->num_factors = operators.size();
+
+    // the distinct flip masks after each factor, starting with s itself
+    std::vector<unsigned int> num_masks = {1u};
+    std::vector<Spins::type> masks = {0u};
+
+    std::vector<unsigned int> transition_begin;
+    std::vector<unsigned int> transition_source;
+    std::vector<Spins::type> transition_source_mask;
+    std::vector<unsigned int> transition_group;
+    std::vector<unsigned int> transition_target;
+
+    std::vector<unsigned int> final_begin;
+
+    for(auto k = 0u; k < this->num_factors; k++) {
+        const auto& operator_ = operators[k];
+        const auto last = k + 1u == this->num_factors;
+
+        std::vector<Spins::type> group_flip_masks(operator_.num_groups);
+        MEMCPY_TO_HOST(group_flip_masks.data(), operator_.group_flip_masks, sizeof(Spins::type) * operator_.num_groups, operator_.gpu);
+
+        std::vector<Spins::type> next_masks;
+        std::unordered_map<Spins::type, unsigned int> next_mask_index;
+
+        struct Transition {
+            unsigned int source;
+            unsigned int group;
+            unsigned int target;
+        };
+        std::vector<Transition> transitions;
+
+        for(auto source = 0u; source < masks.size(); source++) {
+            for(auto group = 0u; group < operator_.num_groups; group++) {
+                const auto mask = masks[source] ^ group_flip_masks[group];
+
+                const auto inserted = next_mask_index.emplace(mask, next_masks.size());
+                if(inserted.second) {
+                    next_masks.push_back(mask);
+                }
+
+                transitions.push_back({source, group, inserted.first->second});
+            }
+        }
+
+        if(last) {
+            std::stable_sort(transitions.begin(), transitions.end(), [](const Transition& a, const Transition& b) {
+                return a.target < b.target;
+            });
+        }
+
+        transition_begin.push_back(transition_source.size());
+        for(const auto& transition : transitions) {
+            if(last && (final_begin.empty() || transition.target != transition_target.back())) {
+                final_begin.push_back(transition_source.size());
+            }
+
+            transition_source.push_back(transition.source);
+            transition_source_mask.push_back(masks[transition.source]);
+            transition_group.push_back(transition.group);
+            transition_target.push_back(transition.target);
+        }
+
+        if(!last && next_masks.size() > max_configurations) {
+            throw invalid_argument(
+                "the product connects a configuration to " + to_string(next_masks.size()) +
+                " configurations after " + to_string(num_masks.size()) + " factors, at most " +
+                to_string(max_configurations) + " are supported"
+            );
+        }
+
+        num_masks.push_back(next_masks.size());
+        masks = next_masks;
+    }
+    transition_begin.push_back(transition_source.size());
+    final_begin.push_back(transition_source.size());
+
+    this->num_transitions = transition_source.size();
+    this->num_final_masks = masks.size();
+    this->max_masks = *std::max_element(num_masks.begin(), num_masks.end() - 1);
+
+    this->allocate_memory_and_initialize(
+        num_masks.data(),
+        transition_begin.data(),
+        transition_source.data(),
+        transition_source_mask.data(),
+        transition_group.data(),
+        transition_target.data(),
+        masks.data(),
+        final_begin.data(),
+        false
+    );
+}
+
+OperatorProduct::OperatorProduct(const OperatorProduct& other)
+    : gpu(other.gpu), operators(other.operators)
+{
+    this->num_factors = other.num_factors;
+    this->num_transitions = other.num_transitions;
+    this->num_final_masks = other.num_final_masks;
+    this->max_masks = other.max_masks;
+
+    this->allocate_memory_and_initialize(
+        other.num_masks,
+        other.transition_begin,
+        other.transition_source,
+        other.transition_source_mask,
+        other.transition_group,
+        other.transition_target,
+        other.final_flip_masks,
+        other.final_begin,
+        other.gpu
+    );
+}
+
+void OperatorProduct::allocate_memory_and_initialize(
+    const unsigned int* num_masks,
+    const unsigned int* transition_begin,
+    const unsigned int* transition_source,
+    const Spins::type*  transition_source_mask,
+    const unsigned int* transition_group,
+    const unsigned int* transition_target,
+    const Spins::type*  final_flip_masks,
+    const unsigned int* final_begin,
+    const bool          pointers_on_gpu
+) {
+    std::vector<kernel::Operator> factors;
+    for(const auto& operator_ : this->operators) {
+        factors.push_back(operator_.get_kernel());
+    }
+
+    MALLOC(this->factors, sizeof(kernel::Operator) * this->num_factors, this->gpu);
+    MALLOC(this->num_masks, sizeof(unsigned int) * (this->num_factors + 1u), this->gpu);
+    MALLOC(this->transition_begin, sizeof(unsigned int) * (this->num_factors + 1u), this->gpu);
+    MALLOC(this->transition_source, sizeof(unsigned int) * this->num_transitions, this->gpu);
+    MALLOC(this->transition_source_mask, sizeof(Spins::type) * this->num_transitions, this->gpu);
+    MALLOC(this->transition_group, sizeof(unsigned int) * this->num_transitions, this->gpu);
+    MALLOC(this->transition_target, sizeof(unsigned int) * this->num_transitions, this->gpu);
+    MALLOC(this->final_flip_masks, sizeof(Spins::type) * this->num_final_masks, this->gpu);
+    MALLOC(this->final_begin, sizeof(unsigned int) * (this->num_final_masks + 1u), this->gpu);
+
+    MEMCPY(this->factors, factors.data(), sizeof(kernel::Operator) * this->num_factors, this->gpu, false);
+    MEMCPY(this->num_masks, num_masks, sizeof(unsigned int) * (this->num_factors + 1u), this->gpu, pointers_on_gpu);
+    MEMCPY(this->transition_begin, transition_begin, sizeof(unsigned int) * (this->num_factors + 1u), this->gpu, pointers_on_gpu);
+    MEMCPY(this->transition_source, transition_source, sizeof(unsigned int) * this->num_transitions, this->gpu, pointers_on_gpu);
+    MEMCPY(this->transition_source_mask, transition_source_mask, sizeof(Spins::type) * this->num_transitions, this->gpu, pointers_on_gpu);
+    MEMCPY(this->transition_group, transition_group, sizeof(unsigned int) * this->num_transitions, this->gpu, pointers_on_gpu);
+    MEMCPY(this->transition_target, transition_target, sizeof(unsigned int) * this->num_transitions, this->gpu, pointers_on_gpu);
+    MEMCPY(this->final_flip_masks, final_flip_masks, sizeof(Spins::type) * this->num_final_masks, this->gpu, pointers_on_gpu);
+    MEMCPY(this->final_begin, final_begin, sizeof(unsigned int) * (this->num_final_masks + 1u), this->gpu, pointers_on_gpu);
+}
+
+OperatorProduct::~OperatorProduct() noexcept(false) {
+    FREE(this->factors, this->gpu);
+    FREE(this->num_masks, this->gpu);
+    FREE(this->transition_begin, this->gpu);
+    FREE(this->transition_source, this->gpu);
+    FREE(this->transition_source_mask, this->gpu);
+    FREE(this->transition_group, this->gpu);
+    FREE(this->transition_target, this->gpu);
+    FREE(this->final_flip_masks, this->gpu);
+    FREE(this->final_begin, this->gpu);
+}
+
+} // namespace rbm_on_gpu
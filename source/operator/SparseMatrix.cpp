@@ -0,0 +1,104 @@
+#include "operator/SparseMatrix.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <string>
+
+
+using namespace std;
+
+namespace rbm_on_gpu {
+
+SparseMatrix sparse_matrix(const Operator& operator_, const SpinBasis& basis, unsigned int num_threads) {
+    if(operator_.gpu) {
+        // the rows are built on the host
+        return sparse_matrix(Operator(operator_.to_expr(), false), basis, num_threads);
+    }
+    if(basis.size() > (uint64_t)numeric_limits<int32_t>::max()) {
+        throw invalid_argument("the basis has " + to_string(basis.size()) + " states, which exceeds 32 bit column indices");
+    }
+
+    const auto kernel = operator_.get_kernel();
+
+    Spins::type sites = kernel.quadratic_form.N > 0u ? kernel.quadratic_form.all_sites() : 0u;
+    for(auto group = 0u; group < kernel.num_groups; group++) {
+        sites |= kernel.group_flip_masks[group];
+    }
+    for(auto n = 0u; n < kernel.num_compiled_strings; n++) {
+        sites |= kernel.sign_masks[n];
+    }
+    if((sites >> basis.N) != 0u) {
+        throw invalid_argument("the operator acts on more than " + to_string(basis.N) + " sites");
+    }
+
+    SparseMatrix result;
+    result.dimension = basis.size();
+    result.indptr.assign(result.dimension + 1u, 0);
+
+    num_threads = basis.get_num_threads(num_threads);
+
+    struct Chunk {
+        vector<int32_t>             indices;
+        vector<complex<double>>     data;
+    };
+    vector<Chunk> chunks(num_threads);
+
+    basis.foreach_chunk(num_threads, [&](const unsigned int thread_idx, const uint64_t begin, const uint64_t end) {
+        auto& chunk = chunks[thread_idx];
+
+        vector<pair<int32_t, complex<double>>> row;
+        row.reserve(kernel.num_groups);
+
+        auto configuration = basis.state(begin);
+        for(auto index = begin; index < end; index++) {
+            if(index > begin) {
+                configuration = basis.next(configuration);
+            }
+
+            row.clear();
+            for(auto group = 0u; group < kernel.num_groups; group++) {
+                const auto configuration_prime = configuration ^ kernel.group_flip_masks[group];
+                if(!basis.contains(configuration_prime)) {
+                    continue;
+                }
+
+                const auto coefficient = kernel.group_coefficient(Spins(configuration), group);
+                if(coefficient.real() != 0.0 || coefficient.imag() != 0.0) {
+                    row.push_back({(int32_t)basis.index(configuration_prime), coefficient.to_std()});
+                }
+            }
+
+            // distinct groups flip distinct sites, hence there are no duplicate columns
+            sort(row.begin(), row.end(), [](const pair<int32_t, complex<double>>& a, const pair<int32_t, complex<double>>& b) {
+                return a.first < b.first;
+            });
+
+            for(const auto& element : row) {
+                chunk.indices.push_back(element.first);
+                chunk.data.push_back(element.second);
+            }
+            result.indptr[index + 1u] = row.size();
+        }
+    });
+
+    for(auto index = uint64_t(0u); index < result.dimension; index++) {
+        result.indptr[index + 1u] += result.indptr[index];
+    }
+
+    result.indices.resize(result.indptr.back());
+    result.data.resize(result.indptr.back());
+
+    basis.foreach_chunk(num_threads, [&](const unsigned int thread_idx, const uint64_t begin, const uint64_t end) {
+        auto& chunk = chunks[thread_idx];
+
+        copy(chunk.indices.begin(), chunk.indices.end(), result.indices.begin() + result.indptr[begin]);
+        copy(chunk.data.begin(), chunk.data.end(), result.data.begin() + result.indptr[begin]);
+
+        chunk = Chunk();
+    });
+
+    return result;
+}
+
+} // namespace rbm_on_gpu
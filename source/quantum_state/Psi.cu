@@ -13,11 +13,14 @@
 namespace rbm_on_gpu {
 
 Psi::Psi(const unsigned int N, const unsigned int M, const int seed, const double noise, const bool free_quantum_axis, const bool gpu)
-  : alpha_array(N, false), beta_array(N, false), b_array(M, gpu), W_array(N * M, gpu), free_quantum_axis(free_quantum_axis), gpu(gpu) {
+  : params(make_shared<Array<complex_t>>(2 * N + M + N * M, gpu)), free_quantum_axis(free_quantum_axis), gpu(gpu) {
     this->N = N;
     this->M = M;
     this->prefactor = 1.0;
-    this->num_params = N + M + N * M;
+    this->num_params = 2 * N + M + N * M;
+    this->O_k_length = M + N * M;
+
+    this->update_kernel();
 
     std::mt19937 rng(seed);
     std::uniform_real_distribution<double> random_real(-1.0, 1.0);
@@ -26,8 +29,8 @@ Psi::Psi(const unsigned int N, const unsigned int M, const int seed, const doubl
         this->b_array[j] = complex_t(noise * random_real(rng), noise * random_real(rng));
     }
     for(auto i = 0u; i < N; i++) {
-        this->alpha_array[i] = 0.0;
-        this->beta_array[i] = 0.0;
+        (*this->params)[i] = complex_t(0.0, 0.0);
+        (*this->params)[N + i] = complex_t(0.0, 0.0);
 
         for(auto j = 0u; j < M; j++) {
             const auto idx = j * N + i;
@@ -38,31 +41,74 @@ Psi::Psi(const unsigned int N, const unsigned int M, const int seed, const doubl
         }
     }
 
-    this->b_array.update_device();
-    this->W_array.update_device();
-
-    this->update_kernel();
+    this->update_params();
 }
 
 Psi::Psi(const Psi& other)
     :
+    kernel::Psi(other),
+    params(other.params),
     alpha_array(other.alpha_array),
     beta_array(other.beta_array),
     b_array(other.b_array),
     W_array(other.W_array),
     free_quantum_axis(other.free_quantum_axis),
     gpu(other.gpu) {
-    this->N = other.N;
-    this->M = other.M;
-    this->prefactor = other.prefactor;
-    this->num_params = other.num_params;
+    // the parameters are shared, unless 'other' has handed out a writable reference to them.
+    if(!this->params.shares_payload_with(other.params)) {
+        this->update_kernel();
+    }
+}
+
+Psi::Psi(const NetworkFile& file, const bool gpu)
+  : params(make_shared<Array<complex_t>>(file.num_params(), gpu)), free_quantum_axis(file.free_quantum_axis()), gpu(gpu) {
+    file.expect_type(NetworkType::Psi);
+
+    TopologyReader topology(file);
+
+    this->N = file.header().N;
+    this->M = topology.read();
+    this->prefactor = file.header().prefactor;
+    this->num_params = 2 * N + M + N * M;
+    this->O_k_length = M + N * M;
+
+    if(file.num_params() != this->num_params) {
+        throw runtime_error(
+            "the network file holds " + to_string(file.num_params()) +
+            " parameters, but the network has " + to_string(this->num_params)
+        );
+    }
 
     this->update_kernel();
+
+    memcpy(this->params->host_data(), file.params(), sizeof(complex_t) * this->num_params);
+    this->update_params();
+}
+
+void Psi::save(const string& file_name) const {
+    NetworkFile::write(
+        file_name,
+        NetworkType::Psi,
+        this->N,
+        this->free_quantum_axis ? NetworkFileHeader::flag_free_quantum_axis : 0u,
+        this->prefactor,
+        log(this->prefactor),
+        {this->M},
+        reinterpret_cast<const complex<double>*>(this->params->host_data()),
+        this->num_params
+    );
 }
 
 void Psi::update_kernel() {
-    this->b = this->b_array.data();
-    this->W = this->W_array.data();
+    auto host_params = this->params->host_data();
+
+    this->alpha_array = RealArrayView(host_params, this->N);
+    this->beta_array = RealArrayView(host_params + this->N, this->N);
+    this->b_array = ArrayView<complex_t>(host_params + 2 * this->N, this->M);
+    this->W_array = ArrayView<complex_t>(host_params + 2 * this->N + this->M, this->N * this->M);
+
+    this->b = this->params->data() + 2 * this->N;
+    this->W = this->params->data() + 2 * this->N + this->M;
 }
 
 void Psi::as_vector(complex<double>* result) const {
@@ -113,26 +159,36 @@ std::complex<double> Psi::log_psi_s_std(const Spins& spins) {
 }
 
 void Psi::get_params(complex<double>* result) const {
-    for(auto i = 0u; i < this->N; i++) {
-        result[i] = complex<double>(this->alpha_array[i], 0.0);
-        result[this->N + i] = complex<double>(this->beta_array[i], 0.0);
-    }
-    memcpy(result + 2 * this->N, this->b_array.host_data(), sizeof(complex_t) * this->M);
-    memcpy(result + 2 * this->N + this->M, this->W_array.host_data(), sizeof(complex_t) * this->N * this->M);
+    memcpy(result, this->params->host_data(), sizeof(complex_t) * this->num_params);
 }
 
 void Psi::set_params(const complex<double>* new_params) {
-    for(auto i = 0u; i < this->N; i++) {
-        this->alpha_array[i] = new_params[i].real();
-        this->beta_array[i] = new_params[this->N + i].real();
+    // 'new_params' may be the zero-copy view onto the parameter store itself.
+    if(reinterpret_cast<const complex_t*>(new_params) != this->params->host_data()) {
+        this->make_params_unique();
+        memcpy(this->params->host_data(), new_params, sizeof(complex_t) * this->num_params);
     }
-    memcpy(this->b_array.host_data(), new_params + 2 * this->N, sizeof(complex_t) * this->M);
-    memcpy(this->W_array.host_data(), new_params + 2 * this->N + this->M, sizeof(complex_t) * this->N * this->M);
 
-    this->b_array.update_device();
-    this->W_array.update_device();
+    this->update_params();
+}
 
-    this->update_kernel();
+void Psi::update_params() {
+    // All kernel pointers point into the parameter store, hence syncing the store is sufficient.
+    this->params->update_device();
+}
+
+void Psi::make_params_unique() {
+    if(this->params.make_unique()) {
+        this->update_kernel();
+    }
+}
+
+Array<complex_t>& Psi::pin_params() {
+    if(this->params.pin()) {
+        this->update_kernel();
+    }
+
+    return *this->params;
 }
 
 } // namespace rbm_on_gpu
@@ -5,31 +5,169 @@
 #include <cstdlib>
 #include <complex>
 #include <vector>
-#include <Eigen/Core> // Matrix and Array classes, basic linear algebra (including triangular and selfadjoint products), array manipulation
-#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
 
 using namespace std;
 
 namespace Peter {
 
 #define cdouble std::complex<double>
-cdouble I(0.0,1.0);
-int L=10;
-int H=1;
-vector< vector< vector<int> > > S;     // i,j -- coordinates of the plaquette, only k=2 is used
+const cdouble I(0.0,1.0);
 int const numberOfVarParametrsMax=300000; // before compression Stripe3Order (12321), Square 3Order (12160) // debug:
-int indexVP[numberOfVarParametrsMax][2] = {0}; // initialize with zeros
 
 int const numberOfVarParameters=4;
-Eigen::VectorXcd varW(numberOfVarParameters); // variational parameters
 
-rbm_on_gpu::PsiDeepMin* psi_neural = nullptr;
 
-void load_neural_network(string directory, int index) {
-    if(psi_neural) {
-        delete psi_neural;
+// Scratch of a single evaluation: the plaquette lattice, which is flipped back and forth
+// while the effective Hamiltonian is built up. The tables are only read.
+class Context {
+public:
+    const Tables& tables;
+    const int L;
+    const int H;
+
+    const uint64_t configuration;
+
+    int S[Tables::max_sites];     // i,j -- coordinates of the plaquette: S[i*L + j]
+
+    inline Context(const Tables& tables, const uint64_t configuration_)
+        : tables(tables), L(tables.L), H(tables.H), configuration(configuration_ & ((uint64_t(1) << tables.L) - 1u)) {
+        // the configuration holds a single chain, see load_tables()
+        if(H != 1) {
+            throw invalid_argument("the classical network expects a single chain, got " + to_string(H));
+        }
+
+        for (int x=0; x<L; x++) S[x] = 1 - 2 * !((this->configuration >> x) & 1u);
+    }
+
+    cdouble findHeffComplex();
+
+private:
+    cdouble psi_0_local(int i, int j, int fl)
+        {
+        cdouble psi_0_local_temp=1.0;
+
+        // the spins seen by the neural network are the first chain of plaquettes
+        psi_0_local_temp *= exp(tables.psi_neural->log_psi_s(S));
+        return psi_0_local_temp;
+        }
+
+    int FindOmega(int i, int j) //
+        {
+        int Omega = (S[i*L + (j+1)%L]+S[i*L + (j-1+L)%L])/2;  // = -1,0,1
+        return Omega;
+        }
+
+    void FlipPlaquette(int i, int j)
+        {
+        S[i*L + j] *= -1;
+        }
+
+    int if_Flippable(int i, int j)
+        {
+        return S[i*L + j];
+        }
+
+    cdouble Heff_plaquetteComplex(int i, int j);
+
+    // The chain with site j-1 at bit j, such that (result >> j) & 7 is the 3-bit index of plaquette j
+    // into the plaquette tables, including the periodic boundary.
+    inline uint64_t neighbourhoods() const
+        {
+        return (
+            (this->configuration << 1) |
+            ((this->configuration >> (L-1)) & 1u) |
+            ((this->configuration & 1u) << (L+1))
+        );
+        }
+};
+
+
+void PerfectHashIndex::build(const vector<pair<int, int>>& entries) {
+    // about four keys per bucket and at least as many slots as keys, both powers of two.
+    size_t num_buckets = 1u;
+    while(4u * num_buckets < entries.size()) {
+        num_buckets *= 2u;
+    }
+    size_t num_slots = 1u;
+    while(num_slots < entries.size()) {
+        num_slots *= 2u;
+    }
+
+    vector<vector<pair<int, int>>> buckets(num_buckets);
+    for(const auto& entry : entries) {
+        buckets[hash(uint64_t(entry.first)) & (num_buckets - 1u)].push_back(entry);
+    }
+
+    // the largest buckets are placed first, while there are still many free slots.
+    vector<size_t> order(num_buckets);
+    for(auto b = 0u; b < num_buckets; b++) {
+        order[b] = b;
+    }
+    stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    for(;; num_slots *= 2u) {
+        this->seeds.assign(num_buckets, 0u);
+        this->keys.assign(num_slots, -1);
+        this->values.assign(num_slots, 0);
+
+        auto success = true;
+        vector<size_t> slots;
+        for(const auto b : order) {
+            const auto& bucket = buckets[b];
+
+            auto placed = false;
+            for(uint32_t seed = 0u; seed < (1u << 16u) && !placed; seed++) {
+                slots.clear();
+                placed = true;
+
+                for(const auto& entry : bucket) {
+                    const auto slot = hash(hash(uint64_t(entry.first)) ^ seed) & (num_slots - 1u);
+                    if(this->keys[slot] != -1 || find(slots.begin(), slots.end(), slot) != slots.end()) {
+                        placed = false;
+                        break;
+                    }
+                    slots.push_back(slot);
+                }
+
+                if(placed) {
+                    this->seeds[b] = seed;
+                    for(auto k = 0u; k < bucket.size(); k++) {
+                        this->keys[slots[k]] = bucket[k].first;
+                        this->values[slots[k]] = bucket[k].second;
+                    }
+                }
+            }
+
+            if(!placed) {
+                success = false;
+                break;
+            }
+        }
+
+        if(success) {
+            return;
+        }
+    }
+}
+
+
+void load_neural_network(Tables& tables, const string& directory, const int index) {
+    // prefer the binary network file, see rbm_on_gpu::convert_to_network_file()
+    const auto file_name = directory + "/psi_" + to_string(index) + "_compressed";
+    tables.psi_neural = make_shared<const rbm_on_gpu::PsiDeepMin>(
+        rbm_on_gpu::NetworkFile::is_network_file(file_name + ".bin") ? file_name + ".bin" : file_name + ".txt"
+    );
+
+    if(int(tables.psi_neural->N) != tables.L) {
+        throw runtime_error(
+            "the neural network has " + to_string(tables.psi_neural->N) + " spins, expected " + to_string(tables.L)
+        );
     }
-    psi_neural = new rbm_on_gpu::PsiDeepMin(directory + "/psi_" + to_string(index) + "_compressed.txt");
 }
 
 
@@ -51,82 +189,174 @@ std::complex<double> Classical_wavefunction(std::vector<int> &S, std::vector<std
     }
 */
 
-void loadVP(std::string directory, int index, std::string ReIm) // two calls are necessary: LoadVP("Re",..,..); LoadVP("Im",..,..);
+void loadVP(Tables& tables, const string& directory, const int index, const string& ReIm) // two calls are necessary: LoadVP("Re",..,..); LoadVP("Im",..,..);
     {
     std::string filenamePos = directory + "/a_VP_" + to_string(index) + "_" + ReIm + ".csv";
 	std::ifstream filePos;
 	filePos.open (filenamePos.c_str());
+    if (!filePos) throw runtime_error("could not open '" + filenamePos + "'");
 
 	std::string temp;
 
-    for (int i=0; i<numberOfVarParameters; i++)
+    auto& varW = tables.varW;
+    varW.resize(numberOfVarParameters + 1); // "dumb" variational parameter for normalization at the end
+
+    for (int i=0; i<=numberOfVarParameters; i++)
         {
         getline (filePos, temp);
-        if (ReIm.find("Re") != std::string::npos) varW(i) +=   atof(temp.c_str());
-        if (ReIm.find("Im") != std::string::npos) varW(i) += I*atof(temp.c_str());
+        if (ReIm.find("Re") != std::string::npos) varW[i] +=   atof(temp.c_str());
+        if (ReIm.find("Im") != std::string::npos) varW[i] += I*atof(temp.c_str());
         }
-    getline (filePos, temp);
-    if (ReIm.find("Re") != std::string::npos) varW(numberOfVarParameters) +=   atof(temp.c_str()); // "dumb" variational parameter for normalization
-    if (ReIm.find("Im") != std::string::npos) varW(numberOfVarParameters) += I*atof(temp.c_str());
-
 
     filePos.close();
 	}
 
 
 
-void Compress_Load(std::string directory, int index)
+vector<pair<int, int>> load_index_entries(const string& directory, const int index)
     {
 
     string filenamePos = directory + "/a_indexVP_" + to_string(index) + ".csv";
 	ifstream filePos;
 	filePos.open (filenamePos.c_str());
+    if (!filePos) throw runtime_error("could not open '" + filenamePos + "'");
+
+    // only the non-zero entries are kept, lines beyond the end of the file are zero.
+    vector<pair<int, int>> entries;
 
-    int indexCompressed=1;
     string temp;
-    for (int i=0; i<numberOfVarParametrsMax; i++)
+    for (int i=0; i<numberOfVarParametrsMax && getline (filePos, temp); i++)
         {
-        getline (filePos, temp);
-        indexVP[i][0] = atoi(temp.c_str());;
-        if (indexVP[i][0]!=0) indexCompressed++;
+        const int index = atoi(temp.c_str());
+        if (index!=0)
+            {
+            entries.push_back({i, index});
+            }
         }
 
-    cout << "Number of decompressed variational parameters: " << indexCompressed << endl;
     filePos.close();
+    return entries;
     }
 
-cdouble psi_0_local(int i, int j, int fl)
+
+void Compress_Load(Tables& tables, const string& directory, const int index)
     {
-    cdouble psi_0_local_temp=1.0;
+    tables.indexVP.build(load_index_entries(directory, index));
+    }
+
 
-    vector<int> spins(L);
-    for (int j=0; j<L; j++) spins[j] = S[0][j][2];
-    psi_0_local_temp *= exp(psi_neural->log_psi_s(spins));
-    return psi_0_local_temp;
+void load_variational_parameters(Tables& tables, const string& directory, const int index) {
+    // prefer the binary network file, see convert_to_network_files()
+    const auto file_name = directory + "/a_VP_" + to_string(index) + ".bin";
+    if(!rbm_on_gpu::NetworkFile::is_network_file(file_name)) {
+        loadVP(tables, directory, index, "Re");
+        loadVP(tables, directory, index, "Im");
+        Compress_Load(tables, directory, index);
+        return;
     }
 
-int FindOmega(int i, int j) //
-	{
-    int Omega = (S[i][(j+1)%L][2]+S[i][(j-1+L)%L][2])/2;  // = -1,0,1
-    return Omega;
+    rbm_on_gpu::NetworkFile file(file_name);
+    file.expect_type(rbm_on_gpu::NetworkType::PsiClassical);
+
+    if(file.num_params() != numberOfVarParameters + 1u) {
+        throw runtime_error(
+            "'" + file_name + "' holds " + to_string(file.num_params()) +
+            " variational parameters, expected " + to_string(numberOfVarParameters + 1)
+        );
     }
+    tables.varW.assign(file.params(), file.params() + file.num_params());
 
-void FlipPlaquette(int i, int j)
-	{
-    S[i][j][2] *= -1;
+    rbm_on_gpu::TopologyReader reader(file);
+    const auto num_entries = reader.read();
+    const auto words = reader.read(2u * size_t(num_entries));
+
+    vector<pair<int, int>> entries(num_entries);
+    for(auto k = 0u; k < num_entries; k++) {
+        entries[k] = {int(words[2u * k]), int(words[2u * k + 1u])};
     }
+    tables.indexVP.build(entries);
+}
 
-int if_Flippable(int i, int j)
-	{
-    return S[i][j][2];
-	}
 
-cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't take into account the factor of 2
+void convert_to_network_files(const string& directory, const int index) {
+    const auto psi_file_name = directory + "/psi_" + to_string(index) + "_compressed";
+    rbm_on_gpu::convert_to_network_file(psi_file_name + ".txt", psi_file_name + ".bin");
+
+    Tables tables;
+    loadVP(tables, directory, index, "Re");
+    loadVP(tables, directory, index, "Im");
+
+    const auto entries = load_index_entries(directory, index);
+    vector<uint32_t> topology = {uint32_t(entries.size())};
+    for(const auto& entry : entries) {
+        topology.push_back(entry.first);
+        topology.push_back(entry.second);
+    }
+
+    rbm_on_gpu::NetworkFile::write(
+        directory + "/a_VP_" + to_string(index) + ".bin",
+        rbm_on_gpu::NetworkType::PsiClassical,
+        0u,
+        0u,
+        1.0,
+        0.0,
+        topology,
+        tables.varW.data(),
+        tables.varW.size()
+    );
+}
+
+
+shared_ptr<const Tables> load_tables(const string& directory, const int index, const int L, const int perturbation_order) {
+    if(L <= 0 || L > Tables::max_sites) {
+        throw runtime_error("the classical network supports between 1 and " + to_string(Tables::max_sites) + " spins");
+    }
+    if(perturbation_order < 0 || perturbation_order > Tables::max_perturbation_order) {
+        throw runtime_error(
+            "the classical network supports perturbation orders between 0 and " + to_string(Tables::max_perturbation_order)
+        );
+    }
+
+    auto tables = make_shared<Tables>();
+    tables->L = L;
+    // a configuration is a single chain, the plaquette terms only see the first one.
+    tables->H = 1;
+    tables->perturbation_order = perturbation_order;
+
+    load_variational_parameters(*tables, directory, index);
+    load_neural_network(*tables, directory, index);
+    build_plaquette_tables(*tables);
+
+    return tables;
+}
+
+
+void build_plaquette_tables(Tables& tables) {
+    // same terms as in Heff_plaquetteComplex() up to first order, for each neighbourhood (j-1, j, j+1).
+    for (int pattern=0; pattern<8; pattern++)
+        {
+        const int S_left  = 1 - 2 * !(pattern & 1);
+        const int S_j     = 1 - 2 * !(pattern & 2);
+        const int S_right = 1 - 2 * !(pattern & 4);
+
+        const int fl = S_j;
+        const int Omega = (S_right+S_left)/2;
+        const int omega = fl*Omega;
+
+        const double Es = -S_j*(S_right+S_left)/2;
+        tables.plaquette_diagonal[pattern] = (-I)*Es*tables.varW[tables.indexVP[1]];
+        tables.plaquette_flip[pattern] = (
+            tables.perturbation_order >= 1 ? (-I)*tables.varW[tables.indexVP[2+(1+omega)]] : cdouble(0.0)
+        );
+        }
+}
+
+
+cdouble Context::Heff_plaquetteComplex(int i, int j) // doesn't take into account the factor of 2
 	{
-	//for (int x=0; x<L; x++) S[0][x][2] = S_1D[x];
+	//for (int x=0; x<L; x++) S[x] = S_1D[x];
 
-	int PerturbationTheoryOrder=1;
-	int CompressionMode=1;
+	int PerturbationTheoryOrder=tables.perturbation_order;
 
 	int fl = if_Flippable(i, j); // flippability, +1,0,-1
 
@@ -141,18 +371,9 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
         int n1OrderVP, n2OrderVP, nPlaqSymClassTotal;
         int omega = fl*Omega;
 
-        int j_ind=0; // j-index for non-uniform states
-        int j_ind_max=1; // for compression
-        if (0)//(TildeRun==1 || InitialState!=0)
-            {
-            j_ind=abs(j-L/2);
-            j_ind_max = L/2+1;
-            }
-
         // 0th order. 0-th parameter for "misses"
-        double Es = -S[0][j][2]*(S[0][(j+1)%L][2]+S[0][(j-1+L)%L][2])/2;
-        Heff_plaquetteComplex += (-I)*Es*varW(indexVP[1][0]);
-        if (CompressionMode==1) for (int j_indt=0; j_indt<j_ind_max; j_indt++) indexVP[1][1]+=1;
+        double Es = -S[j]*(S[(j+1)%L]+S[(j-1+L)%L])/2;
+        Heff_plaquetteComplex += (-I)*Es*tables.varW[tables.indexVP[1]];
         if (PerturbationTheoryOrder==0) return Heff_plaquetteComplex;
 
         cdouble psi_0_local_ij= psi_0_local(i,j, fl);
@@ -162,8 +383,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
             FlipPlaquette(i,j); // flip
             cdouble psi_0_local_ij_flip = psi_0_local(i,j, -fl);
             FlipPlaquette(i,j); // flip back
-            Heff_plaquetteComplex += (-I)*psi_0_local_ij_flip/psi_0_local_ij*varW(indexVP[2+(1+omega)][0]); // 9 first-ordetr VP; +1 -- for all other variational parameters
-            if (CompressionMode==1) for (int j_indt=0; j_indt<j_ind_max; j_indt++)    indexVP[2+(1+omega)][1]+=1;
+            Heff_plaquetteComplex += (-I)*psi_0_local_ij_flip/psi_0_local_ij*tables.varW[tables.indexVP[2+(1+omega)]]; // 9 first-ordetr VP; +1 -- for all other variational parameters
             // total 1-ord: 2+3 = 5 (0-th is dumb)
 
             if (PerturbationTheoryOrder==1) return Heff_plaquetteComplex;
@@ -172,23 +392,19 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
         // 2-nd order
             {
             n1OrderVP = 5;                                                                                                                                      //      A
-            vector<int> i1List, j1List; // neighb plaquette #1. total 12 possibilities, divided in symmetry classes depending on the symmetry of the state      //    8 9 B
-            int nPlaqTotal = 2; // number of spins                                                                                                                                //  7 6 x 0 1    A=10, B=11
-            i1List = {i        , i        };      //    5 3 2
-            j1List = {(j+1+L)%L, (j-1+L)%L};      //      4
-
-            vector<int> SymClassList; // symmetry classes for all 2 spins
+            // fixed-size arrays, such that the evaluation does not allocate                                                                             //      A
+            const int nPlaqTotal = 2; // number of spins. neighb plaquette #1: total 12 possibilities, divided in symmetry classes                        //    8 9 B
+            const int i1List[nPlaqTotal] = {i        , i        };      // depending on the symmetry of the state                                        //  7 6 x 0 1    A=10, B=11
+            const int j1List[nPlaqTotal] = {(j+1+L)%L, (j-1+L)%L};      //    5 3 2
+                                                                        //      4
             //int nPlaqSymClassTotal; // total number of symmetry classes
 
             cdouble Psi;
 
             // symmetry classes
-            // 1. with L-R symmetry
-            if (1)
-                {
-                SymClassList = {0,0}; // both spins are in the same symmetry class
-                nPlaqSymClassTotal = 1;
-                }
+            // 1. with L-R symmetry: both spins are in the same symmetry class
+            const int SymClassList[nPlaqTotal] = {0,0}; // symmetry classes for all 2 spins
+            nPlaqSymClassTotal = 1;
 
             int i1,j1,fl1;
             for (int nPlaq=0; nPlaq < nPlaqTotal; nPlaq+=1) // loop over all 12 plaquettes
@@ -217,8 +433,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
                     FlipPlaquette(i1,j1); // flip plaquette-1 back
 
                     // omega, omega1
-                    Heff_plaquetteComplex += (-I)*Psi*varW(indexVP[n1OrderVP + 3*2*(1+omega) + 2*(1+omega1) + 0][0]);
-                    if (CompressionMode==1) for (int j_indt=0; j_indt<j_ind_max; j_indt++)  indexVP[n1OrderVP + 3*2*(1+omega) + 2*(1+omega1) + 0][1]+=1;
+                    Heff_plaquetteComplex += (-I)*Psi*tables.varW[tables.indexVP[n1OrderVP + 3*2*(1+omega) + 2*(1+omega1) + 0]];
                     }
                 FlipPlaquette(i, j);   // flip plaquette back
 
@@ -241,8 +456,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
                     FlipPlaquette(i1,j1); // flip plaquette-1 back
 
                     // omega, omega1
-                    Heff_plaquetteComplex += (-I)*Psi*varW(indexVP[n1OrderVP + 3*2*(1+omega) + 2*(1+omega1) + 1][0]);
-                    if (CompressionMode==1)  for (int j_indt=0; j_indt<j_ind_max; j_indt++) indexVP[n1OrderVP + 3*2*(1+omega) + 2*(1+omega1) + 1][1]+=1;
+                    Heff_plaquetteComplex += (-I)*Psi*tables.varW[tables.indexVP[n1OrderVP + 3*2*(1+omega) + 2*(1+omega1) + 1]];
                     // total 2-ord: 3*3*2=18
                     }
                 }
@@ -252,18 +466,16 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
 
         // 3-rd order, partial
         n2OrderVP = n1OrderVP+3*3*2;
-        vector<vector<int>> Path; // Path[nPath][coord], where coord = i1,j1,i2,j2
         //cout << "omega="<< omega << endl;
         for (int dir=1; dir>=-1; dir-=2)
             {
-            Path.clear();
-
-            Path.push_back({i, (j+1*dir+  L)%L, i, (j+2*dir+2*L)%L}); // 0-R1-R2 (0 is default)
-            Path.push_back({i, (j+1*dir+  L)%L, i, (j          )%L}); // 0-R1-0
-            Path.push_back({i, (j+1*dir+  L)%L, i, (j-1*dir+  L)%L}); // 0-R1-L1
-            Path.push_back({i, (j+2*dir+2*L)%L, i, (j+1*dir+  L)%L}); // 0-R2-R1
-
-            int nPathTotal = Path.size();
+            const int nPathTotal = 4;
+            const int Path[nPathTotal][4] = { // Path[nPath][coord], where coord = i1,j1,i2,j2
+                {i, (j+1*dir+  L)%L, i, (j+2*dir+2*L)%L}, // 0-R1-R2 (0 is default)
+                {i, (j+1*dir+  L)%L, i, (j          )%L}, // 0-R1-0
+                {i, (j+1*dir+  L)%L, i, (j-1*dir+  L)%L}, // 0-R1-L1
+                {i, (j+2*dir+2*L)%L, i, (j+1*dir+  L)%L}  // 0-R2-R1
+            };
 
             int nPathDiff = nPathTotal; // distinguish all the paths // uncommented out 11.12.2019 for tests // DEBUG
             int nTerms=5; // number of different terms (contributions)
@@ -306,9 +518,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
                         FlipPlaquette(i2,j2); // flip plaquette-2 back
 
                         // omega, omega1, omega2
-                        Heff_plaquetteComplex +=  (-I)*Psi*varW(indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 0][0]);
-                        if (CompressionMode==1)  for (int j_indt=0; j_indt<j_ind_max; j_indt++) indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 0][1]+=1;
-                        //if (CompressionMode==1)  for (int j_indt=0; j_indt<j_ind_max; j_indt++)  indexVP[n2OrderVP + 9*9*9*nTerms*nPathDiff*j_indt + 9*9*nTerms*nPathDiff*(4+omega) + 9*nTerms*nPathDiff*(4+omega1) + nTerms*nPathDiff*(4+omega2) + nTerms*(nPath%nPathDiff) + 0][1]+=1;
+                        Heff_plaquetteComplex +=  (-I)*Psi*tables.varW[tables.indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 0]];
                         }
 
                     FlipPlaquette(i1, j1);   // flip plaquette-1 back
@@ -349,8 +559,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
                         FlipPlaquette(i2,j2); // flip plaquette-2 back
 
                         // omega, omega1, omega2
-                        Heff_plaquetteComplex +=  (-I)*Psi*varW(indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 1][0]);
-                        if (CompressionMode==1)  for (int j_indt=0; j_indt<j_ind_max; j_indt++) indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 1][1]+=1;
+                        Heff_plaquetteComplex +=  (-I)*Psi*tables.varW[tables.indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 1]];
                         }
 
                     FlipPlaquette(i1, j1);   // flip plaquette-1 back
@@ -393,8 +602,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
                         FlipPlaquette(i2,j2); // flip plaquette-2 back
 
                         // omega, omega1, omega2
-                        Heff_plaquetteComplex +=  (-I)*Psi*varW(indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 2][0]);
-                        if (CompressionMode==1)  for (int j_indt=0; j_indt<j_ind_max; j_indt++) indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 2][1]+=1;
+                        Heff_plaquetteComplex +=  (-I)*Psi*tables.varW[tables.indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 2]];
                         }
 
                     FlipPlaquette(i, j);   // flip plaquette back
@@ -434,8 +642,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
                         FlipPlaquette(i1,j1); // flip plaquette-1 back
 
                         // omega, omega1, omega2
-                        Heff_plaquetteComplex +=  (-I)*Psi*varW(indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 3][0]);
-                        if (CompressionMode==1)  for (int j_indt=0; j_indt<j_ind_max; j_indt++) indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 3][1]+=1;
+                        Heff_plaquetteComplex +=  (-I)*Psi*tables.varW[tables.indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 3]];
                         }
 
                     //FlipPlaquette(i1, j1);   // flip plaquette-1 back
@@ -477,8 +684,7 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
                         FlipPlaquette(i2,j2); // flip plaquette-2 back
 
                         // omega, omega1, omega2
-                        Heff_plaquetteComplex +=  (-I)*Psi*varW(indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 4][0]);
-                        if (CompressionMode==1)  for (int j_indt=0; j_indt<j_ind_max; j_indt++) indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 4][1]+=1;
+                        Heff_plaquetteComplex +=  (-I)*Psi*tables.varW[tables.indexVP[n2OrderVP + 3*3*nTerms*nPathDiff*(1+omega) + 3*nTerms*nPathDiff*(1+omega1) + nTerms*nPathDiff*(1+omega2) + nTerms*(nPath%nPathDiff) + 4]];
                         }
 
                     //FlipPlaquette(i1, j1);   // flip plaquette-1 back
@@ -496,30 +702,91 @@ cdouble Heff_plaquetteComplex(int i, int j, Eigen::VectorXcd& varW) // doesn't t
 	}
 
 
-cdouble findHeffComplex(vector<int> &spins) //
+cdouble Context::findHeffComplex() //
 	{
 
     cdouble tempHeff = 0;
 
-	for (int j=0; j<L; j++)  S[0][j][2] = spins[j];
-	tempHeff += psi_neural->log_psi_s(spins);
+    const cdouble log_psi_0 = tables.psi_neural->log_psi_s(S);
+	tempHeff += log_psi_0;
+
+    if (tables.perturbation_order <= 1 && H == 1)
+        {
+        // Each plaquette costs a shift, a mask and a table read, plus one evaluation of the
+        // neural network with the plaquette flipped. The unflipped evaluation is shared by all of them.
+        const uint64_t neighbourhoods = this->neighbourhoods();
 
+        for (int j=0; j<L; j++)
+            {
+            const int pattern = (neighbourhoods >> j) & 7u;
 
-    int i,j;
-	for (i=0; i<H; i++)
-		{
-        for (j=0; j<L; j++)
-			{
-			tempHeff += Heff_plaquetteComplex(i,j, varW);
-			}
-		}
+            tempHeff += tables.plaquette_diagonal[pattern];
+            if (tables.perturbation_order == 1)
+                {
+                FlipPlaquette(0, j);
+                tempHeff += exp(tables.psi_neural->log_psi_s(S) - log_psi_0) * tables.plaquette_flip[pattern];
+                FlipPlaquette(0, j);
+                }
+            }
+        }
+    else
+        {
+        int i,j;
+        for (i=0; i<H; i++)
+            {
+            for (j=0; j<L; j++)
+                {
+                tempHeff += Heff_plaquetteComplex(i,j);
+                }
+            }
+        }
 
 
 
-	cdouble varW0 = varW(numberOfVarParameters);
+	cdouble varW0 = tables.varW[numberOfVarParameters];
 
 	return varW0+tempHeff;
 	}
 
 
+cdouble log_psi_s(const Tables& tables, const uint64_t configuration) {
+    Context context(tables, configuration);
+
+    return context.findHeffComplex();
+}
+
+
+void log_psi_s_batch(
+    const Tables& tables,
+    cdouble* result,
+    const uint64_t* configurations,
+    const size_t num_configurations,
+    unsigned int num_threads
+) {
+    if(num_threads == 0u) {
+        num_threads = max(thread::hardware_concurrency(), 1u);
+    }
+    num_threads = max(min<size_t>(num_threads, num_configurations), size_t(1u));
+
+    const auto evaluate_chunk = [&](const unsigned int thread_idx) {
+        const auto begin = num_configurations * thread_idx / num_threads;
+        const auto end = num_configurations * (thread_idx + 1u) / num_threads;
+        for(auto n = begin; n < end; n++) {
+            result[n] = log_psi_s(tables, configurations[n]);
+        }
+    };
+
+    vector<thread> threads;
+    threads.reserve(num_threads - 1u);
+    for(auto thread_idx = 1u; thread_idx < num_threads; thread_idx++) {
+        threads.emplace_back(evaluate_chunk, thread_idx);
+    }
+    evaluate_chunk(0u);
+
+    for(auto& worker : threads) {
+        worker.join();
+    }
+}
+
+
 }
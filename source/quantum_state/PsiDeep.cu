@@ -11,80 +11,278 @@
 namespace rbm_on_gpu {
 
 
+PsiDeep::Weights::Weights(Array<complex_t>&& params, const Layers& layers, const unsigned int N, const bool gpu)
+    : params(move(params)), num_layers(layers.size()), gpu(gpu)
+{
+    auto prev_size = N;
+    for(const auto& layer : layers) {
+        this->rhs_weights.push_back(Array<complex_t>(layer.rhs_connections.size(), gpu));
+        this->dense_weights.push_back(Array<complex_t>(layer.dense ? prev_size * layer.size : 0u, gpu));
+
+        prev_size = layer.size;
+    }
+
+    MALLOC(this->kernel_layers, sizeof(kernel::PsiDeep::Layer) * this->num_layers, this->gpu);
+}
+
+
+PsiDeep::Weights::Weights(const Weights& other)
+    :
+    params(other.params),
+    rhs_weights(other.rhs_weights),
+    dense_weights(other.dense_weights),
+    num_layers(other.num_layers),
+    gpu(other.gpu)
+{
+    // the layer descriptors point into the buffers above and are filled by PsiDeep::update_kernel().
+    MALLOC(this->kernel_layers, sizeof(kernel::PsiDeep::Layer) * this->num_layers, this->gpu);
+}
+
+
+PsiDeep::Weights::~Weights() noexcept(false) {
+    FREE(this->kernel_layers, this->gpu);
+}
+
+
 PsiDeep::PsiDeep(const PsiDeep& other)
     :
+    kernel::PsiDeep(other),
+    layers(other.layers),
+    weights(other.weights),
     alpha_array(other.alpha_array),
     beta_array(other.beta_array),
-    layers(other.layers),
     free_quantum_axis(other.free_quantum_axis),
     gpu(other.gpu)
 {
-    this->N = other.N;
-    this->prefactor = other.prefactor;
-    this->num_layers = other.num_layers;
-    this->width = other.width;
-    this->num_units = other.num_units;
+    // the weights are shared, unless 'other' has handed out a writable reference to them.
+    if(!this->weights.shares_payload_with(other.weights)) {
+        this->update_kernel();
+    }
+}
+
+
+PsiDeep::PsiDeep(const NetworkFile& file, const bool gpu) : free_quantum_axis(file.free_quantum_axis()), gpu(gpu) {
+    file.expect_type(NetworkType::PsiDeep);
+
+    this->N = file.header().N;
+    this->prefactor = file.header().prefactor;
+
+    const auto num_params = this->init_layers(read_layer_topology(file, this->N));
+    if(file.num_params() != num_params) {
+        throw runtime_error(
+            "the network file holds " + to_string(file.num_params()) +
+            " parameters, but the network has " + to_string(num_params)
+        );
+    }
+
+    Array<complex_t> params(num_params, gpu);
+    memcpy(params.host_data(), file.params(), sizeof(complex_t) * num_params);
+
+    this->weights = CopyOnWrite<Weights>(make_shared<Weights>(move(params), *this->layers, this->N, gpu));
 
     this->init_kernel();
+    this->update_params();
 }
 
 
-void PsiDeep::init_kernel() {
-    this->num_params = 2 * this->N; // alpha and beta
-    auto angle_idx = 0u;
+void PsiDeep::save(const string& file_name) const {
+    vector<uint32_t> topology = {this->num_layers};
+    for(const auto& layer : *this->layers) {
+        append_layer_topology(topology, {layer.size, layer.lhs_connectivity, layer.lhs_connections.host_data()});
+    }
+
+    NetworkFile::write(
+        file_name,
+        NetworkType::PsiDeep,
+        this->N,
+        this->free_quantum_axis ? NetworkFileHeader::flag_free_quantum_axis : 0u,
+        this->prefactor,
+        log(this->prefactor),
+        topology,
+        reinterpret_cast<const complex<double>*>(this->weights->params.host_data()),
+        this->num_params
+    );
+}
+
+
+unsigned int PsiDeep::init_layers(const vector<LayerTopology>& topology) {
+    this->num_layers = topology.size();
+    this->width = this->N;
+    this->num_units = 0u;
+
+    auto layers = make_shared<Layers>();
+    auto num_params = 2u * this->N;
+
     for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
-        const auto& layer = *next(this->layers.begin(), layer_idx);
-        auto& kernel_layer = kernel::PsiDeep::layers[layer_idx];
-        kernel_layer.size = layer.size;
-        kernel_layer.lhs_connectivity = layer.lhs_connectivity;
+        const auto size = topology[layer_idx].size;
+        const auto lhs_connectivity = topology[layer_idx].lhs_connectivity;
 
-        kernel_layer.begin_params = this->num_params;
-        kernel_layer.begin_angles = angle_idx;
+        if(size > this->width) {
+            this->width = size;
+        }
 
-        this->num_params += layer.size + layer.lhs_weights.size();
-        angle_idx += layer.size;
+        this->num_units += size;
+
+        Array<unsigned int> lhs_connections(lhs_connectivity * size, this->gpu);
+        memcpy(
+            lhs_connections.host_data(),
+            topology[layer_idx].lhs_connections,
+            sizeof(unsigned int) * lhs_connections.size()
+        );
+        lhs_connections.update_device();
+
+        const auto prev_size = layer_idx > 0 ? topology[layer_idx - 1].size : this->N;
+        auto rhs_positions = this->compile_rhs_positions(
+            prev_size, size, lhs_connectivity, lhs_connections
+        );
+        const auto dense = this->is_dense(prev_size, size, lhs_connectivity, lhs_connections);
+
+        layers->push_back({
+            size,
+            lhs_connectivity,
+            num_params,
+            move(lhs_connections),
+            Array<unsigned int>(0, this->gpu),
+            move(rhs_positions),
+            dense
+        });
+
+        num_params += size * (1u + lhs_connectivity);
     }
-    for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
-        auto& layer = kernel::PsiDeep::layers[layer_idx];
-        auto next_layer = kernel::PsiDeep::layers + layer_idx + 1;
 
-        layer.rhs_connectivity = (
-            layer_idx + 1 < this->num_layers ?
-            next_layer->size * next_layer->lhs_connectivity / layer.size :
-            0u
+    // the rhs-connections of a layer follow from the lhs-connections of the next one.
+    for(auto layer_idx = 0u; layer_idx + 1u < this->num_layers; layer_idx++) {
+        (*layers)[layer_idx].rhs_connections = this->compile_rhs_connections(
+            (*layers)[layer_idx], (*layers)[layer_idx + 1u]
         );
     }
+
+    this->layers = layers;
+
+    return num_params;
+}
+
+
+void PsiDeep::init_kernel() {
+    this->num_params = this->weights->params.size();
     this->O_k_length = this->num_params - 2 * this->N;
 
+    // the per-sample workspace is carved into buffers sized by the network, see PsiDeepAngles.
+    auto workspace_size = 2u * this->width + this->num_units;
+    #ifdef PSI_DEEP_CACHED_ANGLES
+    workspace_size += this->get_num_shifts() * this->layers->front().size;
+    #endif
+    if(workspace_size > Angles::max_workspace) {
+        throw runtime_error(
+            "PsiDeep: the network needs a workspace of " + to_string(workspace_size) +
+            " complex numbers per sample, but PSI_DEEP_WORKSPACE_SIZE is " + to_string(Angles::max_workspace)
+        );
+    }
+
     this->update_kernel();
 }
 
 
 void PsiDeep::update_kernel() {
+    // (Re-)binds all pointers into the current weights. Needed whenever the weights have been replaced.
+
+    auto& weights = *this->weights;
+    auto params = weights.params.data();
+
+    this->alpha_array = RealArrayView(weights.params.host_data(), this->N);
+    this->beta_array = RealArrayView(weights.params.host_data() + this->N, this->N);
+
+    vector<kernel::PsiDeep::Layer> kernel_layers(this->num_layers);
+
+    auto angle_idx = 0u;
     for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
-        Layer& layer = *next(this->layers.begin(), layer_idx);
-        auto& kernel_layer = kernel::PsiDeep::layers[layer_idx];
+        const auto& layer = (*this->layers)[layer_idx];
+        auto& kernel_layer = kernel_layers[layer_idx];
+
+        kernel_layer.size = layer.size;
+        kernel_layer.lhs_connectivity = layer.lhs_connectivity;
+        kernel_layer.rhs_connectivity = (
+            layer_idx + 1 < this->num_layers ?
+            layer.rhs_connections.size() / layer.size :
+            0u
+        );
+        kernel_layer.begin_params = layer.begin_params;
+        kernel_layer.begin_angles = angle_idx;
 
         kernel_layer.lhs_connections = layer.lhs_connections.data();
         kernel_layer.rhs_connections = layer.rhs_connections.data();
-        kernel_layer.lhs_weights = layer.lhs_weights.data();
-        kernel_layer.rhs_weights = layer.rhs_weights.data();
-        kernel_layer.biases = layer.biases.data();
+        kernel_layer.biases = params + layer.begin_params;
+        kernel_layer.lhs_weights = params + layer.begin_params + layer.size;
+        kernel_layer.rhs_weights = weights.rhs_weights[layer_idx].data();
+        kernel_layer.dense_weights = layer.dense ? weights.dense_weights[layer_idx].data() : nullptr;
+
+        angle_idx += layer.size;
+    }
+
+    MEMCPY(
+        weights.kernel_layers,
+        kernel_layers.data(),
+        sizeof(kernel::PsiDeep::Layer) * this->num_layers,
+        this->gpu,
+        false
+    );
+    this->kernel::PsiDeep::layers = weights.kernel_layers;
+}
+
+
+bool PsiDeep::is_dense(
+    const unsigned int prev_size,
+    const unsigned int size,
+    const unsigned int lhs_connectivity,
+    const Array<unsigned int>& lhs_connections
+) const {
+    // A layer is dense if every unit is connected to each unit of the lhs exactly once.
+    // In that case the weights are rearranged into a plain lhs-size x size matrix, see scatter_dense_weights().
+
+    if(lhs_connectivity != prev_size) {
+        return false;
+    }
+
+    vector<bool> connected(prev_size);
+    for(auto j = 0u; j < size; j++) {
+        connected.assign(prev_size, false);
+
+        for(auto i = 0u; i < lhs_connectivity; i++) {
+            const auto lhs_idx = lhs_connections[i * size + j];
+            if(lhs_idx >= prev_size || connected[lhs_idx]) {
+                return false;
+            }
+            connected[lhs_idx] = true;
+        }
     }
+
+    return true;
 }
 
 
-pair<Array<unsigned int>, Array<complex_t>> PsiDeep::compile_rhs_connections_and_weights(
+void PsiDeep::scatter_dense_weights(Array<complex_t>& dense_weights, const unsigned int layer_idx) const {
+    const auto& layer = (*this->layers)[layer_idx];
+    const auto lhs_weights = this->get_lhs_weights(layer_idx);
+
+    for(auto j = 0u; j < layer.size; j++) {
+        for(auto i = 0u; i < layer.lhs_connectivity; i++) {
+            dense_weights[layer.lhs_connections[i * layer.size + j] * layer.size + j] = lhs_weights[i * layer.size + j];
+        }
+    }
+    dense_weights.update_device();
+}
+
+
+vector<unsigned int> PsiDeep::compile_rhs_positions(
     const unsigned int prev_size,
     const unsigned int size,
     const unsigned int lhs_connectivity,
-    const Array<unsigned int>& lhs_connections,
-    const Array<complex_t>& lhs_weights
-) {
+    const Array<unsigned int>& lhs_connections
+) const {
+    // position of each lhs-weight (i, j) within the rhs-weights of the previous layer.
     const auto rhs_connectivity = size * lhs_connectivity / prev_size;
 
-    Array<unsigned int> rhs_connections(prev_size * rhs_connectivity, this->gpu);
-    Array<complex_t> rhs_weights(prev_size * rhs_connectivity, this->gpu);
+    vector<unsigned int> result(lhs_connectivity * size);
 
     vector<unsigned int> lhs_num_connections;
     lhs_num_connections.assign(prev_size, 0u);
@@ -93,71 +291,146 @@ pair<Array<unsigned int>, Array<complex_t>> PsiDeep::compile_rhs_connections_and
         for(auto i = 0u; i < lhs_connectivity; i++) {
             const auto lhs_idx = lhs_connections[i * size + j];
 
-            rhs_connections[lhs_idx * rhs_connectivity + lhs_num_connections[lhs_idx]] = j;
-            rhs_weights[lhs_idx * rhs_connectivity + lhs_num_connections[lhs_idx]] = lhs_weights[
-                i * size + j
-            ];
+            result[i * size + j] = lhs_idx * rhs_connectivity + lhs_num_connections[lhs_idx];
             lhs_num_connections[lhs_idx]++;
         }
     }
 
-    rhs_connections.update_device();
-    rhs_weights.update_device();
-
-    return {move(rhs_connections), move(rhs_weights)};
+    return result;
 }
 
 
-Array<complex_t> PsiDeep::get_params() const {
-    Array<complex_t> result(this->num_params, false);
+Array<unsigned int> PsiDeep::compile_rhs_connections(const Layer& layer, const Layer& next_layer) const {
+    const auto rhs_connectivity = next_layer.size * next_layer.lhs_connectivity / layer.size;
 
-    for(auto i = 0u; i < this->N; i++) {
-        result[i]= complex_t(this->alpha_array[i], 0.0);
-        result[this->N + i] = complex_t(this->beta_array[i], 0.0);
-    }
-    auto it = result.begin() + 2 * this->N;
+    Array<unsigned int> result(layer.size * rhs_connectivity, this->gpu);
 
-    for(const auto& layer : this->layers) {
-        copy(layer.biases.begin(), layer.biases.end(), it);
-        it += layer.biases.size();
-        copy(layer.lhs_weights.begin(), layer.lhs_weights.end(), it);
-        it += layer.lhs_weights.size();
+    for(auto j = 0u; j < next_layer.size; j++) {
+        for(auto i = 0u; i < next_layer.lhs_connectivity; i++) {
+            result[next_layer.rhs_positions[i * next_layer.size + j]] = j;
+        }
     }
 
+    result.update_device();
+
     return result;
 }
 
 
-void PsiDeep::set_params(const Array<complex_t>& new_params) {
-    for(auto i = 0u; i < this->N; i++) {
-        this->alpha_array[i] = new_params[i].real();
-        this->beta_array[i] = new_params[this->N + i].real();
+void PsiDeep::set_params(const complex_t* new_params) {
+    // 'new_params' may be the zero-copy view onto the parameter store itself.
+    if(new_params != this->weights->params.host_data()) {
+        this->make_params_unique();
+        memcpy(this->weights->params.host_data(), new_params, sizeof(complex_t) * this->num_params);
     }
-    auto it = new_params.begin() + 2 * this->N;
 
-    for(auto layer_it = this->layers.begin(); layer_it != this->layers.end(); layer_it++) {
-        auto& layer = *layer_it;
+    this->update_params();
+}
 
-        copy(it, it + layer.biases.size(), layer.biases.begin());
-        layer.biases.update_device();
-        it += layer.size;
 
-        copy(it, it + layer.lhs_weights.size(), layer.lhs_weights.begin());
-        layer.lhs_weights.update_device();
-        it += layer.lhs_weights.size();
+void PsiDeep::update_params() {
+    // The topology is fixed, hence only the store has to be synced and the weights
+    // derived from it are scattered in-place into their existing buffers.
 
-        if(layer_it != this->layers.begin()) {
-            prev(layer_it)->rhs_weights = this->compile_rhs_connections_and_weights(
-                prev(layer_it)->size,
-                layer.size,
-                layer.lhs_connectivity,
-                layer.lhs_connections,
-                layer.lhs_weights
-            ).second;
+    auto& weights = *this->weights;
+
+    weights.params.update_device();
+
+    for(auto layer_idx = 0u; layer_idx < this->num_layers; layer_idx++) {
+        const auto& layer = (*this->layers)[layer_idx];
+
+        if(layer.dense) {
+            this->scatter_dense_weights(weights.dense_weights[layer_idx], layer_idx);
+        }
+
+        if(layer_idx > 0u) {
+            auto& rhs_weights = weights.rhs_weights[layer_idx - 1u];
+            const auto lhs_weights = this->get_lhs_weights(layer_idx);
+
+            for(auto k = 0u; k < lhs_weights.size(); k++) {
+                rhs_weights[layer.rhs_positions[k]] = lhs_weights[k];
+            }
+            rhs_weights.update_device();
         }
     }
+}
 
-    this->update_kernel();
+
+void PsiDeep::make_params_unique() {
+    if(this->weights.make_unique()) {
+        this->update_kernel();
+    }
+}
+
+
+Array<complex_t>& PsiDeep::pin_params() {
+    if(this->weights.pin()) {
+        this->update_kernel();
+    }
+
+    return this->weights->params;
+}
+
+
+vector<complex<double>> PsiDeep::log_psi_s_along_flips(
+    const Spins& spins, const vector<unsigned int>& positions
+) const {
+    const auto num_flips = positions.size();
+
+    Array<unsigned int> positions_array(num_flips, this->gpu);
+    Array<complex_t> result(num_flips, this->gpu);
+    std::copy(positions.begin(), positions.end(), positions_array.begin());
+    positions_array.update_device();
+
+    auto this_ = this->get_kernel();
+    auto positions_ptr = positions_array.data();
+    auto result_ptr = result.data();
+
+    const auto functor = [=] __host__ __device__ () {
+        #include "cuda_kernel_defines.h"
+
+        SHARED Spins current_spins;
+        SHARED PsiDeep::Angles angles;
+        SHARED complex_t log_psi;
+
+        SINGLE {
+            current_spins = spins;
+        }
+        SYNC;
+        angles.init(this_, current_spins);
+
+        for(auto n = 0u; n < num_flips; n++) {
+            SYNC;
+            SINGLE {
+                current_spins = current_spins.flip(positions_ptr[n]);
+            }
+            SYNC;
+            MULTI(j, this_.get_num_angles()) {
+                this_.flip_spin_of_jth_angle(j, positions_ptr[n], current_spins, angles);
+            }
+            SYNC;
+            this_.log_psi_s(log_psi, current_spins, angles);
+            SINGLE {
+                result_ptr[n] = log_psi;
+            }
+        }
+    };
+
+    if(this->gpu) {
+        cuda_kernel<<<1, this->get_width()>>>(functor);
+    }
+    else {
+        functor();
+    }
+
+    result.update_host();
+
+    vector<complex<double>> result_std(num_flips);
+    for(auto n = 0u; n < num_flips; n++) {
+        result_std[n] = result[n].to_std();
+    }
+
+    return result_std;
 }
 
 } // namespace rbm_on_gpu
@@ -0,0 +1,68 @@
+#include "quantum_state/PsiHamiltonian.hpp"
+
+#include <complex>
+#include <vector>
+
+
+namespace rbm_on_gpu {
+
+vector<complex<double>> PsiHamiltonian::carried_energies(
+    const Spins& spins, const vector<unsigned int>& positions
+) const {
+    const auto num_flips = positions.size();
+
+    Array<unsigned int> positions_array(num_flips, this->gpu);
+    Array<complex_t> result(num_flips, this->gpu);
+    std::copy(positions.begin(), positions.end(), positions_array.begin());
+    positions_array.update_device();
+
+    auto this_ = this->get_kernel();
+    auto positions_ptr = positions_array.data();
+    auto result_ptr = result.data();
+
+    const auto functor = [=] __host__ __device__ () {
+        #include "cuda_kernel_defines.h"
+
+        SHARED Spins current_spins;
+        SHARED PsiHamiltonian::Angles angles;
+
+        SINGLE {
+            current_spins = spins;
+        }
+        SYNC;
+        angles.init(this_, current_spins);
+
+        for(auto n = 0u; n < num_flips; n++) {
+            SYNC;
+            SINGLE {
+                current_spins = current_spins.flip(positions_ptr[n]);
+            }
+            SYNC;
+            MULTI(j, this_.get_num_angles()) {
+                this_.flip_spin_of_jth_angle(j, positions_ptr[n], current_spins, angles);
+            }
+            SYNC;
+            SINGLE {
+                result_ptr[n] = angles.energy;
+            }
+        }
+    };
+
+    if(this->gpu) {
+        cuda_kernel<<<1, this->get_width()>>>(functor);
+    }
+    else {
+        functor();
+    }
+
+    result.update_host();
+
+    vector<complex<double>> result_std(num_flips);
+    for(auto n = 0u; n < num_flips; n++) {
+        result_std[n] = result[n].to_std();
+    }
+
+    return result_std;
+}
+
+} // namespace rbm_on_gpu
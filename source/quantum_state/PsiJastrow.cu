@@ -0,0 +1,61 @@
+#include "quantum_state/PsiJastrow.hpp"
+
+#include <complex>
+#include <cstring>
+
+
+namespace rbm_on_gpu {
+
+PsiJastrow::PsiJastrow(const unsigned int N, const bool gpu)
+  : params(N * (N - 1u) / 2u, gpu), J_array(N * N, gpu), gpu(gpu) {
+    this->N = N;
+    this->prefactor = 1.0;
+    this->num_params = N * (N - 1u) / 2u;
+
+    this->update_kernel();
+
+    for(auto& J_k : this->params) {
+        J_k = complex_t(0.0, 0.0);
+    }
+    this->update_params();
+}
+
+PsiJastrow::PsiJastrow(const PsiJastrow& other)
+    :
+    kernel::PsiJastrow(other),
+    params(other.params),
+    J_array(other.J_array),
+    gpu(other.gpu) {
+    this->update_kernel();
+}
+
+void PsiJastrow::update_kernel() {
+    this->J = this->J_array.data();
+}
+
+void PsiJastrow::get_params(complex<double>* result) const {
+    memcpy(result, this->params.host_data(), sizeof(complex_t) * this->num_params);
+}
+
+void PsiJastrow::set_params(const complex<double>* new_params) {
+    memcpy(this->params.host_data(), new_params, sizeof(complex_t) * this->num_params);
+    this->update_params();
+}
+
+void PsiJastrow::update_params() {
+    for(auto i = 0u; i < this->N; i++) {
+        this->J_array[i * this->N + i] = complex_t(0.0, 0.0);
+
+        for(auto j = i + 1u; j < this->N; j++) {
+            const auto& J_ij = this->params[pair_index(i, j, this->N)];
+
+            this->J_array[i * this->N + j] = J_ij;
+            this->J_array[j * this->N + i] = J_ij;
+        }
+    }
+
+    this->params.update_device();
+    this->J_array.update_device();
+}
+
+} // namespace rbm_on_gpu
@@ -31,6 +31,17 @@ def pytest_generate_tests(metafunc):
         ]
         metafunc.parametrize("psi_deep", psi_list)
 
+    if 'psi_deep_layers' in metafunc.fixturenames:
+        psi_list = [
+            # sparse layers of varying width
+            lambda gpu: new_deep_neural_network(8, [16, 16, 8, 4, 2], [4, 4, 4, 2, 2], noise=1e-2, gpu=gpu),
+            # fully connected layers, evaluated by the dense path
+            lambda gpu: new_deep_neural_network(6, [12, 12, 6, 3], [6, 12, 12, 6], noise=1e-2, gpu=gpu),
+            # a sparse layer followed by fully connected ones
+            lambda gpu: new_deep_neural_network(8, [8, 8, 4, 2], [4, 8, 8, 4], noise=1e-2, gpu=gpu),
+        ]
+        metafunc.parametrize("psi_deep_layers", psi_list)
+
     if 'psi_all' in metafunc.fixturenames:
         psi_list = [
             lambda gpu: new_neural_network(3, 9, noise=1e-2, gpu=gpu),
@@ -0,0 +1,70 @@
+from pyRBMonGPU import ExpectationValue, ExactSummation, MeasurementPlan, Operator
+from QuantumExpression import sigma_x, sigma_y, sigma_z
+from pytest import approx
+import numpy as np
+
+
+def correlations(N):
+    # sharing flip masks between the operators, such that the plan merges their groups
+    return [
+        sigma_x(i) * sigma_x((i + d) % N) + 0.5j * sigma_y(i) * sigma_y((i + d) % N) + sigma_z(i) * sigma_z((i + d) % N)
+        for i in range(N) for d in range(1, N // 2 + 1)
+    ] + [sigma_x(i) for i in range(N)]
+
+
+def test_measurement_plan(psi_all, gpu):
+    psi = psi_all(gpu)
+
+    N = psi.N
+    spin_ensemble = ExactSummation(N, gpu)
+    psi.normalize(spin_ensemble)
+
+    expressions = correlations(N)
+    operators = [Operator(expr, gpu) for expr in expressions]
+    plan = MeasurementPlan(operators, gpu)
+    expectation_value = ExpectationValue(gpu)
+
+    result_plan = expectation_value(psi, plan, spin_ensemble)
+    result_list = expectation_value(psi, operators, spin_ensemble)
+    result_single = [expectation_value(psi, op, spin_ensemble) for op in operators]
+
+    psi_vector = psi.vector
+    result_ref = [np.vdot(psi_vector, expr.matrix(N) @ psi_vector) for expr in expressions]
+
+    assert result_plan == approx(result_single, rel=1e-10, abs=1e-12)
+    assert result_list == approx(result_single, rel=1e-10, abs=1e-12)
+    assert result_plan == approx(result_ref, rel=1e-10, abs=1e-12)
+
+
+def test_difference(psi_all, gpu):
+    psi = psi_all(gpu)
+
+    N = psi.N
+    spin_ensemble = ExactSummation(N, gpu)
+    psi.normalize(spin_ensemble)
+
+    psi_prime = psi.copy()
+    psi_prime.params = 0.95 * psi_prime.params
+
+    expressions = correlations(N)
+    operators = [Operator(expr, gpu) for expr in expressions]
+    expectation_value = ExpectationValue(gpu)
+
+    result_plan = expectation_value.difference(psi, psi_prime, MeasurementPlan(operators, gpu), spin_ensemble)
+    result_list = expectation_value.difference(psi, psi_prime, operators, spin_ensemble)
+
+    # local energies of psi_prime sampled from psi, minus those of psi reweighted by |psi / psi_prime|^2
+    psi_vector = psi.vector
+    psi_prime_vector = psi_prime.vector
+    probability = abs(psi_vector)**2
+    probability_ratio = probability / abs(psi_prime_vector)**2
+
+    result_ref = []
+    for expr in expressions:
+        matrix = expr.matrix(N)
+        a = np.sum(probability * (matrix @ psi_prime_vector) / psi_prime_vector)
+        b = np.sum(probability * probability_ratio * (matrix @ psi_vector) / psi_vector)
+        result_ref.append(a - b / np.sum(probability * probability_ratio))
+
+    assert result_plan == approx(result_list, rel=1e-10, abs=1e-12)
+    assert result_plan == approx(result_ref, rel=1e-8, abs=1e-10)
@@ -1,4 +1,7 @@
-from pyRBMonGPU import HilbertSpaceDistance, ExactSummation, Operator
+from pyRBMonGPU import (
+    HilbertSpaceDistance, ExactSummation, MonteCarloLoop, Operator, OperatorProduct, PsiClassical, log_psi_table
+)
+from QuantumExpression import sigma_x, sigma_y, sigma_z
 from pytest import approx
 import numpy as np
 from pathlib import Path
@@ -28,6 +31,37 @@ def test_distance1(psi_all, hamiltonian, gpu):
     assert distance_test == approx(distance_ref, rel=1e-3, abs=1e-8)
 
 
+def test_distance_operator_product(psi_all, gpu):
+    psi = psi_all(gpu)
+
+    N = psi.N
+    spin_ensemble = ExactSummation(N, gpu)
+
+    psi.normalize(spin_ensemble)
+
+    # overlapping factors, such that the intermediate flip masks coincide and get merged
+    factors = [
+        1 + 0.3j * (sigma_x(0) * sigma_x(1 % N) + sigma_y(0) * sigma_y(1 % N)),
+        0.5 + sigma_z(1 % N) * sigma_z(2 % N) + 0.2 * sigma_x(2 % N),
+        sigma_x(0) + 0.7 * sigma_y(N - 1) + 0.1j * sigma_z(N // 2),
+    ]
+
+    hs_distance = HilbertSpaceDistance(N, psi.num_params, gpu)
+    op_product = OperatorProduct([Operator(factor, gpu) for factor in factors], gpu)
+    distance_test = hs_distance(psi, psi, op_product, True, spin_ensemble)
+
+    product = factors[0] * factors[1] * factors[2]
+    distance_expanded = hs_distance(psi, psi, Operator(product, gpu), True, spin_ensemble)
+
+    A = factors[0].matrix(N) @ factors[1].matrix(N) @ factors[2].matrix(N)
+    psi_vector = psi.vector
+    A_psi_vector = A @ psi_vector
+    distance_ref = sqrt(1.0 - abs(np.vdot(psi_vector, A_psi_vector))**2 / np.vdot(A_psi_vector, A_psi_vector).real)
+
+    assert distance_test == approx(distance_expanded, rel=1e-8, abs=1e-10)
+    assert distance_test == approx(distance_ref, rel=1e-8, abs=1e-10)
+
+
 # def test_distance2(psi_all, hamiltonian, gpu):
 #     psi = psi_all(gpu)
 
@@ -169,3 +203,24 @@ def test_gradient(psi_all, hamiltonian, gpu):
 #             )
 
 #     assert passed
+
+
+def test_gradient_tabulated_monte_carlo(psi_deep, hamiltonian, gpu):
+    # a tabulated state looked up at sampled configurations, which carry random bits beyond the N sites
+    psi_prime = psi_deep(gpu)
+
+    N = psi_prime.N
+    H = hamiltonian(N)
+    psi = PsiClassical(log_psi_table(psi_prime), N, gpu)
+
+    hs_distance = HilbertSpaceDistance(N, psi_prime.num_params, gpu)
+    op = Operator(1j * psi_prime.transform(H) * 1e-2, gpu)
+
+    gradient_ref, _ = hs_distance.gradient(psi, psi_prime, op, False, ExactSummation(N, gpu))
+
+    # on the host only a single Markov chain is run
+    spin_ensemble = MonteCarloLoop(2**14, 2, 10, 64 if gpu else 1, gpu)
+    gradient_test, _ = hs_distance.gradient(psi, psi_prime, op, False, spin_ensemble)
+
+    assert np.all(np.isfinite(gradient_test))
+    assert gradient_test == approx(gradient_ref, rel=1e-1, abs=1e-1 * np.max(np.abs(gradient_ref)))
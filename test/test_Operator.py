@@ -0,0 +1,166 @@
+from pyRBMonGPU import Operator, SpinBasis, ExpectationValue, ExactSummation, MonteCarloLoop, ground_state
+from QuantumExpression import sigma_x, sigma_y, sigma_z
+from pytest import approx, skip
+import numpy as np
+
+
+def all_to_all_model(N):
+    # random ZZ couplings between all pairs, evaluated row-wise as a quadratic form
+    rng = np.random.RandomState(N)
+
+    return (
+        sum(rng.normal() * sigma_z(i) * sigma_z(j) for i in range(N) for j in range(i + 1, N)) +
+        sum(rng.normal() * sigma_z(i) + 0.5 * sigma_x(i) for i in range(N))
+    )
+
+
+def heisenberg_ring(N):
+    # translation invariant ZZ couplings, evaluated by the popcount path of the quadratic form
+    return (
+        sum(
+            sigma_x(i) * sigma_x((i + 1) % N) + sigma_y(i) * sigma_y((i + 1) % N) + sigma_z(i) * sigma_z((i + 1) % N)
+            for i in range(N)
+        ) +
+        0.3 * sum(sigma_z(i) for i in range(N))
+    )
+
+
+def redundant_operator(H, gpu):
+    # the strings of H twice with halved coefficients, the second time with the symbols in reverse order
+    op = Operator(H, gpu)
+    pauli_types = np.array(op.pauli_types)
+    pauli_indices = np.array(op.pauli_indices)
+
+    for n in range(op.num_strings):
+        length = np.count_nonzero(pauli_types[n])
+        pauli_types[n, :length] = pauli_types[n, :length][::-1].copy()
+        pauli_indices[n, :length] = pauli_indices[n, :length][::-1].copy()
+
+    return Operator(
+        np.concatenate([0.5 * op.coefficients, 0.5 * op.coefficients]),
+        np.concatenate([op.pauli_types, pauli_types]).astype(np.int32),
+        np.concatenate([op.pauli_indices, pauli_indices]).astype(np.int32),
+        gpu
+    )
+
+
+def check_operator(op, H, psi, gpu):
+    # the matrix and the local energies of 'op' against the dense matrix of H
+    N = psi.N
+    H_dense = H.matrix(N)
+
+    assert op.sparse_matrix(SpinBasis(N)).toarray() == approx(H_dense, rel=1e-12, abs=1e-12)
+
+    spin_ensemble = ExactSummation(N, gpu)
+    psi.normalize(spin_ensemble)
+    psi_vector = psi.vector
+
+    expectation_value = ExpectationValue(gpu)(psi, op, spin_ensemble)
+    assert expectation_value == approx(np.vdot(psi_vector, H_dense @ psi_vector), rel=1e-10, abs=1e-10)
+
+
+def test_sparse_matrix(hamiltonian, gpu):
+    N = 8
+    H = hamiltonian(N)
+    H_dense = H.matrix(N)
+
+    op = Operator(H, gpu)
+    assert op.sparse_matrix(SpinBasis(N)).toarray() == approx(H_dense)
+
+    for num_up in range(N + 1):
+        basis = SpinBasis(N, num_up)
+        states = basis.states.astype(np.int64)
+
+        assert len(basis) == len(states)
+        assert op.sparse_matrix(basis, num_threads=2).toarray() == approx(H_dense[np.ix_(states, states)])
+
+
+def test_ground_state(hamiltonian, gpu):
+    N = 8
+    H = hamiltonian(N)
+    energies, states = np.linalg.eigh(H.matrix(N))
+
+    op = Operator(H, gpu)
+    result = ground_state(op, SpinBasis(N))
+
+    assert result.converged
+    assert result.energy == approx(energies[0])
+    assert abs(np.vdot(result.full_vector, states[:, 0])) == approx(1.0)
+
+    sector_energies = [ground_state(op, SpinBasis(N, num_up)).energy for num_up in range(N + 1)]
+    assert min(sector_energies) == approx(energies[0])
+
+
+def test_all_to_all(psi_all, gpu):
+    psi = psi_all(gpu)
+    H = all_to_all_model(psi.N)
+
+    check_operator(Operator(H, gpu), H, psi, gpu)
+
+
+def test_translation_invariant(psi_all, gpu):
+    psi = psi_all(gpu)
+    H = heisenberg_ring(psi.N)
+
+    check_operator(Operator(H, gpu), H, psi, gpu)
+
+
+def test_translation_invariant_monte_carlo(psi_all, gpu):
+    # sampled configurations carry random bits beyond the N sites, which must not enter the correlations
+    psi = psi_all(gpu)
+    N = psi.N
+    H = sum(sigma_z(i) * sigma_z((i + 1) % N) + 0.5 * sigma_z(i) * sigma_z((i + 2) % N) + 0.3 * sigma_z(i) for i in range(N))
+
+    # on the host only a single Markov chain is run
+    spin_ensemble = MonteCarloLoop(2**14, 2, 10, 64 if gpu else 1, gpu)
+    energy_test = ExpectationValue(gpu)(psi, Operator(H, gpu), spin_ensemble)
+
+    psi_vector = psi.vector
+    energy_ref = np.vdot(psi_vector, H.matrix(N) @ psi_vector) / np.vdot(psi_vector, psi_vector)
+
+    assert energy_test == approx(energy_ref, rel=5e-2, abs=5e-2 * N)
+
+
+def test_compress(psi_all, gpu):
+    psi = psi_all(gpu)
+    H = heisenberg_ring(psi.N) + all_to_all_model(psi.N)
+
+    op = redundant_operator(H, gpu)
+    compressed, report = op.compress()
+
+    assert report.num_strings == op.num_strings
+    assert report.num_merged_strings == op.num_strings // 2
+    assert report.error_bound == 0
+
+    check_operator(op, H, psi, gpu)
+    check_operator(compressed, H, psi, gpu)
+
+
+def test_jit(psi_all, tmp_path):
+    # the runtime-compiled group coefficients exist on the host only
+    psi = psi_all(False)
+    H = heisenberg_ring(psi.N) + all_to_all_model(psi.N)
+
+    op = Operator(H, False)
+    spin_ensemble = ExactSummation(psi.N, False)
+    psi.normalize(spin_ensemble)
+
+    expectation_value_ref = ExpectationValue(False)(psi, op, spin_ensemble)
+    matrix_ref = op.sparse_matrix(SpinBasis(psi.N)).toarray()
+
+    if not op.enable_jit(str(tmp_path)):
+        skip("no host compiler available")
+    assert op.jit_enabled
+
+    check_operator(op, H, psi, False)
+    assert ExpectationValue(False)(psi, op, spin_ensemble) == approx(expectation_value_ref, rel=1e-12, abs=1e-12)
+    assert op.sparse_matrix(SpinBasis(psi.N)).toarray() == approx(matrix_ref, rel=1e-12, abs=1e-12)
+
+    # a second operator loads the library from the cache
+    op_cached = Operator(H, False)
+    assert op_cached.enable_jit(str(tmp_path))
+    assert ExpectationValue(False)(psi, op_cached, spin_ensemble) == approx(expectation_value_ref, rel=1e-12, abs=1e-12)
+
+    op.disable_jit()
+    assert not op.jit_enabled
+    assert ExpectationValue(False)(psi, op, spin_ensemble) == approx(expectation_value_ref, rel=1e-12, abs=1e-12)
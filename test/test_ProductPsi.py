@@ -0,0 +1,88 @@
+from pyRBMonGPU import (
+    Spins, PsiJastrow, PsiWithJastrow, PsiDeepWithJastrow, log_psi_table, MonteCarloLoop, ExpectationValue, Operator
+)
+from pytest import approx
+import numpy as np
+
+
+def new_jastrow(N, gpu):
+    num_params = N * (N - 1) // 2
+    params = 1e-1 * (np.random.normal(size=num_params) + 1j * np.random.normal(size=num_params))
+
+    return PsiJastrow(params, N, gpu)
+
+
+def test_log_psi_s(psi_deep, gpu):
+    psi = psi_deep(gpu)
+    jastrow = new_jastrow(psi.N, gpu)
+    product = PsiDeepWithJastrow(psi, jastrow)
+
+    assert product.num_params == psi.num_params + jastrow.num_params
+    assert product.params == approx(np.concatenate([psi.params, jastrow.params]))
+
+    N = psi.N
+    J = jastrow.J
+    spins = [np.array(Spins(spins_idx).array(N)) for spins_idx in range(2**N)]
+    log_psi_jastrow = np.array([0.5 * s @ J @ s for s in spins])
+
+    assert log_psi_table(product) == approx(log_psi_table(psi) + log_psi_jastrow)
+
+
+def test_params(psi_deep, gpu):
+    psi = psi_deep(gpu)
+    product = PsiDeepWithJastrow(psi, new_jastrow(psi.N, gpu))
+    product_copy = product.copy()
+
+    params = product.params
+    params[-1] += 0.5
+    product.params = params
+
+    assert product.second.params[-1] == approx(params[-1])
+    assert product_copy.params[-1] == approx(params[-1] - 0.5)
+
+
+def test_O_k(psi, gpu):
+    # the RBM, since the translation-averaged PsiDeep yields O_k of its unshifted pass only
+    first = psi(gpu)
+    product = PsiWithJastrow(first, new_jastrow(first.N, gpu))
+
+    N = product.N
+    params = product.params
+    eps = 1e-6
+
+    O_k_ref = np.zeros((2**N, product.num_params), dtype=complex)
+    for k in range(2 * N, product.num_params):
+        delta_params = np.zeros(product.num_params, dtype=complex)
+        delta_params[k] = eps
+
+        product.params = params + delta_params
+        plus = log_psi_table(product)
+        product.params = params - delta_params
+        minus = log_psi_table(product)
+
+        # mapping the phase difference back into (-pi, pi]
+        O_k_ref[:, k] = np.log(np.exp(plus - minus)) / (2 * eps)
+
+    product.params = params
+
+    for spins_idx in range(2**N):
+        O_k_test = product.O_k_vector(Spins(spins_idx))
+        assert O_k_test[2 * N:] == approx(O_k_ref[spins_idx, 2 * N:], rel=1e-5, abs=1e-7)
+
+
+def test_monte_carlo(psi, hamiltonian, gpu):
+    # local energies along the Markov chains, which move by incremental spin flips of both factors
+    first = psi(gpu)
+    product = PsiWithJastrow(first, new_jastrow(first.N, gpu))
+
+    N = product.N
+    H = hamiltonian(N)
+
+    # on the host only a single Markov chain is run
+    spin_ensemble = MonteCarloLoop(2**14, 2, 10, 64 if gpu else 1, gpu)
+    energy_test = ExpectationValue(gpu)(product, Operator(H, gpu), spin_ensemble)
+
+    psi_vector = product.vector
+    energy_ref = np.vdot(psi_vector, H.matrix(N) @ psi_vector) / np.vdot(psi_vector, psi_vector)
+
+    assert energy_test == approx(energy_ref, rel=5e-2, abs=1e-1)
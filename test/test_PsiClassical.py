@@ -0,0 +1,38 @@
+from pyRBMonGPU import PsiClassical, new_deep_neural_network, convert_classical_to_network_files
+from test_PsiDeepMin import write_text_file
+from pytest import mark
+import numpy as np
+import os
+
+
+def write_snapshot(directory, index, N):
+    # the text files of a snapshot: the neural network and the csv-files of the variational parameters
+    psi = new_deep_neural_network(N, [N], [4], noise=1e-2)
+    write_text_file(os.path.join(directory, f"psi_{index}_compressed.txt"), psi, 0.0)
+
+    rng = np.random.RandomState(index)
+    variational_parameters = 1e-1 * (rng.normal(size=5) + 1j * rng.normal(size=5))
+    for part, values in (("Re", variational_parameters.real), ("Im", variational_parameters.imag)):
+        with open(os.path.join(directory, f"a_VP_{index}_{part}.csv"), "w") as f:
+            f.write("\n".join(repr(float(x)) for x in values) + "\n")
+
+    # leaving zeros in between, which are not stored
+    with open(os.path.join(directory, f"a_indexVP_{index}.csv"), "w") as f:
+        f.write("\n".join(str(i) for i in [0, 1, 0, 2, 3, 4, 0, 1]) + "\n")
+
+
+@mark.parametrize("perturbation_order", [1, 2])
+def test_network_files(perturbation_order, tmp_path):
+    N = 8
+    directory = str(tmp_path)
+    write_snapshot(directory, 0, N)
+
+    configurations = np.arange(2**N, dtype=np.uint64)
+    result_text = PsiClassical(directory, 0, N, False, perturbation_order).log_psi_s_batch(configurations)
+
+    convert_classical_to_network_files(directory, 0)
+    for file_name in ("psi_0_compressed.txt", "a_VP_0_Re.csv", "a_VP_0_Im.csv", "a_indexVP_0.csv"):
+        os.remove(os.path.join(directory, file_name))
+
+    psi = PsiClassical(directory, 0, N, False, perturbation_order)
+    assert np.array_equal(psi.log_psi_s_batch(configurations), result_text)
@@ -1,11 +1,32 @@
-from pyRBMonGPU import Spins, activation_function
-from pytest import approx
+from pyRBMonGPU import (
+    Spins, PsiDeep, PsiClassical, ExactSummation, new_deep_neural_network, activation_function, log_psi_table, get_O_k_vector
+)
+from pytest import approx, mark
 import numpy as np
 import cmath
 import random
 
 translational_invariance = True
 
+logcosh = np.vectorize(activation_function, otypes=[complex])
+
+
+def forward_pass_ref(W, b, connections, spins):
+    # output-activations of the last layer, each unit reading the lhs-units given by the connectivity of its layer
+    activations = np.array(spins, dtype=complex)
+    for w, b_layer, c in zip(W, b, connections):
+        activations = logcosh(np.sum(w * activations[c], axis=0) + b_layer)
+
+    return activations
+
+
+def log_psi_ref(psi, spins):
+    # averaged over all translations
+    return sum(
+        np.sum(forward_pass_ref(psi.W, psi.b, psi.connections, np.roll(spins, shift)))
+        for shift in range(psi.N)
+    ) / psi.N
+
 
 def test_psi_s(psi_deep, gpu):
     psi = psi_deep(gpu)
@@ -47,3 +68,255 @@ def test_psi_s(psi_deep, gpu):
         psi_s_ref = cmath.exp(log_psi_s_ref)
 
         assert psi_vector[spins_idx] == approx(psi_s_ref)
+
+
+def test_params_view(psi_deep, gpu):
+    psi = psi_deep(gpu)
+
+    params = psi.params
+    assert not np.shares_memory(params, psi.params)
+
+    view = psi.params_view()
+    assert np.shares_memory(view, psi.params_view())
+
+    view[-1] += 0.1j
+    psi.update_params()
+
+    assert psi.W[-1][-1, -1] == approx(view[-1])
+    assert psi.params[-1] == approx(view[-1])
+    assert psi.copy().params[-1] == approx(view[-1])
+
+
+def test_copy_on_write(psi_deep, gpu):
+    psi = psi_deep(gpu)
+    psi_vector = psi._vector
+
+    psi_copy = psi.copy()
+    psi_copy.params = psi_copy.params + 0.1
+
+    assert psi._vector == approx(psi_vector)
+    assert psi_copy._vector != approx(psi_vector)
+
+
+def test_copy_after_params_access(psi_deep, gpu):
+    psi = psi_deep(gpu)
+
+    # reading and assigning the parameters, as the training loop does
+    psi.params = psi.params + 0.1
+    assert psi.copy().shares_params_with(psi)
+
+    # only a live view forces copies to get their own parameters
+    view = psi.params_view()
+    assert not psi.copy().shares_params_with(psi)
+
+    del view
+    assert psi.copy().shares_params_with(psi)
+
+
+def test_write_after_copy_with_view(psi_deep, gpu):
+    psi = psi_deep(gpu)
+    view = psi.params_view()
+
+    psi_copy = psi.copy()
+    copy_vector = psi_copy._vector
+
+    view[-1] += 0.1j
+    psi.update_params()
+
+    assert psi_copy._vector == approx(copy_vector)
+    assert psi._vector != approx(copy_vector)
+
+    psi_copy.params = psi_copy.params + 0.1
+    assert view == approx(psi.params)
+    assert psi.params[-1] == approx(psi_copy.params[-1] - 0.1)
+
+
+def test_save_load(psi_deep, gpu, tmp_path):
+    psi = psi_deep(gpu)
+
+    file_name = str(tmp_path / "psi.bin")
+    psi.save(file_name)
+    psi_loaded = type(psi).load(file_name, gpu)
+
+    assert psi_loaded.params == approx(psi.params)
+    assert psi_loaded.prefactor == psi.prefactor
+    assert psi_loaded._vector == approx(psi._vector)
+
+
+def test_log_psi_table(psi_deep, gpu):
+    psi = psi_deep(gpu)
+
+    table = log_psi_table(psi)
+    assert psi.prefactor * np.exp(table) == approx(psi.vector)
+
+    psi_tabulated = PsiClassical(table, psi.N, gpu)
+    assert psi_tabulated.tabulated
+    assert psi_tabulated.vector == approx(np.exp(table))
+
+    # a state given by its table alone has nothing to fall back on
+    psi_tabulated.clear_table()
+    assert psi_tabulated.tabulated
+
+
+def test_deep_log_psi_s(psi_deep_layers, gpu):
+    psi = psi_deep_layers(gpu)
+    N = psi.N
+
+    table = log_psi_table(psi)
+    table_ref = np.array([log_psi_ref(psi, Spins(spins_idx).array(N)) for spins_idx in range(2**N)])
+
+    assert np.exp(table) == approx(np.exp(table_ref), rel=1e-10)
+
+
+def test_deep_O_k(psi_deep_layers, gpu):
+    psi = psi_deep_layers(gpu)
+    N = psi.N
+    W, b, connections = psi.W, psi.b, psi.connections
+
+    # the parameters after alpha and beta: the biases and the lhs-weights of each layer
+    params = np.concatenate([np.concatenate([b_layer, w.ravel()]) for w, b_layer in zip(W, b)])
+
+    def unshifted_log_psi(params, spins):
+        W_params, b_params = [], []
+        begin = 0
+        for w, b_layer in zip(W, b):
+            b_params.append(params[begin:begin + b_layer.size])
+            begin += b_layer.size
+            W_params.append(params[begin:begin + w.size].reshape(w.shape))
+            begin += w.size
+
+        return np.sum(forward_pass_ref(W_params, b_params, connections, spins))
+
+    eps = 1e-6
+    for spins_idx in random.sample(range(2**N), 3):
+        spins = Spins(spins_idx).array(N)
+
+        # O_k are the derivatives of the unshifted pass
+        O_k_ref = np.zeros(len(params), dtype=complex)
+        for k in range(len(params)):
+            delta_params = np.zeros(len(params), dtype=complex)
+            delta_params[k] = eps
+            O_k_ref[k] = (
+                unshifted_log_psi(params + delta_params, spins) - unshifted_log_psi(params - delta_params, spins)
+            ) / (2 * eps)
+
+        O_k_test = psi.O_k_vector(Spins(spins_idx))
+        assert O_k_test[2 * N:] == approx(O_k_ref, rel=1e-5, abs=1e-7)
+
+
+def test_deep_flips(psi_deep_layers, gpu):
+    psi = psi_deep_layers(gpu)
+    N = psi.N
+
+    spins_idx = random.randint(0, 2**N - 1)
+    positions = np.random.randint(N, size=100)
+
+    # cached angles, updated on every flip
+    log_psi_test = psi.log_psi_s_along_flips(Spins(spins_idx), positions.tolist())
+
+    for position, log_psi in zip(positions, log_psi_test):
+        spins_idx ^= 1 << int(position)
+        assert np.exp(log_psi) == approx(np.exp(log_psi_ref(psi, Spins(spins_idx).array(N))), rel=1e-10)
+
+
+def test_cached_angles_along_chain(psi_deep_layers, gpu):
+    # the angles carried along a long chain of flips against a fresh evaluation of each configuration
+    psi = psi_deep_layers(gpu)
+    N = psi.N
+    table = log_psi_table(psi)
+
+    spins_idx = random.randint(0, 2**N - 1)
+    positions = np.random.randint(N, size=1000)
+    log_psi_test = psi.log_psi_s_along_flips(Spins(spins_idx), positions.tolist())
+
+    for position, log_psi in zip(positions, log_psi_test):
+        spins_idx ^= 1 << int(position)
+        assert np.exp(log_psi) == approx(np.exp(table[spins_idx]), rel=1e-10)
+
+
+def test_O_k_after_log_psi(psi_deep_layers, gpu):
+    # the ensemble evaluates log_psi first, whose forward pass is reused for O_k
+    psi = psi_deep_layers(gpu)
+    N = psi.N
+
+    spin_ensemble = ExactSummation(N, gpu)
+    psi.normalize(spin_ensemble)
+    O_k_test, _ = get_O_k_vector(psi, spin_ensemble)
+
+    probabilities = abs(psi.vector)**2
+    O_k_ref = sum(
+        probabilities[spins_idx] * psi.O_k_vector(Spins(spins_idx)) for spins_idx in range(2**N)
+    )
+
+    assert O_k_test[2 * N:] == approx(O_k_ref[2 * N:], rel=1e-10, abs=1e-12)
+
+
+@mark.parametrize("N, M, C", [
+    # all translations fit into the buffers of the batched forward pass
+    (8, [16, 8, 4], [4, 8, 8]),
+    # too wide for them, hence evaluated one translation after the other
+    (16, [16, 48, 8], [4, 16, 48]),
+])
+def test_batched_shifts(N, M, C, gpu):
+    psi = new_deep_neural_network(N, M, C, noise=1e-2, gpu=gpu)
+
+    spins_idx = random.randint(0, 2**N - 1)
+    positions = np.random.randint(N, size=20)
+    log_psi_test = psi.log_psi_s_along_flips(Spins(spins_idx), positions.tolist())
+
+    for position, log_psi in zip(positions, log_psi_test):
+        spins_idx ^= 1 << int(position)
+        assert np.exp(log_psi) == approx(np.exp(log_psi_ref(psi, Spins(spins_idx).array(N))), rel=1e-10)
+
+
+def test_dense_layers_in_any_order(gpu):
+    # the same network, but each unit lists its lhs-units in a different order
+    psi = new_deep_neural_network(8, [8, 8, 4, 2], [4, 8, 8, 4], noise=1e-2, gpu=gpu)
+    rng = np.random.RandomState(0)
+
+    connections_list, W_list = [], []
+    for connections, w in zip(psi.connections, psi.W):
+        connections, w = np.array(connections), np.array(w)
+        for j in range(connections.shape[1]):
+            permutation = rng.permutation(connections.shape[0])
+            connections[:, j] = connections[permutation, j]
+            w[:, j] = w[permutation, j]
+
+        connections_list.append(connections.astype(np.uint32))
+        W_list.append(w)
+
+    psi_permuted = PsiDeep(
+        psi.alpha, psi.beta, psi.b, connections_list, W_list, psi.prefactor, psi.free_quantum_axis, gpu
+    )
+
+    assert np.exp(log_psi_table(psi_permuted)) == approx(np.exp(log_psi_table(psi)), rel=1e-10)
+
+
+def test_set_params(psi_deep_layers, gpu):
+    psi = psi_deep_layers(gpu)
+    N = psi.N
+    psi_copy = psi.copy()
+    table = log_psi_table(psi)
+
+    params = psi.params
+    num_weights = len(params) - 2 * N
+    params[2 * N:] += 1e-1 * (np.random.normal(size=num_weights) + 1j * np.random.normal(size=num_weights))
+    psi.params = params
+
+    # all buffers derived from the parameters have to follow, as if the network was built from them
+    psi_fresh = PsiDeep(
+        psi.alpha, psi.beta, psi.b, [c.astype(np.uint32) for c in psi.connections], psi.W,
+        psi.prefactor, psi.free_quantum_axis, gpu
+    )
+    assert psi_fresh.params == approx(params)
+    assert log_psi_table(psi) == approx(log_psi_table(psi_fresh), rel=1e-10)
+
+    spins_idx = random.randint(0, 2**N - 1)
+    assert psi.O_k_vector(Spins(spins_idx)) == approx(psi_fresh.O_k_vector(Spins(spins_idx)), rel=1e-10)
+
+    positions = np.random.randint(N, size=20).tolist()
+    assert psi.log_psi_s_along_flips(Spins(spins_idx), positions) == approx(
+        psi_fresh.log_psi_s_along_flips(Spins(spins_idx), positions), rel=1e-10
+    )
+
+    assert log_psi_table(psi_copy) == approx(table)
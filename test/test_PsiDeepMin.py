@@ -0,0 +1,91 @@
+from pyRBMonGPU import PsiDeepMin, Spins, new_deep_neural_network, convert_to_network_file
+from pytest import approx, mark
+import numpy as np
+
+
+networks = [
+    (8, [8], [4]),
+    (8, [16, 8, 4], [4, 8, 8]),
+    (6, [12, 6, 3], [6, 12, 6]),
+]
+
+
+def write_text_file(file_name, psi, log_prefactor):
+    # the text format of 'psi_<index>_compressed.txt', with the connections starting from the last layer
+    numbers = [psi.N, len(psi.b), log_prefactor] + [len(b) for b in psi.b]
+    for connections in reversed(psi.connections):
+        numbers += [connections.shape[0]] + list(np.ravel(connections))
+    for w, b in zip(psi.W, psi.b):
+        for x in np.concatenate([b, np.ravel(w)]):
+            numbers += [x.real, x.imag]
+
+    with open(file_name, "w") as f:
+        f.write(" ".join(repr(float(x)) if isinstance(x, (float, np.floating)) else str(int(x)) for x in numbers))
+
+
+def activation_function(z):
+    # the rational approximation of log(cosh(z)) used by PsiDeepMin
+    w = np.where(z.real <= 0, -z, z)
+    denominator = 9.19376335670885 + w * (10.2180213465 + w * (7.771429504240965 + w * (3.746646023906276 + w)))
+
+    return 0.9003320053750442 * w + (5.49914721954 - 2.16564366435 * w) / denominator - 0.598139
+
+
+def log_psi_ref(psi, spins, log_prefactor):
+    # one translation after the other
+    result = 0
+    for shift in range(psi.N):
+        activations = np.roll(np.array(spins, dtype=complex), -shift)
+        for w, b, connections in zip(psi.W, psi.b, psi.connections):
+            activations = activation_function(np.sum(w * activations[connections], axis=0) + b)
+
+        result += np.sum(activations)
+
+    return result / psi.N + log_prefactor
+
+
+@mark.parametrize("N, M, C", networks)
+def test_log_psi_s_batch(N, M, C, tmp_path):
+    psi = new_deep_neural_network(N, M, C, noise=1e-2)
+    log_prefactor = 0.25
+
+    file_name = str(tmp_path / "psi_0_compressed.txt")
+    write_text_file(file_name, psi, log_prefactor)
+    psi_min = PsiDeepMin(file_name)
+    assert psi_min.N == N
+
+    configurations = np.arange(2**N, dtype=np.uint64)
+    result_batch = psi_min.log_psi_s_batch(configurations, num_threads=4)
+    assert psi_min.log_psi_s_batch(configurations, num_threads=1) == approx(result_batch, rel=1e-14)
+
+    for spins_idx in configurations:
+        spins = Spins(int(spins_idx)).array(N)
+
+        # every translation of a configuration has the same amplitude
+        for shift in range(N):
+            assert psi_min.log_psi_s(np.roll(spins, shift).tolist()) == approx(result_batch[spins_idx], rel=1e-12)
+
+        assert result_batch[spins_idx] == approx(log_psi_ref(psi, spins, log_prefactor), rel=1e-10)
+
+
+@mark.parametrize("N, M, C", networks)
+def test_network_file(N, M, C, tmp_path):
+    psi = new_deep_neural_network(N, M, C, noise=1e-2)
+
+    text_file_name = str(tmp_path / "psi_0_compressed.txt")
+    network_file_name = str(tmp_path / "psi_0_compressed.bin")
+    write_text_file(text_file_name, psi, 0.25)
+    convert_to_network_file(text_file_name, network_file_name)
+
+    configurations = np.arange(2**N, dtype=np.uint64)
+    result_text = PsiDeepMin(text_file_name).log_psi_s_batch(configurations)
+
+    # the parameters are used in-place from the mapped file, bit for bit the same as parsed from the text
+    psi_mapped = PsiDeepMin(network_file_name)
+    assert psi_mapped.N == N
+    assert np.array_equal(psi_mapped.log_psi_s_batch(configurations), result_text)
+
+    # saving a mapped network
+    copy_file_name = str(tmp_path / "psi_copy.bin")
+    psi_mapped.save(copy_file_name)
+    assert np.array_equal(PsiDeepMin(copy_file_name).log_psi_s_batch(configurations), result_text)
@@ -0,0 +1,32 @@
+from pyRBMonGPU import PsiHamiltonian, Operator, Spins
+from QuantumExpression import sigma_x, sigma_z
+from pytest import approx
+import numpy as np
+
+
+def test_carried_energy(gpu):
+    N = 8
+    rng = np.random.RandomState(0)
+
+    # all-to-all ZZ couplings, fields and an off-diagonal part, which does not enter the diagonal energy
+    H = (
+        sum(rng.normal() * sigma_z(i) * sigma_z(j) for i in range(N) for j in range(i + 1, N)) +
+        sum(rng.normal() * sigma_z(i) + 0.5 * sigma_x(i) for i in range(N)) +
+        0.3 * sigma_z(0) * sigma_z(2) * sigma_z(4)
+    )
+    psi = PsiHamiltonian(N, Operator(H, gpu))
+    diagonal_energies = np.diag(H.matrix(N))
+
+    # crossing the recomputation from scratch a few times
+    num_flips = 3 * PsiHamiltonian.num_flips_per_refresh + 10
+    positions = rng.randint(N, size=num_flips)
+
+    configuration = int(rng.randint(2**N))
+    # garbage bits above N, as left by a randomly initialized Markov chain
+    garbage = int(rng.randint(2**40)) << N
+
+    carried_energies = psi.carried_energies(Spins(garbage | configuration), positions.tolist())
+
+    for position, carried_energy in zip(positions, carried_energies):
+        configuration ^= 1 << int(position)
+        assert carried_energy == approx(diagonal_energies[configuration], rel=1e-10, abs=1e-10)